@@ -13,15 +13,22 @@
 // C standard includes
 // -------------------
 
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 // -----------------------------------
 // Expressif SDK-IDF standard includes
 // -----------------------------------
 
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <esp_console.h>
 #include <argtable3/argtable3.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 // --------------
 // Local includes
@@ -37,10 +44,25 @@
 
 #define CMD_TAG "CMDS"  // logging tag
 
+#define PARAMS_BATCH    8    // frequencies solved at once by 'params' sweeps
+#define PARAMS_MAX_ROWS 1000 // sweep table length limit
+#define PARAMS_PARETO   32   // largest Pareto set displayed by 'params -x'
+#define PATTERN_MAX_SEG 32   // longest pattern given to 'pattern'
+#define SWEEP_POLL_MS   100  // 'sweep' progress check period
+#define SCHEDULE_MAX_EV 32   // longest event list given to 'schedule'
+
 /* ************************************************************************* */
 /*                               DATATYPES SECTION                           */
 /* ************************************************************************* */
 
+// An event given to 'schedule', due at_ms after the command is run
+typedef struct {
+    rmt_channel_t channel;
+    fgen_event_t  event;
+    double        freq;
+    double        duty_cycle;
+    double        at_ms;
+} schedule_event_t;
 
 
 /* ************************************************************************* */
@@ -53,18 +75,59 @@ fgen_resources_t* FGEN[RMT_CHANNEL_MAX] = { 0, 0, 0, 0, 0, 0, 0, 0 };
 // 'params' command arguments variable
 static struct params_args_s {
     struct arg_dbl *frequency;
+    struct arg_int *freq_mhz;
+    struct arg_str *freq_ratio;
     struct arg_dbl *duty_cycle;
+    struct arg_int *duty_ppm;
+    struct arg_int *tolerance;
+    struct arg_str *objective;
+    struct arg_lit *fractional;
+    struct arg_str *weights;
+    struct arg_lit *streaming;
+    struct arg_lit *compensate;
+    struct arg_dbl *phase;
+    struct arg_lit *pareto;
+    struct arg_dbl *stop;
+    struct arg_dbl *step;
+    struct arg_lit *logscale;
     struct arg_end *end;
 } params_args;
 
 // 'create' command arguments variable
 static struct create_args_s {
     struct arg_dbl *frequency;
+    struct arg_int *freq_mhz;
+    struct arg_str *freq_ratio;
     struct arg_dbl *duty_cycle;
+    struct arg_int *duty_ppm;
+    struct arg_int *tolerance;
+    struct arg_str *objective;
+    struct arg_lit *fractional;
+    struct arg_str *weights;
+    struct arg_lit *streaming;
+    struct arg_lit *compensate;
+    struct arg_lit *min_wrap;
+    struct arg_lit *zero_copy;
+    struct arg_dbl *phase;
     struct arg_int *gpio_num;
     struct arg_end *end;
 } create_args;
 
+// 'pattern' command arguments variable
+static struct pattern_args_s {
+    struct arg_str *segments;
+    struct arg_lit *dry_run;
+    struct arg_int *gpio_num;
+    struct arg_end *end;
+} pattern_args;
+
+// 'plan' command arguments variable
+static struct plan_args_s {
+    struct arg_str *generators;
+    struct arg_lit *apply;
+    struct arg_end *end;
+} plan_args;
+
 // 'delete' command arguments variable
 static struct delete_args_s {
     struct arg_int *channel;
@@ -82,6 +145,7 @@ static struct list_args_s {
 // 'start' command arguments variable
 static struct start_args_s {
     struct arg_int *channel;
+    struct arg_lit *sync;
     struct arg_end *end;
 } start_args;
 
@@ -91,6 +155,48 @@ static struct stop_args_s {
     struct arg_end *end;
 } stop_args;
 
+// 'set' command arguments variable
+static struct set_args_s {
+    struct arg_int *channel;
+    struct arg_dbl *frequency;
+    struct arg_dbl *duty_cycle;
+    struct arg_dbl *phase;
+    struct arg_end *end;
+} set_args;
+
+// 'sweep' command arguments variable
+static struct sweep_args_s {
+    struct arg_int *channel;
+    struct arg_dbl *start;
+    struct arg_dbl *stop;
+    struct arg_dbl *duty_cycle;
+    struct arg_int *steps;
+    struct arg_dbl *dwell;
+    struct arg_dbl *total;
+    struct arg_lit *logscale;
+    struct arg_str *objective;
+    struct arg_int *tolerance;
+    struct arg_lit *background;
+    struct arg_lit *abort;
+    struct arg_end *end;
+} sweep_args;
+
+// 'burst' command arguments variable
+static struct burst_args_s {
+    struct arg_int *channel;
+    struct arg_dbl *periods;
+    struct arg_lit *background;
+    struct arg_lit *abort;
+    struct arg_end *end;
+} burst_args;
+
+// 'schedule' command arguments variable
+static struct schedule_args_s {
+    struct arg_str *events;
+    struct arg_lit *cancel;
+    struct arg_end *end;
+} schedule_args;
+
 // 'autoload' command arguments variable
 static struct autoload_args_s {
     struct arg_lit *yes;
@@ -110,6 +216,24 @@ static struct save_args_s {
     struct arg_end *end;
 } save_args;
 
+// 'cache' command arguments variable
+static struct cache_args_s {
+    struct arg_lit *clear;
+    struct arg_end *end;
+} cache_args;
+
+// 'mem' command arguments variable
+static struct mem_args_s {
+    struct arg_end *end;
+} mem_args;
+
+// 'gpio' command arguments variable
+static struct gpio_args_s {
+    struct arg_str *pins;
+    struct arg_lit *restore;
+    struct arg_end *end;
+} gpio_args;
+
 /* ************************************************************************* */
 /*                        AUXILIAR FUNCTIONS SECTION                         */
 /* ************************************************************************* */
@@ -118,14 +242,14 @@ static void register_fgen(fgen_resources_t* fgen)
 {
     extern fgen_resources_t* FGEN[];
 
-    FGEN[fgen->channel] = fgen; 
+    FGEN[fgen->handle] = fgen; 
 }
 
 static void unregister_fgen(fgen_resources_t* fgen)
 {
     extern fgen_resources_t* FGEN[];
 
-    FGEN[fgen->channel] = 0; 
+    FGEN[fgen->handle] = 0; 
 }
 
 static fgen_resources_t* search_fgen(rmt_channel_t channel)
@@ -133,7 +257,7 @@ static fgen_resources_t* search_fgen(rmt_channel_t channel)
     extern fgen_resources_t* FGEN[];
 
     for (rmt_channel_t i = 0; i<RMT_CHANNEL_MAX; i++) {
-        if ( (FGEN[i] != NULL) && (FGEN[i]->channel == channel) ) {
+        if ( (FGEN[i] != NULL) && (FGEN[i]->handle == channel) ) {
             return FGEN[i];
         }
     }
@@ -150,7 +274,7 @@ static const char* state_msg(fgen_resources_t* fgen)
 static void print_fgen_summary(fgen_resources_t* fgen)
 {
     printf("Channel: %02d [%s]\tGPIO: %02d\tFreq.: %0.2f Hz\tDC.: %0.0f%%\tBlocks: %d\n", 
-                fgen->channel, state_msg(fgen), fgen->gpio_num, fgen->info.freq, 100*fgen->info.duty_cycle, fgen->info.mem_blocks);
+                fgen->handle, state_msg(fgen), fgen->gpio_num, fgen->info.freq, 100*fgen->info.duty_cycle, fgen->info.mem_blocks);
 }
 
 static void print_config_summary(rmt_channel_t channel, freq_nvs_info_t* info)
@@ -159,6 +283,77 @@ static void print_config_summary(rmt_channel_t channel, freq_nvs_info_t* info)
                 channel, "nvs", info->gpio_num, info->freq, 100*info->duty_cycle, 0);
 }
 
+// Solver objective from the -o argument, error if not given
+static esp_err_t parse_objective(struct arg_str* objective, fgen_objective_t* obj)
+{
+    static const char* names[] = {"error", "blocks", "jitter"};
+
+    *obj = FGEN_OBJ_ERROR;
+    if (objective->count == 0) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < sizeof(names)/sizeof(names[0]); i++) {
+        if (strcmp(objective->sval[0], names[i]) == 0) {
+            *obj = i;
+            return ESP_OK;
+        }
+    }
+    printf("Objective must be one of error, blocks or jitter\n");
+    return ESP_ERR_INVALID_ARG;
+}
+
+// Solver options from the -t, -o, -a, -w, -S and -C arguments
+static esp_err_t parse_options(struct arg_int* tolerance, struct arg_str* objective, struct arg_lit* fractional, 
+                               struct arg_str* weights, struct arg_lit* streaming, struct arg_lit* compensate,
+                               fgen_options_t* opt)
+{
+    opt->tol_ppm     = (tolerance->count) ? tolerance->ival[0] : 0;
+    opt->fractional  = fractional->count > 0;
+    opt->streaming   = streaming->count > 0;
+    opt->compensate  = compensate->count > 0;
+    opt->min_wrap    = false;
+    opt->zero_copy   = false;
+    opt->phase       = 0.0;
+    opt->freq_weight = 0;
+    opt->duty_weight = 0;
+    if (weights->count && sscanf(weights->sval[0], "%u:%u", &opt->freq_weight, &opt->duty_weight) != 2) {
+        printf("Weights must be given as <freq>:<duty>\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return parse_objective(objective, &opt->objective);
+}
+
+// Computes the frequency generator parameters from whichever
+// frequency (Hz, mHz or num/den Hz) and duty cycle (ratio or ppm) form was given
+static esp_err_t compute_info(struct arg_dbl* frequency, struct arg_int* freq_mhz, struct arg_str* freq_ratio, 
+                              struct arg_dbl* duty_cycle, struct arg_int* duty_ppm, const fgen_options_t* opt, 
+                              fgen_info_t* info)
+{
+    unsigned long long num, den;
+    uint32_t ppm;
+
+    if (frequency->count + freq_mhz->count + freq_ratio->count != 1) {
+        printf("Give the frequency in exactly one of the -f, -m or -r forms\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (frequency->count) {
+        return fgen_info_opt(frequency->dval[0], 
+                             (duty_ppm->count) ? duty_ppm->ival[0] / 1000000.0 : duty_cycle->dval[0], 
+                             opt, info);
+    }
+
+    ppm = (duty_ppm->count) ? duty_ppm->ival[0] : (uint32_t)(duty_cycle->dval[0] * 1000000 + 0.5);
+    if (freq_mhz->count) {
+        return fgen_info_ratio_opt(freq_mhz->ival[0], 1000, ppm, opt, info);
+    }
+    if (sscanf(freq_ratio->sval[0], "%llu/%llu", &num, &den) != 2) {
+        printf("Frequency ratio must be given as <num>/<den>\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return fgen_info_ratio_opt(num, den, ppm, opt, info);
+}
+
 
 /* ************************************************************************* */
 /*                     COMMAND IMPLEMENTATION SECTION                        */
@@ -175,18 +370,47 @@ static void register_params()
     extern struct params_args_s params_args;
 
     params_args.frequency =
-        arg_dbl1("f", "freq", "<Hz>", "Frequency");
+        arg_dbl0("f", "freq", "<Hz>", "Frequency");
+    params_args.freq_mhz =
+        arg_int0("m", "mhz", "<mHz>", "Exact frequency in millihertz");
+    params_args.freq_ratio =
+        arg_str0("r", "ratio", "<num/den>", "Exact frequency as a ratio in Hz");
     params_args.duty_cycle =
         arg_dbl0("d", "duty", "<duty cycle>",
                  "Defaults to 0.5 (50%) if not given");
     params_args.duty_cycle->dval[0] = 0.5; // Give it a default value
+    params_args.duty_ppm =
+        arg_int0("p", "ppm", "<ppm>", "Exact duty cycle in parts per million");
+    params_args.tolerance =
+        arg_int0("t", "tol", "<ppm>", "Frequency error allowed to meet the objective");
+    params_args.objective =
+        arg_str0("o", "objective", "<error|blocks|jitter>", "What to minimize. Defaults to error");
+    params_args.fractional =
+        arg_lit0("a", "frac", "Alternates N and N+1 tick periods for a better average frequency");
+    params_args.weights =
+        arg_str0("w", "weights", "<freq:duty>", "Weights of the frequency and duty cycle errors. Defaults to 1:0");
+    params_args.streaming =
+        arg_lit0("S", "stream", "Streams the items from RAM through a single RMT block");
+    params_args.compensate =
+        arg_lit0("C", "compensate", "Takes the loop idle tick out of the last period");
+    params_args.phase =
+        arg_dbl0("P", "phase", "<deg>", "Delay relative to generators started together, in [0,360)");
+    params_args.pareto =
+        arg_lit0("x", "pareto", "Lists all the best trade-offs within the tolerance");
+    params_args.stop =
+        arg_dbl0("F", "stop", "<Hz>", "Sweep from -f frequency up to this one");
+    params_args.step =
+        arg_dbl0("s", "step", "<step>", "Sweep step in Hz, or factor with --log");
+    params_args.logscale =
+        arg_lit0("l", "log", "Logarithmic sweep");
   
     params_args.end = arg_end(3);
 
     const esp_console_cmd_t cmd = {
         .command  = "params",
         .help     = "Computes the frequency generator parameters as well as the needed resources. "
-                    "Does not create a frequency generator. ",
+                    "Does not create a frequency generator. "
+                    "Displays a table for a whole frequency range if -F is given.",
         .hint     = NULL,
         .func     = exec_params,
         .argtable = &params_args
@@ -194,11 +418,71 @@ static void register_params()
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
 
+// 'params' command implementation for a frequency range
+static int exec_params_range(double start, double stop, double step, bool logscale, double duty_cycle)
+{
+    fgen_request_t req[PARAMS_BATCH];
+    fgen_info_t    info[PARAMS_BATCH];
+    esp_err_t      status[PARAMS_BATCH];
+    size_t         rows, n;
+    double         freq;
+
+    if (start <= 0 || stop < start || (logscale && step <= 1.0) || (!logscale && step <= 0)) {
+        printf("Sweep needs 0 < start <= stop and a step > 0 (or a factor > 1 with --log)\n");
+        return 1;
+    }
+
+    printf("------------------------------------------------------------------\n");
+    printf("Freq. (Hz)\tFinal (Hz)\tErr. (ppm)\tPresc.\tN\tItems\tBlocks\tJitter (us)\n");
+    freq = start;
+    for (rows = 0; rows < PARAMS_MAX_ROWS && freq <= stop; rows += n) {
+        for (n = 0; n < PARAMS_BATCH && freq <= stop; n++) {
+            req[n].freq       = freq;
+            req[n].duty_cycle = duty_cycle;
+            freq = (logscale) ? freq * step : start + (rows + n + 1) * step;
+        }
+        fgen_info_batch(req, n, info, status);
+        for (size_t i = 0; i < n; i++) {
+            if (status[i] != ESP_OK) {
+                printf("%0.4f\t%s\n", req[i].freq, esp_err_to_name(status[i]));
+                continue;
+            }
+            printf("%0.4f\t%0.4f\t%0.3f\t\t%d\t%d\t%d\t%d\t%0.3f\n", req[i].freq, info[i].freq, 
+                (info[i].freq - req[i].freq) * 1000000 / req[i].freq, info[i].prescaler, info[i].N, 
+                info[i].onitems, info[i].mem_blocks, info[i].jitter*1000000);
+        }
+    }
+    printf("------------------------------------------------------------------\n");
+    return 0;
+}
+
+// 'params' command implementation for the Pareto set
+static int exec_params_pareto(double freq, double duty_cycle, uint32_t tol_ppm)
+{
+    static fgen_info_t set[PARAMS_PARETO];
+    size_t n = PARAMS_PARETO;
+
+    if (fgen_info_pareto(freq, duty_cycle, tol_ppm, set, &n) != ESP_OK) {
+        printf("INVALID FREQUENCY GENERATOR PARAMETERS\n");
+        return 1;
+    }
+
+    printf("------------------------------------------------------------------\n");
+    printf("Final (Hz)\tErr. (ppm)\tPresc.\tN\tItems\tBlocks\tJitter (us)\n");
+    for (size_t i = 0; i < n; i++) {
+        printf("%0.4f\t%d\t\t%d\t%d\t%d\t%d\t%0.3f\n", set[i].freq, set[i].freq_err, set[i].prescaler, 
+            set[i].N, set[i].onitems, set[i].mem_blocks, set[i].jitter*1000000);
+    }
+    printf("------------------------------------------------------------------\n");
+    return 0;
+}
+
 // 'params' command implementation
 static int exec_params(int argc, char **argv)
 {
     extern struct params_args_s params_args;
     fgen_info_t    info;
+    fgen_options_t opt;
 
     int nerrors = arg_parse(argc, argv, (void **) &params_args);
     if (nerrors != 0) {
@@ -206,19 +490,62 @@ static int exec_params(int argc, char **argv)
         return 1;
     }
 
-    fgen_info( params_args.frequency->dval[0], 
-               params_args.duty_cycle->dval[0], 
-               &info);
+    if (parse_options(params_args.tolerance, params_args.objective, params_args.fractional, params_args.weights, 
+                      params_args.streaming, params_args.compensate, &opt) != ESP_OK) {
+        return 1;
+    }
+    opt.phase = (params_args.phase->count) ? params_args.phase->dval[0] : 0.0;
+
+    if (params_args.pareto->count) {
+        if (params_args.frequency->count == 0) {
+            printf("The Pareto set needs -f <Hz>\n");
+            return 1;
+        }
+        return exec_params_pareto(params_args.frequency->dval[0], 
+                                  (params_args.duty_ppm->count) ? params_args.duty_ppm->ival[0] / 1000000.0 : params_args.duty_cycle->dval[0],
+                                  opt.tol_ppm);
+    }
+
+    if (params_args.stop->count) {
+        if (params_args.frequency->count == 0 || params_args.step->count == 0) {
+            printf("Sweeps need -f <start Hz>, -F <stop Hz> and -s <step>\n");
+            return 1;
+        }
+        return exec_params_range(params_args.frequency->dval[0], params_args.stop->dval[0], 
+                                 params_args.step->dval[0], params_args.logscale->count,
+                                 (params_args.duty_ppm->count) ? params_args.duty_ppm->ival[0] / 1000000.0 : params_args.duty_cycle->dval[0]);
+    }
+
+    if (compute_info(params_args.frequency, params_args.freq_mhz, params_args.freq_ratio,
+                     params_args.duty_cycle, params_args.duty_ppm, &opt, &info) != ESP_OK) {
+        printf("INVALID FREQUENCY GENERATOR PARAMETERS\n");
+        return 1;
+    }
 
     printf("------------------------------------------------------------------\n");
     printf("                 FREQUENCY GENERATOR PARAMETERS                   \n");
-    printf("Final Frequency:\t%0.4f Hz\n", info.freq);
-    printf("Final Duty Cycle:\t%0.2f%%\n", info.duty_cycle*100);
+    printf("Final Frequency:\t%0.4f Hz (%llu mHz, %d ppm)\n", info.freq, info.freq_mhz, info.freq_err);
+    printf("Final Duty Cycle:\t%0.2f%% (%u ppm, %d ppm)\n", info.duty_cycle*100, info.duty_ppm, info.duty_err);
     printf("Prescaler:\t\t%d\n", info.prescaler);
+    if (info.encoding == FGEN_ENC_REF_TICK) {
+        printf("Clock:\t\t\tREF_TICK (1 MHz)\n");
+    }
     printf("N:\t\t\t%d (%d high + %d low)\n", info.N, info.NH, info.NL);
-    printf("Nitems:\t\t\t%d, x%d times + EoTx\n", info.onitems, info.nrep);
+    if (info.nlong) {
+        printf("N+1:\t\t\t%d out of %d times\n", info.nlong, info.nrep);
+        printf("Phase error:\t\t%0.3f us peak\n", info.phase_err*1000000);
+    }
+    printf("Nitems:\t\t\t%d, x%d times%s\n", info.onitems, info.nrep, (info.streaming) ? " in RAM" : " + EoTx");
     printf("Blocks:\t\t\t%d (64 items each)\n", info.mem_blocks);
-    printf("Jitter:\t\t\t%0.3f us every %d times\n", info.jitter*1000000, info.nrep);
+    if (info.streaming) {
+        printf("Streaming:\t\t%0.1f half block refills/s\n", info.refill_rate);
+    } else {
+        printf("Jitter:\t\t\t%0.3f us every %d times\n", info.jitter*1000000, info.nrep);
+        printf("Loop average:\t\t%0.4f Hz (%d ppm)%s\n", info.loop_freq, info.loop_err, 
+                (info.compensated) ? ", idle tick compensated" : "");
+        printf("Phase:\t\t\t%0.3f deg late, %0.3f deg (%0.3f us) steps\n", info.phase, info.phase_res, 
+                info.phase_res / 360 / info.freq * 1000000);
+    }
     printf("------------------------------------------------------------------\n");
     return 0;
 }
@@ -236,11 +563,35 @@ static void register_create()
     extern struct create_args_s create_args;
 
     create_args.frequency =
-        arg_dbl1("f", "freq", "<Hz>", "Frequency");
+        arg_dbl0("f", "freq", "<Hz>", "Frequency");
+    create_args.freq_mhz =
+        arg_int0("m", "mhz", "<mHz>", "Exact frequency in millihertz");
+    create_args.freq_ratio =
+        arg_str0("r", "ratio", "<num/den>", "Exact frequency as a ratio in Hz");
     create_args.duty_cycle =
         arg_dbl0("d", "duty", "<duty cycle>",
                  "Defaults to 0.5 (50%) if not given");
     create_args.duty_cycle->dval[0] = 0.5; // Give it a default value
+    create_args.duty_ppm =
+        arg_int0("p", "ppm", "<ppm>", "Exact duty cycle in parts per million");
+    create_args.tolerance =
+        arg_int0("t", "tol", "<ppm>", "Frequency error allowed to meet the objective");
+    create_args.objective =
+        arg_str0("o", "objective", "<error|blocks|jitter>", "What to minimize. Defaults to error");
+    create_args.fractional =
+        arg_lit0("a", "frac", "Alternates N and N+1 tick periods for a better average frequency");
+    create_args.weights =
+        arg_str0("w", "weights", "<freq:duty>", "Weights of the frequency and duty cycle errors. Defaults to 1:0");
+    create_args.streaming =
+        arg_lit0("S", "stream", "Streams the items from RAM through a single RMT block");
+    create_args.compensate =
+        arg_lit0("C", "compensate", "Takes the loop idle tick out of the last period");
+    create_args.min_wrap =
+        arg_lit0(NULL, "min-wrap", "Spreads the repetitions over spare RMT blocks, given back when needed");
+    create_args.zero_copy =
+        arg_lit0("Z", "zero-copy", "Writes the items straight into RMT RAM instead of copying them on start");
+    create_args.phase =
+        arg_dbl0("P", "phase", "<deg>", "Delay relative to generators started together, in [0,360)");
     create_args.gpio_num =
         arg_int0("g", "gpio", "<GPIO num>",
                  "Defaults to -1 if not given");
@@ -263,6 +614,7 @@ static int exec_create(int argc, char **argv)
 {
     extern struct create_args_s create_args;
     fgen_info_t       info;
+    fgen_options_t    opt;
     fgen_resources_t* fgen;
 
     int nerrors = arg_parse(argc, argv, (void **) &create_args);
@@ -271,15 +623,140 @@ static int exec_create(int argc, char **argv)
         return 1;
     }
 
-    fgen_info( create_args.frequency->dval[0], 
-               create_args.duty_cycle->dval[0], 
-               &info);
+    if (parse_options(create_args.tolerance, create_args.objective, create_args.fractional, create_args.weights, 
+                      create_args.streaming, create_args.compensate, &opt) != ESP_OK) {
+        return 1;
+    }
+    opt.min_wrap  = create_args.min_wrap->count > 0;
+    opt.zero_copy = create_args.zero_copy->count > 0;
+    opt.phase     = (create_args.phase->count) ? create_args.phase->dval[0] : 0.0;
+
+    if (compute_info(create_args.frequency, create_args.freq_mhz, create_args.freq_ratio,
+                     create_args.duty_cycle, create_args.duty_ppm, &opt, &info) != ESP_OK) {
+        printf("INVALID FREQUENCY GENERATOR PARAMETERS\n");
+        return 1;
+    }
 
     fgen = fgen_alloc(&info, create_args.gpio_num->ival[0] );
     if (fgen != NULL) {
         register_fgen(fgen); 
         printf("Channel: %02d [%s]\tGPIO: %02d\tFreq.: %0.2f Hz\tBlocks: %d\n", 
-                fgen->channel, state_msg(fgen), fgen->gpio_num, fgen->info.freq, fgen->info.mem_blocks);
+                fgen->handle, state_msg(fgen), fgen->gpio_num, fgen->info.freq, fgen->info.mem_blocks);
+        if (fgen->info.phase_ticks) {
+            printf("Phase:\t\t\t%0.3f deg late, %0.3f deg steps\n", fgen->info.phase, fgen->info.phase_res);
+        }
+    } else {
+        printf("NO RESOURCES AVAILABLE TO CREATE A NEW FREQUENCY GENERATOR\n");
+    }
+    return 0;
+}
+
+// ============================================================================
+
+
+// forward declaration
+static int exec_pattern(int argc, char **argv);
+
+// 'pattern' command registration
+static void register_pattern()
+{
+    extern struct pattern_args_s pattern_args;
+
+    pattern_args.segments =
+        arg_str1("s", "segments", "<level:ns,...>", "Pattern segments, e.g. 1:1000,0:500,1:250,0:2000");
+    pattern_args.dry_run =
+        arg_lit0("n", "dry-run", "Only displays the pattern parameters and needed resources");
+    pattern_args.gpio_num =
+        arg_int0("g", "gpio", "<GPIO num>",
+                 "Defaults to -1 if not given");
+    pattern_args.gpio_num->ival[0] = GPIO_NUM_NC; // Give it a default value
+    pattern_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "pattern",
+        .help     = "Creates a generator looping over a custom pulse pattern and binds it to a GPIO pin. "
+                    "Does not start it.",
+        .hint     = NULL,
+        .func     = exec_pattern,
+        .argtable = &pattern_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+// Parses comma separated <level>:<ns> segments
+static esp_err_t parse_segments(const char* str, fgen_segment_t* seg, size_t* n)
+{
+    unsigned long long ns;
+    unsigned int       level;
+    int                len;
+
+    for (*n = 0; *str != 0; (*n)++) {
+        if (*n == PATTERN_MAX_SEG) {
+            printf("At most %d segments\n", PATTERN_MAX_SEG);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (sscanf(str, "%u:%llu%n", &level, &ns, &len) != 2 || (str[len] != ',' && str[len] != 0)) {
+            printf("Segments must be given as <level>:<ns>,...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        seg[*n].level       = level;
+        seg[*n].duration_ns = ns;
+        str += len + (str[len] == ',');
+    }
+    return ESP_OK;
+}
+
+// 'pattern' command implementation
+static int exec_pattern(int argc, char **argv)
+{
+    extern struct pattern_args_s pattern_args;
+    fgen_segment_t    seg[PATTERN_MAX_SEG];
+    fgen_info_t       info;
+    fgen_resources_t* fgen;
+    size_t            n;
+
+    int nerrors = arg_parse(argc, argv, (void **) &pattern_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, pattern_args.end, argv[0]);
+        return 1;
+    }
+
+    if (parse_segments(pattern_args.segments->sval[0], seg, &n) != ESP_OK) {
+        return 1;
+    }
+    if (fgen_pattern_info(seg, n, &info) != ESP_OK) {
+        printf("INVALID PULSE PATTERN\n");
+        return 1;
+    }
+
+    printf("------------------------------------------------------------------\n");
+    printf("                    PULSE PATTERN PARAMETERS                      \n");
+    printf("Period:\t\t\t%0.3f us (%0.4f Hz, %d ppm)\n", 1000000/info.freq, info.freq, info.freq_err);
+    printf("High time:\t\t%0.2f%% (%u ppm, %d ppm)\n", info.duty_cycle*100, info.duty_ppm, info.duty_err);
+    printf("Prescaler:\t\t%d\n", info.prescaler);
+    if (info.encoding == FGEN_ENC_REF_TICK) {
+        printf("Clock:\t\t\tREF_TICK (1 MHz)\n");
+    }
+    printf("Ticks:\t\t\t%d (%d high + %d low)\n", info.N, info.NH, info.NL);
+    printf("Edge error:\t\t%0.3f us peak\n", info.phase_err*1000000);
+    printf("Nitems:\t\t\t%d, x%d times + EoTx\n", info.onitems, info.nrep);
+    printf("Blocks:\t\t\t%d (64 items each)\n", info.mem_blocks);
+    if (info.compensated) {
+        printf("Loop:\t\t\twithout gaps, idle tick compensated\n");
+    } else {
+        printf("Loop:\t\t\t%0.3f us gap every %d times\n", info.jitter*1000000, info.nrep);
+    }
+    printf("Loop average:\t\t%0.4f Hz (%d ppm)\n", info.loop_freq, info.loop_err);
+    printf("------------------------------------------------------------------\n");
+    if (pattern_args.dry_run->count) {
+        return 0;
+    }
+
+    fgen = fgen_pattern_alloc(seg, n, pattern_args.gpio_num->ival[0]);
+    if (fgen != NULL) {
+        register_fgen(fgen); 
+        printf("Channel: %02d [%s]\tGPIO: %02d\tFreq.: %0.2f Hz\tBlocks: %d\n", 
+                fgen->handle, state_msg(fgen), fgen->gpio_num, fgen->info.freq, fgen->info.mem_blocks);
     } else {
         printf("NO RESOURCES AVAILABLE TO CREATE A NEW FREQUENCY GENERATOR\n");
     }
@@ -289,6 +766,138 @@ static int exec_create(int argc, char **argv)
 // ============================================================================
 
 
+// forward declaration
+static int exec_plan(int argc, char **argv);
+
+// 'plan' command registration
+static void register_plan()
+{
+    extern struct plan_args_s plan_args;
+
+    plan_args.generators =
+        arg_str1("s", "set", "<Hz[:duty[:GPIO]],...>", "Generators to place together, e.g. 1000,50:0.25,10:0.5:4");
+    plan_args.apply =
+        arg_lit0("a", "apply", "Creates them all as planned, or none of them");
+    plan_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "plan",
+        .help     = "Finds RMT channels, blocks and GPIO pins for a whole set of generators, "
+                    "alongside the existing ones, or tells why there are none. "
+                    "Changes nothing unless --apply is given. Does not start them.",
+        .hint     = NULL,
+        .func     = exec_plan,
+        .argtable = &plan_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+// Parses comma separated <Hz>[:<duty>[:<GPIO>]] generators
+static esp_err_t parse_plan_set(const char* str, fgen_plan_req_t* req, size_t* n)
+{
+    double freq, duty_cycle;
+    int    gpio, len, more;
+
+    for (*n = 0; *str != 0; (*n)++) {
+        if (*n == RMT_CHANNEL_MAX) {
+            printf("At most %d generators\n", RMT_CHANNEL_MAX);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        duty_cycle = 0.5;
+        gpio       = GPIO_NUM_NC;
+        if (sscanf(str, "%lf%n", &freq, &len) != 1) {
+            printf("Generators must be given as <Hz>[:<duty>[:<GPIO>]],...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (str[len] == ':' && sscanf(str + len, ":%lf%n", &duty_cycle, &more) == 1) {
+            len += more;
+            if (str[len] == ':' && sscanf(str + len, ":%d%n", &gpio, &more) == 1) {
+                len += more;
+            }
+        }
+        if (str[len] != ',' && str[len] != 0) {
+            printf("Generators must be given as <Hz>[:<duty>[:<GPIO>]],...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        req[*n].freq       = freq;
+        req[*n].duty_cycle = duty_cycle;
+        req[*n].gpio_num   = gpio;
+        str += len + (str[len] == ',');
+    }
+    return ESP_OK;
+}
+
+// 'plan' command implementation
+static int exec_plan(int argc, char **argv)
+{
+    extern struct plan_args_s plan_args;
+    // Too large for the console task stack
+    static fgen_placement_t place[RMT_CHANNEL_MAX];
+    fgen_plan_req_t   req[RMT_CHANNEL_MAX];
+    fgen_resources_t* fgen[RMT_CHANNEL_MAX];
+    fgen_plan_t       plan;
+    esp_err_t         ret;
+    size_t            n;
+
+    int nerrors = arg_parse(argc, argv, (void **) &plan_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, plan_args.end, argv[0]);
+        return 1;
+    }
+
+    if (parse_plan_set(plan_args.generators->sval[0], req, &n) != ESP_OK) {
+        return 1;
+    }
+    ret = fgen_plan(req, n, place, &plan);
+
+    printf("------------------------------------------------------------------\n");
+    printf("                    GENERATORS PLACEMENT PLAN                     \n");
+    printf("Freq. (Hz)\tDC.\tFinal (Hz)\tBlocks\tChannel\tGPIO\n");
+    for (size_t i = 0; i < n; i++) {
+        if (place[i].status != ESP_OK) {
+            printf("%0.4f\t%0.0f%%\t%s\n", req[i].freq, 100*req[i].duty_cycle, esp_err_to_name(place[i].status));
+        } else if (place[i].channel == -1) {
+            printf("%0.4f\t%0.0f%%\t%0.4f\t%d\t--\t--\n", 
+                req[i].freq, 100*req[i].duty_cycle, place[i].info.freq, place[i].info.mem_blocks);
+        } else {
+            printf("%0.4f\t%0.0f%%\t%0.4f\t%d\t%02d\t%02d\n", 
+                req[i].freq, 100*req[i].duty_cycle, place[i].info.freq, place[i].info.mem_blocks, 
+                place[i].channel, place[i].gpio_num);
+        }
+    }
+    printf("------------------------------------------------------------------\n");
+    if (ret == ESP_ERR_INVALID_ARG) {
+        printf("NO PLACEMENT: SOME GENERATORS CANNOT BE SOLVED OR SHARE A GPIO PIN\n");
+        return 0;
+    }
+    printf("Blocks:\t\t\t%d needed, %d free\n", plan.blocks, plan.free_blocks);
+    printf("Generators:\t\t%d needed, %d slots free\n", n, plan.free_slots);
+    printf("GPIO pool:\t\t%d pins free\n", plan.free_gpios);
+    if (ret != ESP_OK) {
+        printf("NO PLACEMENT: NOT ENOUGH RESOURCES FOR THE WHOLE SET\n");
+        return 0;
+    }
+    printf("Room:\t\t\t%s%s\n", (plan.give_back) ? "spare blocks given back, " : "", 
+        (plan.compact) ? "generators moved" : "as is");
+    printf("------------------------------------------------------------------\n");
+    if (plan_args.apply->count == 0) {
+        return 0;
+    }
+
+    if (fgen_plan_apply(req, n, fgen) != ESP_OK) {
+        printf("NO RESOURCES AVAILABLE TO CREATE THE WHOLE SET\n");
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        register_fgen(fgen[i]); 
+        print_fgen_summary(fgen[i]);
+    }
+    return 0;
+}
+
+// ============================================================================
+
+
 // forward declaration
 static int exec_delete(int argc, char **argv);
 
@@ -298,7 +907,7 @@ static void register_delete()
     extern struct delete_args_s delete_args;
 
     delete_args.channel =
-        arg_int0("c", "channel", "<0-7>", "RMT channel number.");
+        arg_int0("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
     delete_args.nvs =
         arg_lit0("n", "nvs", "Delete NVS configuration as well.");
     delete_args.end = arg_end(3);
@@ -391,7 +1000,8 @@ static int exec_list(int argc, char **argv)
 {
     extern struct list_args_s list_args;
 
-    fgen_resources_t* fgen;
+    fgen_resources_t*   fgen;
+    fgen_stream_stats_t stats;
 
     int nerrors = arg_parse(argc, argv, (void **) &list_args);
     if (nerrors != 0) {
@@ -426,8 +1036,22 @@ static int exec_list(int argc, char **argv)
         if (fgen != NULL) {
             print_fgen_summary(fgen);
             if (list_args.extended->count) {
-                printf("\tPrescaler: %03d, N: %d (%d + %d)\n", 
-                fgen->info.prescaler, fgen->info.N, fgen->info.NH, fgen->info.NL);
+                printf("\tPrescaler: %03d, N: %d (%d + %d)%s\n", 
+                fgen->info.prescaler, fgen->info.N, fgen->info.NH, fgen->info.NL,
+                (fgen->info.encoding == FGEN_ENC_REF_TICK) ? ", REF_TICK clock" : "");
+                if (fgen->channel != fgen->handle) {
+                    printf("\tOn RMT channel %02d\n", fgen->channel);
+                }
+                if (fgen->info.streaming) {
+                    if (fgen_stream_stats(fgen, &stats) == ESP_OK) {
+                        printf("\tStreaming: %u refills, %u cycles each, %0.3f%% CPU\n", 
+                            stats.refills, stats.cycles, stats.load*100);
+                    }
+                } else {
+                    printf("\tLoop: %d periods, wraps every %0.3f ms (%d ppm)%s\n", 
+                        fgen->info.nrep, 1000.0*fgen->info.nrep/fgen->info.loop_freq, fgen->info.loop_err,
+                        (fgen->info.mem_blocks > fgen->solved.mem_blocks) ? ", spread over spare blocks" : "");
+                }
             }
         }
     }
@@ -447,13 +1071,15 @@ static void register_start()
     extern struct start_args_s start_args;
 
     start_args.channel =
-        arg_int0("c", "channel", "<0-7>", "RMT channel number.");
+        arg_int0("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
+    start_args.sync =
+        arg_lit0("s", "sync", "Starts them all together, their edges aligned.");
     start_args.end = arg_end(3);
 
     const esp_console_cmd_t cmd = {
         .command  = "start",
         .help     = "Starts frequency generator given by channel id. "
-                    "Starts all if no channel is given.",
+                    "Starts all if no channel is given, together with --sync.",
         .hint     = NULL,
         .func     = exec_start,
         .argtable = &start_args
@@ -471,6 +1097,35 @@ static void exec_start_single(rmt_channel_t channel)
     }     
 }
 
+static int exec_start_sync()
+{
+    fgen_resources_t* group[RMT_CHANNEL_MAX];
+    size_t            n = 0;
+    uint32_t          window_ns;
+    esp_err_t         ret;
+
+    for (rmt_channel_t channel= 0; channel<RMT_CHANNEL_MAX; channel++) {
+        group[n] = search_fgen(channel);
+        n += (group[n] != NULL);
+    }
+    if (n == 0) {
+        return 0;
+    }
+    ret = fgen_start_group(group, n, &window_ns);
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        printf("STREAMED GENERATORS CANNOT BE STARTED TOGETHER\n");
+        return 1;
+    } else if (ret != ESP_OK) {
+        printf("COULD NOT START THE GENERATORS TOGETHER\n");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        print_fgen_summary(group[i]);
+    }
+    printf("Start window:\t\t%u ns across %d channels\n", window_ns, n);
+    return 0;
+}
+
 
 // 'start' command implementation
 static int exec_start(int argc, char **argv)
@@ -483,6 +1138,13 @@ static int exec_start(int argc, char **argv)
         return 1;
     }
 
+    if (start_args.sync->count) {
+        if (start_args.channel->count) {
+            printf("Give either a channel or --sync\n");
+            return 1;
+        }
+        return exec_start_sync();
+    }
     if (start_args.channel->count) {
         exec_start_single(start_args.channel->ival[0]);
     }  else {
@@ -506,7 +1168,7 @@ static void register_stop()
     extern struct stop_args_s stop_args;
 
     stop_args.channel =
-        arg_int0("c", "channel", "<0-7>", "RMT channel number.");
+        arg_int0("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
     stop_args.end = arg_end(3);
 
     const esp_console_cmd_t cmd = {
@@ -553,60 +1215,540 @@ static int exec_stop(int argc, char **argv)
     return 0;
 }
 
-
 // ============================================================================
 
 // forward declaration
-static int exec_save(int argc, char **argv);
+static int exec_set(int argc, char **argv);
 
-// 'save' command registration
-static void register_save()
+// 'set' command registration
+static void register_set()
 {
-    extern struct save_args_s save_args;
-
-    save_args.channel =
-        arg_int0("c", "channel", "<0-7>", "RMT channel number.");
-    save_args.end = arg_end(3);
+    extern struct set_args_s set_args;
+
+    set_args.channel =
+        arg_int1("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
+    set_args.frequency =
+        arg_dbl1("f", "freq", "<Hz>", "New frequency.");
+    set_args.duty_cycle =
+        arg_dbl0("d", "duty", "<0..1>", "New duty cycle. Kept if not given.");
+    set_args.phase =
+        arg_dbl0("P", "phase", "<deg>", "New phase delay in [0,360). Kept if not given.");
+    set_args.end = arg_end(3);
 
     const esp_console_cmd_t cmd = {
-        .command  = "save",
-        .help     = "Saves frequency generator configuration to NVS given by channel id. "
-                    "Saves all if no channel is given.",
+        .command  = "set",
+        .help     = "Retunes a frequency generator in place, running or not, "
+                    "switching at a loop boundary when its prescaler stays the same.",
         .hint     = NULL,
-        .func     = exec_save,
-        .argtable = &save_args
+        .func     = exec_set,
+        .argtable = &set_args
     };
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
 }
 
-static void do_save_single(nvs_handle_t handle, rmt_channel_t channel)
+// 'set' command implementation
+static int exec_set(int argc, char **argv)
 {
+    extern struct set_args_s set_args;
     fgen_resources_t* fgen;
-    freq_nvs_info_t   nvs_info;
+    esp_err_t         ret;
+    int64_t           elapsed;
 
-    fgen = search_fgen(channel);
-    if (fgen != NULL) {
-        nvs_info.gpio_num   = fgen->gpio_num;
-        nvs_info.freq       = fgen->info.freq;
-        nvs_info.duty_cycle = fgen->info.duty_cycle;
-        ESP_ERROR_CHECK( freq_nvs_info_save(handle, channel, &nvs_info) );
-    }  
-}
+    int nerrors = arg_parse(argc, argv, (void **) &set_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, set_args.end, argv[0]);
+        return 1;
+    }
 
-// 'save' command implementation
-static int exec_save(int argc, char **argv)
-{ 
-    extern struct save_args_s save_args;
-    nvs_handle_t    handle;
+    fgen = search_fgen(set_args.channel->ival[0]);
+    if (fgen == NULL) {
+        printf("NO SUCH FREQUENCY GENERATOR\n");
+        return 1;
+    }
 
-    int nerrors = arg_parse(argc, argv, (void **) &save_args);
-    if (nerrors != 0) {
-        arg_print_errors(stderr, save_args.end, argv[0]);
+    elapsed = esp_timer_get_time();
+    ret = fgen_update_phase(fgen, set_args.frequency->dval[0], 
+                            (set_args.duty_cycle->count) ? set_args.duty_cycle->dval[0] : fgen->info.duty_cycle,
+                            (set_args.phase->count) ? set_args.phase->dval[0] : fgen->info.phase);
+    elapsed = esp_timer_get_time() - elapsed;
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        printf("STREAMED GENERATORS AND PATTERNS CANNOT BE RETUNED\n");
+        return 1;
+    } else if (ret == ESP_ERR_INVALID_SIZE) {
+        printf("MORE RMT BLOCKS NEEDED THAN HELD, DELETE AND CREATE IT AGAIN\n");
+        return 1;
+    } else if (ret != ESP_OK) {
+        printf("INVALID FREQUENCY GENERATOR PARAMETERS\n");
         return 1;
     }
-    
-    ESP_ERROR_CHECK( freq_nvs_begin_transaction(NVS_READWRITE, &handle) );
-    if (save_args.channel->count == 0) {
+    print_fgen_summary(fgen);
+    if (fgen->info.phase_ticks) {
+        printf("Phase:\t\t\t%0.3f deg late, %0.3f deg steps\n", fgen->info.phase, fgen->info.phase_res);
+    }
+    printf("Retune:\t\t\t%u us %s, %lld us solving\n", fgen->retune.latency_us, 
+                (fgen_get_state(fgen) == RMT_CHANNEL_IDLE) ? "stopped" : (fgen->retune.seamless) ? "at a loop boundary" : "paused", 
+                elapsed - fgen->retune.latency_us);
+    return 0;
+}
+
+// ============================================================================
+
+// forward declaration
+static int exec_sweep(int argc, char **argv);
+
+// 'sweep' command registration
+static void register_sweep()
+{
+    extern struct sweep_args_s sweep_args;
+
+    sweep_args.channel =
+        arg_int1("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
+    sweep_args.start =
+        arg_dbl0("f", "freq", "<Hz>", "First frequency.");
+    sweep_args.stop =
+        arg_dbl0("F", "stop", "<Hz>", "Last frequency.");
+    sweep_args.duty_cycle =
+        arg_dbl0("d", "duty", "<0..1>", "Duty cycle. Kept if not given.");
+    sweep_args.steps =
+        arg_int0("n", "steps", "<steps>", "Frequencies, both ends included.");
+    sweep_args.dwell =
+        arg_dbl0("w", "dwell", "<ms>", "Time spent at each frequency.");
+    sweep_args.total =
+        arg_dbl0("T", "time", "<ms>", "Whole sweep time. Two of -n, -w and -T are needed.");
+    sweep_args.logscale =
+        arg_lit0("l", "log", "Logarithmic sweep");
+    sweep_args.objective =
+        arg_str0("o", "objective", "<error|blocks|jitter>", "What to minimize at every step. Defaults to error");
+    sweep_args.tolerance =
+        arg_int0("t", "tol", "<ppm>", "Frequency error allowed to meet the objective");
+    sweep_args.background =
+        arg_lit0("b", "background", "Returns at once instead of waiting for the sweep to end");
+    sweep_args.abort =
+        arg_lit0("x", "abort", "Aborts the sweep going on");
+    sweep_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "sweep",
+        .help     = "Steps a frequency generator from one frequency to another, retuning it in place, "
+                    "and shows the dwell time accuracy achieved. Shows the last sweep if no frequencies are given.",
+        .hint     = NULL,
+        .func     = exec_sweep,
+        .argtable = &sweep_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static void print_sweep_stats(fgen_resources_t* fgen)
+{
+    fgen_sweep_stats_t stats;
+
+    if (fgen_sweep_stats(fgen, &stats) != ESP_OK) {
+        printf("NO SWEEP DONE ON THIS FREQUENCY GENERATOR\n");
+        return;
+    }
+    print_fgen_summary(fgen);
+    printf("Sweep:\t\t\t%u out of %u steps%s, %u seamless, %u failed\n", stats.steps, stats.total, 
+                (stats.running) ? " so far" : "", stats.seamless, stats.failed);
+    printf("Dwell:\t\t\t%u us, %0.1f us mean error, %u us peak (%0.2f%%)\n", stats.dwell_us, 
+                stats.dwell_err_avg_us, stats.dwell_err_max_us, stats.dwell_err_max_us * 100.0 / stats.dwell_us);
+    printf("Elapsed:\t\t%lld us, %llu us requested\n", stats.elapsed_us, (unsigned long long) stats.total * stats.dwell_us);
+    printf("Retune:\t\t\t%u us slowest, %u overruns\n", stats.latency_max_us, stats.overruns);
+}
+
+// 'sweep' command implementation
+static int exec_sweep(int argc, char **argv)
+{
+    extern struct sweep_args_s sweep_args;
+    fgen_resources_t*  fgen;
+    fgen_sweep_req_t   req;
+    fgen_sweep_stats_t stats;
+    esp_err_t          ret;
+    int64_t            elapsed;
+
+    int nerrors = arg_parse(argc, argv, (void **) &sweep_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, sweep_args.end, argv[0]);
+        return 1;
+    }
+
+    fgen = search_fgen(sweep_args.channel->ival[0]);
+    if (fgen == NULL) {
+        printf("NO SUCH FREQUENCY GENERATOR\n");
+        return 1;
+    }
+    if (sweep_args.abort->count) {
+        if (fgen_sweep_stop(fgen) != ESP_OK) {
+            printf("NO SWEEP GOING ON\n");
+            return 1;
+        }
+        print_sweep_stats(fgen);
+        return 0;
+    }
+    if (sweep_args.start->count + sweep_args.stop->count == 0) {
+        print_sweep_stats(fgen);
+        return 0;
+    }
+    if (sweep_args.start->count + sweep_args.stop->count != 2 || 
+        sweep_args.steps->count + sweep_args.dwell->count + sweep_args.total->count != 2) {
+        printf("Sweeps need -f <Hz>, -F <Hz> and two of -n <steps>, -w <ms> and -T <ms>\n");
+        return 1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    if (parse_objective(sweep_args.objective, &req.objective) != ESP_OK) {
+        return 1;
+    }
+    req.start      = sweep_args.start->dval[0];
+    req.stop       = sweep_args.stop->dval[0];
+    req.duty_cycle = (sweep_args.duty_cycle->count) ? sweep_args.duty_cycle->dval[0] : fgen->info.duty_cycle;
+    req.logscale   = sweep_args.logscale->count > 0;
+    req.tol_ppm    = (sweep_args.tolerance->count) ? sweep_args.tolerance->ival[0] : 0;
+    if (sweep_args.steps->count == 0) {
+        req.steps = lround(sweep_args.total->dval[0] / sweep_args.dwell->dval[0]);
+    } else {
+        req.steps = sweep_args.steps->ival[0];
+    }
+    if (req.steps < 2) {
+        printf("Sweeps need 2 steps at least\n");
+        return 1;
+    }
+    if (sweep_args.dwell->count == 0) {
+        req.dwell_us = llround(sweep_args.total->dval[0] * 1000 / req.steps);
+    } else {
+        req.dwell_us = llround(sweep_args.dwell->dval[0] * 1000);
+    }
+
+    elapsed = esp_timer_get_time();
+    ret = fgen_sweep_start(fgen, &req);
+    elapsed = esp_timer_get_time() - elapsed;
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        printf("STREAMED GENERATORS AND PATTERNS CANNOT BE SWEPT\n");
+        return 1;
+    } else if (ret == ESP_ERR_INVALID_STATE) {
+        printf("ALREADY SWEEPING, ABORT IT WITH -x FIRST\n");
+        return 1;
+    } else if (ret == ESP_ERR_INVALID_SIZE) {
+        printf("SOME STEPS NEED MORE RMT BLOCKS THAN HELD, CREATE IT AT THE LOWEST FREQUENCY\n");
+        return 1;
+    } else if (ret == ESP_ERR_NO_MEM) {
+        printf("NOT ENOUGH MEMORY FOR %u STEPS\n", req.steps);
+        return 1;
+    } else if (ret != ESP_OK) {
+        printf("INVALID SWEEP PARAMETERS\n");
+        return 1;
+    }
+    printf("Solving:\t\t%lld us for %u steps\n", elapsed, req.steps);
+    if (sweep_args.background->count) {
+        return 0;
+    }
+    do {
+        vTaskDelay(pdMS_TO_TICKS(SWEEP_POLL_MS));
+        fgen_sweep_stats(fgen, &stats);
+    } while (stats.running);
+    print_sweep_stats(fgen);
+    return 0;
+}
+
+// ============================================================================
+
+// forward declaration
+static int exec_burst(int argc, char **argv);
+
+// 'burst' command registration
+static void register_burst()
+{
+    extern struct burst_args_s burst_args;
+
+    burst_args.channel =
+        arg_int1("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
+    burst_args.periods =
+        arg_dbl0("n", "periods", "<periods>", "Exact number of periods to send, up to 2^53.");
+    burst_args.background =
+        arg_lit0("b", "background", "Returns at once instead of waiting for the burst to end");
+    burst_args.abort =
+        arg_lit0("x", "abort", "Aborts the burst going on, stopping the generator");
+    burst_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "burst",
+        .help     = "Sends an exact number of periods from a frequency generator and stops it. "
+                    "Shows the last burst if no periods are given.",
+        .hint     = NULL,
+        .func     = exec_burst,
+        .argtable = &burst_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static void print_burst_stats(fgen_resources_t* fgen)
+{
+    fgen_burst_stats_t stats;
+
+    if (fgen_burst_stats(fgen, &stats) != ESP_OK) {
+        printf("NO BURST SENT BY THIS FREQUENCY GENERATOR\n");
+        return;
+    }
+    print_fgen_summary(fgen);
+    printf("Burst:\t\t\t%llu periods, %llu loops of %u + %u%s\n", stats.periods, stats.loops, fgen->info.nrep, stats.last,
+                (stats.running) ? ", going on" : (stats.exact) ? ", sent" : ", NOT EXACT");
+    if (stats.loops > 0) {
+        printf("Slack:\t\t\t%u us before the RMT got to the last loop changes\n", stats.slack_us);
+    }
+    printf("Elapsed:\t\t%lld us, %0.0f us expected\n", stats.elapsed_us, stats.periods * 1e6 / fgen->info.freq);
+}
+
+// 'burst' command implementation
+static int exec_burst(int argc, char **argv)
+{
+    extern struct burst_args_s burst_args;
+    fgen_resources_t* fgen;
+    double            periods;
+    esp_err_t         ret;
+
+    int nerrors = arg_parse(argc, argv, (void **) &burst_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, burst_args.end, argv[0]);
+        return 1;
+    }
+
+    fgen = search_fgen(burst_args.channel->ival[0]);
+    if (fgen == NULL) {
+        printf("NO SUCH FREQUENCY GENERATOR\n");
+        return 1;
+    }
+    if (burst_args.abort->count) {
+        if (fgen_burst_stop(fgen) != ESP_OK) {
+            printf("NO BURST GOING ON\n");
+            return 1;
+        }
+        print_burst_stats(fgen);
+        return 0;
+    }
+    if (burst_args.periods->count == 0) {
+        print_burst_stats(fgen);
+        return 0;
+    }
+    periods = burst_args.periods->dval[0];
+    if (periods < 1 || periods != floor(periods) || periods > 9007199254740992.0) {
+        printf("Bursts need a whole number of periods, 1 at least\n");
+        return 1;
+    }
+
+    ret = fgen_burst_start(fgen, (uint64_t) periods, (burst_args.background->count) ? NULL : xTaskGetCurrentTaskHandle());
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        printf("STREAMED, PATTERN AND PHASED GENERATORS CANNOT BURST\n");
+        return 1;
+    } else if (ret == ESP_ERR_INVALID_STATE) {
+        printf("ALREADY BURSTING OR SWEEPING, ABORT IT FIRST\n");
+        return 1;
+    } else if (ret != ESP_OK) {
+        printf("BURST NOT STARTED\n");
+        return 1;
+    }
+    if (burst_args.background->count) {
+        return 0;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    print_burst_stats(fgen);
+    return 0;
+}
+
+// ============================================================================
+
+// forward declaration
+static int exec_schedule(int argc, char **argv);
+
+// 'schedule' command registration
+static void register_schedule()
+{
+    extern struct schedule_args_s schedule_args;
+
+    schedule_args.events =
+        arg_str0("e", "events", "<ch>:<start|stop|Hz[:duty]>@<ms>,...", "Events due that many ms from now, e.g. 0:start@10,1:start@10,0:2000:0.25@500");
+    schedule_args.cancel =
+        arg_lit0("x", "cancel", "Drops every pending event");
+    schedule_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "schedule",
+        .help     = "Starts, stops or retunes frequency generators at given times, logging how late they were. "
+                    "Shows the scheduler statistics if no events are given.",
+        .hint     = NULL,
+        .func     = exec_schedule,
+        .argtable = &schedule_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+// Parses comma separated <ch>:<start|stop|Hz[:duty]>@<ms> events
+static esp_err_t parse_events(const char* str, schedule_event_t* ev, size_t* n)
+{
+    int channel, len, more;
+
+    for (*n = 0; *str != 0; (*n)++) {
+        if (*n == SCHEDULE_MAX_EV) {
+            printf("At most %d events\n", SCHEDULE_MAX_EV);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        len = 0;
+        if (sscanf(str, "%d:%n", &channel, &len) != 1 || len == 0) {
+            printf("Events must be given as <ch>:<start|stop|Hz[:duty]>@<ms>,...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        ev[*n].channel    = channel;
+        ev[*n].freq       = 0;
+        ev[*n].duty_cycle = -1;
+        if (strncmp(str + len, "start@", 6) == 0) {
+            ev[*n].event = FGEN_EVENT_START;
+            len += 5;
+        } else if (strncmp(str + len, "stop@", 5) == 0) {
+            ev[*n].event = FGEN_EVENT_STOP;
+            len += 4;
+        } else if (sscanf(str + len, "%lf%n", &ev[*n].freq, &more) == 1) {
+            ev[*n].event = FGEN_EVENT_RETUNE;
+            len += more;
+            if (str[len] == ':' && sscanf(str + len, ":%lf%n", &ev[*n].duty_cycle, &more) == 1) {
+                len += more;
+            }
+        } else {
+            printf("Events must be given as <ch>:<start|stop|Hz[:duty]>@<ms>,...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (str[len] != '@' || sscanf(str + len, "@%lf%n", &ev[*n].at_ms, &more) != 1
+            || (str[len + more] != ',' && str[len + more] != 0)) {
+            printf("Events must be given as <ch>:<start|stop|Hz[:duty]>@<ms>,...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        len += more;
+        str += len + (str[len] == ',');
+    }
+    return ESP_OK;
+}
+
+static void print_schedule_stats()
+{
+    fgen_schedule_stats_t stats;
+
+    fgen_schedule_stats(&stats);
+    printf("------------------------------------------------------------------\n");
+    printf("Pending:\t\t%u events\n", stats.pending);
+    printf("Done:\t\t\t%u events, %u failed\n", stats.done, stats.failed);
+    if (stats.done > stats.failed) {
+        printf("Error:\t\t\t%+d to %+d us, %0.1f us on average\n", stats.err_min_us, stats.err_max_us, stats.err_avg_us);
+    }
+    printf("------------------------------------------------------------------\n");
+}
+
+// 'schedule' command implementation
+static int exec_schedule(int argc, char **argv)
+{
+    extern struct schedule_args_s schedule_args;
+    schedule_event_t  ev[SCHEDULE_MAX_EV];
+    fgen_resources_t* fgen[SCHEDULE_MAX_EV];
+    int64_t           t0;
+    esp_err_t         ret;
+    size_t            n;
+    int               failed = 0;
+
+    int nerrors = arg_parse(argc, argv, (void **) &schedule_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, schedule_args.end, argv[0]);
+        return 1;
+    }
+
+    if (schedule_args.cancel->count) {
+        fgen_schedule_cancel(NULL);
+    }
+    if (schedule_args.events->count == 0) {
+        print_schedule_stats();
+        return 0;
+    }
+    if (parse_events(schedule_args.events->sval[0], ev, &n) != ESP_OK) {
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        fgen[i] = search_fgen(ev[i].channel);
+        if (fgen[i] == NULL) {
+            printf("NO SUCH FREQUENCY GENERATOR %02d\n", ev[i].channel);
+            return 1;
+        }
+    }
+
+    // Retunes are solved as they are scheduled, which takes some of the time given
+    t0 = esp_timer_get_time();
+    for (size_t i = 0; i < n; i++) {
+        if (ev[i].event == FGEN_EVENT_RETUNE) {
+            ret = fgen_schedule_update(fgen[i], t0 + (int64_t) (ev[i].at_ms * 1000), ev[i].freq,
+                                       (ev[i].duty_cycle < 0) ? fgen[i]->info.duty_cycle : ev[i].duty_cycle);
+        } else {
+            ret = fgen_schedule(fgen[i], ev[i].event, t0 + (int64_t) (ev[i].at_ms * 1000), NULL);
+        }
+        if (ret == ESP_ERR_NOT_SUPPORTED) {
+            printf("CHANNEL %02d CANNOT BE SCHEDULED SO\n", ev[i].channel);
+        } else if (ret == ESP_ERR_INVALID_ARG) {
+            printf("CHANNEL %02d EVENT TOO SOON OR NOT SOLVED\n", ev[i].channel);
+        } else if (ret != ESP_OK) {
+            printf("CHANNEL %02d EVENT NOT SCHEDULED\n", ev[i].channel);
+        }
+        failed += (ret != ESP_OK);
+    }
+    return (failed > 0);
+}
+
+
+// ============================================================================
+
+// forward declaration
+static int exec_save(int argc, char **argv);
+
+// 'save' command registration
+static void register_save()
+{
+    extern struct save_args_s save_args;
+
+    save_args.channel =
+        arg_int0("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
+    save_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "save",
+        .help     = "Saves frequency generator configuration to NVS given by channel id. "
+                    "Saves all if no channel is given.",
+        .hint     = NULL,
+        .func     = exec_save,
+        .argtable = &save_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+static void do_save_single(nvs_handle_t handle, rmt_channel_t channel)
+{
+    fgen_resources_t* fgen;
+    freq_nvs_info_t   nvs_info;
+
+    fgen = search_fgen(channel);
+    if (fgen != NULL) {
+        nvs_info.gpio_num   = fgen->gpio_num;
+        nvs_info.freq       = fgen->info.freq;
+        nvs_info.duty_cycle = fgen->info.duty_cycle;
+        ESP_ERROR_CHECK( freq_nvs_info_save(handle, channel, &nvs_info) );
+    }  
+}
+
+// 'save' command implementation
+static int exec_save(int argc, char **argv)
+{ 
+    extern struct save_args_s save_args;
+    nvs_handle_t    handle;
+
+    int nerrors = arg_parse(argc, argv, (void **) &save_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, save_args.end, argv[0]);
+        return 1;
+    }
+    
+    ESP_ERROR_CHECK( freq_nvs_begin_transaction(NVS_READWRITE, &handle) );
+    if (save_args.channel->count == 0) {
         for (rmt_channel_t ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
             do_save_single(handle, ch);
         }
@@ -630,7 +1772,7 @@ static void register_load()
     extern struct load_args_s load_args;
 
     load_args.channel =
-        arg_int0("c", "channel", "<0-7>", "RMT channel number.");
+        arg_int0("c", "channel", "<0-7>", "Channel number, kept when moved to another RMT channel.");
 
     load_args.end = arg_end(3);
 
@@ -673,21 +1815,76 @@ static void exec_load_single(nvs_handle_t handle, rmt_channel_t channel)
 
     fgen_info( nvs_info.freq, nvs_info.duty_cycle, &info);
     fgen = search_fgen(channel);
-    if (fgen == NULL) {
-        // Channel not created in memory
-        fgen = fgen_alloc(&info, nvs_info.gpio_num);
-        register_fgen(fgen); 
-
-    } else {
-        // Already existing in memory
+    if (fgen != NULL) {
+        // Already existing in memory, its slot is reused
         do_purge_single(fgen);
-        fgen = fgen_alloc(&info, nvs_info.gpio_num);
+    }
+    fgen = fgen_alloc(&info, nvs_info.gpio_num);
+    if (fgen != NULL) {
         register_fgen(fgen); 
+    } else {
+        printf("NO RESOURCES AVAILABLE TO LOAD CHANNEL %02d\n", channel);
     }
 
 }
 
 
+// Loads every configuration stored in NVS as a single set, so that they
+// all fit whatever their channel ids, and starts them if so asked. The
+// existing generators with a stored entry are replaced only if the whole
+// set fits, and left as they were otherwise
+static void exec_load_all(nvs_handle_t handle, bool start)
+{
+    extern fgen_resources_t* FGEN[];
+
+    freq_nvs_info_t   nvs_info;
+    fgen_plan_req_t   req[RMT_CHANNEL_MAX];
+    fgen_resources_t* fgen[RMT_CHANNEL_MAX];
+    fgen_resources_t* old[RMT_CHANNEL_MAX];
+    rmt_channel_t     handles[RMT_CHANNEL_MAX];
+    size_t            n = 0, nold = 0;
+    esp_err_t         ret;
+
+    for (rmt_channel_t i = 0; i <  RMT_CHANNEL_MAX; i++) {
+        rmt_channel_t channel = RMT_CHANNEL_MAX - 1 - i;
+        freq_nvs_info_load(handle, channel, &nvs_info);
+        // No channel stored in NVS
+        if (nvs_info.gpio_num == GPIO_NUM_NC) {
+            continue;
+        }
+        old[nold] = search_fgen(channel);
+        if (old[nold] != NULL) {
+            handles[nold] = old[nold]->handle;
+            nold++;
+        }
+        req[n].freq       = nvs_info.freq;
+        req[n].duty_cycle = nvs_info.duty_cycle;
+        req[n].gpio_num   = nvs_info.gpio_num;
+        n++;
+    }
+
+    ret = fgen_plan_apply_over(req, n, old, nold, fgen);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        printf("STORED CHANNELS SWEEPING OR BURSTING, ABORT THEM FIRST\n");
+        return;
+    } else if (ret != ESP_OK) {
+        printf("NO RESOURCES AVAILABLE TO LOAD THE STORED CHANNELS\n");
+        return;
+    }
+    // Gone by now, their slots possibly reused
+    for (size_t i = 0; i < nold; i++) {
+        FGEN[handles[i]] = NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        register_fgen(fgen[i]); 
+        if (start) {
+            fgen_start(fgen[i]);
+            print_fgen_summary(fgen[i]);
+        }
+    }
+}
+
+
 // 'load' command implementation
 static int exec_load(int argc, char **argv)
 { 
@@ -703,12 +1900,9 @@ static int exec_load(int argc, char **argv)
     
     ESP_ERROR_CHECK( freq_nvs_begin_transaction(NVS_READONLY, &handle) );
     if (load_args.channel->count == 0) {
-        for (rmt_channel_t i = 0; i <  RMT_CHANNEL_MAX; i++) {
-            channel = RMT_CHANNEL_MAX - 1 - i;
-            exec_load_single(handle, channel);
-        }
+        exec_load_all(handle, false);
     } else {
-        rmt_channel_t channel = load_args.channel->ival[0];
+        channel = load_args.channel->ival[0];
         exec_load_single(handle, channel);
     }
     ESP_ERROR_CHECK( freq_nvs_end_transaction(handle, false) );
@@ -758,10 +1952,7 @@ static void autoload_at_boot()
     if (autoload) {
         // Autoload from NVS
         ESP_ERROR_CHECK( freq_nvs_begin_transaction(NVS_READONLY, &handle) );
-        for (rmt_channel_t ch = 0; ch <  RMT_CHANNEL_MAX; ch++) {
-          exec_load_single(handle, RMT_CHANNEL_MAX-1-ch);
-          exec_start_single(RMT_CHANNEL_MAX-1-ch);
-        }
+        exec_load_all(handle, true);
         ESP_ERROR_CHECK( freq_nvs_end_transaction(handle, false) );
     }
 }
@@ -792,6 +1983,215 @@ static int exec_autoload(int argc, char **argv)
 
 
 
+// ============================================================================
+
+// forward declaration
+static int exec_cache(int argc, char **argv);
+
+// 'cache' command registration
+static void register_cache()
+{
+    extern struct cache_args_s cache_args;
+
+    cache_args.clear =
+        arg_lit0("c", "clear", "Empty the cache and reset its counters.");
+    cache_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "cache",
+        .help     = "Displays the frequency generator parameters cache statistics.",
+        .hint     = NULL,
+        .func     = exec_cache,
+        .argtable = &cache_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+// 'cache' command implementation
+static int exec_cache(int argc, char **argv)
+{ 
+    extern struct cache_args_s cache_args;
+    fgen_cache_stats_t stats;
+
+    int nerrors = arg_parse(argc, argv, (void **) &cache_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, cache_args.end, argv[0]);
+        return 1;
+    }
+
+    if (cache_args.clear->count) {
+        fgen_cache_clear();
+    }
+
+    fgen_cache_stats(&stats);
+    printf("------------------------------------------------------------------\n");
+    printf("Entries:\t\t%d of %d\n", stats.entries, stats.size);
+    printf("Hits:\t\t\t%u\n", stats.hits);
+    printf("Misses:\t\t\t%u\n", stats.misses);
+    printf("Evictions:\t\t%u\n", stats.evictions);
+    printf("------------------------------------------------------------------\n");
+    return 0;
+}
+
+// ============================================================================
+
+// forward declaration
+static int exec_mem(int argc, char **argv);
+
+// 'mem' command registration
+static void register_mem()
+{
+    extern struct mem_args_s mem_args;
+
+    mem_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "mem",
+        .help     = "Displays the memory used by every frequency generator and the heap left.",
+        .hint     = NULL,
+        .func     = exec_mem,
+        .argtable = &mem_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+// 'mem' command implementation
+static int exec_mem(int argc, char **argv)
+{ 
+    extern struct mem_args_s mem_args;
+    fgen_resources_t* fgen;
+    size_t heap, items, arena, free_slots;
+    size_t used  = 0;
+    size_t saved = 0;
+
+    int nerrors = arg_parse(argc, argv, (void **) &mem_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, mem_args.end, argv[0]);
+        return 1;
+    }
+
+    printf("------------------------------------------------------------------\n");
+    for (rmt_channel_t channel = 0; channel<RMT_CHANNEL_MAX ; channel++) {
+        fgen = search_fgen(channel);
+        if (fgen != NULL) {
+            // Items held in RMT RAM or in the arena would be in heap otherwise
+            heap   = fgen_heap_size(fgen);
+            items  = fgen->info.nitems * sizeof(rmt_item32_t);
+            used  += heap;
+            saved += (heap < items) ? items : 0;
+            printf("Channel: %02d\tHeap: %d bytes\tItems: %d in %s\n", 
+                channel, heap, fgen->info.nitems, (fgen->info.zero_copy) ? "RMT RAM" : (heap < items) ? "arena" : "heap");
+        }
+    }
+    fgen_arena_stats(&arena, &free_slots);
+    printf("------------------------------------------------------------------\n");
+    printf("Generators:\t\t%d bytes of heap, %d bytes with items in heap\n", used, used + saved);
+    printf("Arena:\t\t\t%d bytes, %d of %d slots free\n", arena, free_slots, RMT_CHANNEL_MAX);
+    printf("Free heap:\t\t%u bytes, %u bytes at least since boot\n", 
+        esp_get_free_heap_size(), esp_get_minimum_free_heap_size());
+    printf("Largest free block:\t%d bytes\n", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    printf("------------------------------------------------------------------\n");
+    return 0;
+}
+
+// ============================================================================
+
+// forward declaration
+static int exec_gpio(int argc, char **argv);
+
+// 'gpio' command registration
+static void register_gpio()
+{
+    extern struct gpio_args_s gpio_args;
+
+    gpio_args.pins =
+        arg_str0("s", "set", "<GPIO,...>", "Sets the pool and saves it to NVS, e.g. 4,13,14,16,17,18,19,21");
+    gpio_args.restore =
+        arg_lit0("d", "default", "Goes back to the configured pool and erases it from NVS.");
+    gpio_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command  = "gpio",
+        .help     = "Displays the GPIO pool given to generators created without a GPIO pin. "
+                    "Generators keep their pins when it changes.",
+        .hint     = NULL,
+        .func     = exec_gpio,
+        .argtable = &gpio_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+}
+
+// Parses comma separated GPIO pins
+static esp_err_t parse_gpios(const char* str, gpio_num_t* pins, size_t* n)
+{
+    int gpio, len;
+
+    for (*n = 0; *str != 0; (*n)++) {
+        if (*n == RMT_CHANNEL_MAX) {
+            printf("At most %d GPIO pins\n", RMT_CHANNEL_MAX);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (sscanf(str, "%d%n", &gpio, &len) != 1 || (str[len] != ',' && str[len] != 0)) {
+            printf("GPIO pins must be given as <GPIO>,...\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        pins[*n] = gpio;
+        str += len + (str[len] == ',');
+    }
+    return ESP_OK;
+}
+
+// The GPIO pool saved in NVS, if any, replaces the configured one
+static void gpio_pool_at_boot()
+{
+    gpio_num_t pins[RMT_CHANNEL_MAX];
+    size_t     n;
+
+    if (freq_nvs_gpio_pool_load(pins, &n) == ESP_OK && n > 0 && fgen_gpio_pool_set(pins, n) != ESP_OK) {
+        ESP_LOGW(CMD_TAG, "GPIO pool in NVS not usable, using the configured one");
+    }
+}
+
+// 'gpio' command implementation
+static int exec_gpio(int argc, char **argv)
+{ 
+    extern struct gpio_args_s gpio_args;
+    gpio_num_t  pins[RMT_CHANNEL_MAX];
+    fgen_gpio_t pool[RMT_CHANNEL_MAX];
+    size_t      n;
+
+    int nerrors = arg_parse(argc, argv, (void **) &gpio_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, gpio_args.end, argv[0]);
+        return 1;
+    }
+
+    if (gpio_args.pins->count) {
+        if (parse_gpios(gpio_args.pins->sval[0], pins, &n) != ESP_OK) {
+            return 1;
+        }
+        if (fgen_gpio_pool_set(pins, n) != ESP_OK) {
+            printf("INVALID GPIO POOL\n");
+            return 1;
+        }
+        ESP_ERROR_CHECK( freq_nvs_gpio_pool_save(pins, n) );
+    } else if (gpio_args.restore->count) {
+        if (fgen_gpio_pool_set(NULL, 0) != ESP_OK) {
+            printf("INVALID CONFIGURED GPIO POOL\n");
+            return 1;
+        }
+        ESP_ERROR_CHECK( freq_nvs_gpio_pool_save(NULL, 0) );
+    }
+
+    n = fgen_gpio_pool_get(pool);
+    printf("------------------------------------------------------------------\n");
+    for (size_t i = 0; i < n; i++) {
+        printf("GPIO: %02d [%s]\n", pool[i].gpio_num, (pool[i].allocated) ? "taken" : "free");
+    }
+    printf("------------------------------------------------------------------\n");
+    return 0;
+}
+
 /* ************************************************************************* */
 /*                               API FUNCTIONS                               */
 /* ************************************************************************* */
@@ -801,13 +2201,23 @@ void freq_cmds_register()
     esp_console_register_help_command();
     register_params();
     register_create();
+    register_pattern();
+    register_plan();
     register_start();
     register_stop();
+    register_set();
+    register_sweep();
+    register_burst();
+    register_schedule();
     register_delete();
     register_list();
     register_save();
     register_load();
     register_autoload();
+    register_cache();
+    register_mem();
+    register_gpio();
+    gpio_pool_at_boot();
     autoload_at_boot();
     printf("Try 'help' to check all supported commands\n");
 }
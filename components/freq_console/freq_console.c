@@ -84,7 +84,7 @@ void freq_console_init()
 
     /* Initialize the console */
     esp_console_config_t console_config = {
-        .max_cmdline_args   = 8,
+        .max_cmdline_args   = 16,
         .max_cmdline_length = 256,
         .hint_color         = atoi(LOG_COLOR_CYAN)
     };
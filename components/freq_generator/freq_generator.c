@@ -14,13 +14,24 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // -----------------------------------
 // Expressif SDK-IDF standard includes
 // -----------------------------------
 
+#include <sdkconfig.h>
 #include <esp_system.h>
 #include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_intr_alloc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <soc/soc.h>
+#include <xtensa/core-macros.h>
 
 // --------------
 // Local includes
@@ -33,10 +44,108 @@
 /* ************************************************************************* */
 
 #define NO_RX_BUFFER        0
-#define DEFAULT_ALLOC_FLAGS 0
+#define DEFAULT_ALLOC_FLAGS (ESP_INTR_FLAG_SHARED | ESP_INTR_FLAG_IRAM)   // RMT interrupt shared with the streaming ISR
 
-#define FGEN_APB 80000000.0
-#define FGEN_TAG "FGen"
+#define FGEN_APB_HZ 80000000ULL
+#define FGEN_APB    ((double)FGEN_APB_HZ)
+#define FGEN_REF_HZ 1000000ULL
+#define FGEN_REF_TICKS (FGEN_APB_HZ / FGEN_REF_HZ)   // APB ticks per REF_TICK
+#define FGEN_TAG    "FGen"
+
+#define FGEN_MAX_PRESCALER 255
+#define FGEN_MAX_ITEMS     511     // 8 blocks x 64 items - EoTx
+#define FGEN_ITEM_TICKS    32767   // max. duration of each half of an RMT item
+
+// Largest N whose items fit in the whole RMT RAM, whatever the duty cycle
+#define FGEN_MAX_N ((uint64_t)(FGEN_MAX_ITEMS - 3) * 2 * FGEN_ITEM_TICKS)
+
+// Number of solutions remembered by fgen_info()
+#define FGEN_CACHE_SIZE 16
+
+// Largest Pareto set computed by fgen_info_pareto()
+#define FGEN_PARETO_MAX 32
+
+// fgen_info_batch(): tick products covered by a divisor table shared by
+// the requests whose periods fall within it, kept that far from both of
+// its ends, and fewest requests worth building one
+#define FGEN_BATCH_WINDOW 4096
+#define FGEN_BATCH_MARGIN 256
+#define FGEN_BATCH_MIN    8
+
+// Furthest N from the period examined on each side by the joint
+// frequency and duty cycle search, for every prescaler, and most
+// candidates it evaluates in all, as it may run with the lock taken by fgen_plan()
+#define FGEN_JOINT_SCAN 1024
+#define FGEN_JOINT_MAX  8192
+
+// Streaming: items written into the single RMT block by each refill interrupt
+// and highest refill rate allowed, 50 us apart, to keep the ISR load low
+#define FGEN_STREAM_HALF     32
+#define FGEN_STREAM_MAX_RATE 20000
+
+// Items held by every generator slot: the whole RMT RAM, EoTx included,
+// as long as the longest loop or pattern there can be. Only streams of
+// longer periods need more
+#define FGEN_SLOT_ITEMS (FGEN_MAX_ITEMS + 1)
+
+// TX threshold event interrupt of a channel and its current RMT RAM
+// read address, relative to the channel block (status register bits 12-21)
+#define FGEN_TX_THR_INT(ch) BIT(24 + (ch))
+#define FGEN_TX_RADDR(ch)   (((RMT.status_ch[ch].val >> 12) & 0x3FF) - (ch) * 64)
+
+// TX end interrupt of a channel, raised by the end of a one-shot transmission
+#define FGEN_TX_END_INT(ch) BIT((ch) * 3)
+
+// RMT_CONF1_CHn bits written together by fgen_start_group(): start
+// transmitting, reset the RAM read address and reset the clock divider
+#define FGEN_CONF1_TX_START    BIT(0)
+#define FGEN_CONF1_MEM_RD_RST  BIT(3)
+#define FGEN_CONF1_REF_CNT_RST BIT(16)
+
+// Live retuning: longest loop waited for to switch at its boundary, time
+// kept between the RMT reader and the items written ahead of it, and time
+// taken by each RMT RAM write
+#define FGEN_RETUNE_WAIT_US   20000
+#define FGEN_RETUNE_MARGIN_US 20
+#define FGEN_RETUNE_WORD_NS   50
+
+// Sweeps: most steps solved beforehand, about 150 KB of them, shortest
+// dwell time, and the task retuning the generator, above the console and
+// below the esp_timer task, on whose CPU it runs
+#define FGEN_SWEEP_MAX_STEPS    1000
+#define FGEN_SWEEP_MIN_DWELL_US 1000
+#define FGEN_SWEEP_PRIO         (configMAX_PRIORITIES - 5)
+#define FGEN_SWEEP_STACK        4096
+#define FGEN_SWEEP_CPU          0
+
+// Bursts: time spun by their task before the RMT reaches the items it
+// changes, having slept until then, and longest wait past the expected
+// end of transmission. Their task runs as the sweep one does
+#define FGEN_BURST_SPIN_US 500
+#define FGEN_BURST_END_MS  50
+#define FGEN_BURST_PRIO    FGEN_SWEEP_PRIO
+#define FGEN_BURST_STACK   3072
+#define FGEN_BURST_CPU     FGEN_SWEEP_CPU
+
+// Scheduled events: most pending, shortest notice, time spun by their task
+// before an event, the items being loaded first, last part of it spun with
+// the lock taken, for the last checks, and with interrupts disabled. Their
+// task runs as the sweep one does
+#define FGEN_SCHED_MAX     32
+#define FGEN_SCHED_MIN_US  1000
+#define FGEN_SCHED_SPIN_US 500
+#define FGEN_SCHED_LOCK_US 50
+#define FGEN_SCHED_CRIT_US 5
+#define FGEN_SCHED_PRIO    FGEN_SWEEP_PRIO
+#define FGEN_SCHED_STACK   4096
+#define FGEN_SCHED_CPU     FGEN_SWEEP_CPU
+
+// Longest custom pulse pattern, about 18 minutes
+#define FGEN_PATTERN_MAX_NS (1ULL << 40)
+
+// Limits that keep all the solver intermediate products within 64 bits
+#define FGEN_MAX_RATIO_NUM (1ULL << 52)
+#define FGEN_MAX_RATIO_DEN ((1ULL << 62) / FGEN_APB_HZ)
 
 #define FGEN_CHECK(a, str, ret_val) \
     if (!(a)) { \
@@ -61,54 +170,427 @@ typedef enum {
     FGEN_CHANNEL_UNAVAILABLE,   // because other channl is using its memory block
 } fgen_state_t;
 
-typedef struct {
-    gpio_num_t gpio_num;    // GPIO number
-    bool       allocated;   // GIPO resource status (allocated to frequency geneartor or free)
-} fgen_gpio_t;
-
 typedef struct {
     size_t       mem_blocks;   // number of 64-item memory blocks allocated to this channel
     fgen_state_t state;         // RMT channel state
+    fgen_resources_t* spread;  // generator holding spare blocks it can give back, if any
 } fgen_channel_t;
 
+// What the solver works on, whatever the way frequency and duty cycle were given
+typedef struct {
+    uint64_t tnum;      // Exact period in APB ticks is tnum/tden
+    uint64_t tden;
+    uint64_t dnum;      // Exact duty cycle is dnum/dden (dden up to 10^9)
+    uint64_t dden;
+    uint32_t objective; // fgen_objective_t
+    uint32_t tol_ppm;   // frequency error allowed for the objective
+    uint32_t fractional;// N and N+1 tick periods allowed
+    uint32_t freq_weight;
+    uint32_t duty_weight;
+    uint32_t streaming; // items streamed from RAM instead of looped in RMT RAM
+    uint32_t compensate;// loop idle tick taken out of the last period
+    uint32_t min_wrap;  // repetitions spread over spare RMT blocks when allocated
+    uint32_t zero_copy; // items written straight into RMT RAM
+    uint32_t phase_mdeg;// loop start delay (thousandths of a degree)
+} fgen_target_t;
+
+// Largest prescaler up to min(M/2, FGEN_MAX_PRESCALER) dividing each tick
+// product M in [base, base + FGEN_BATCH_WINDOW), see fgen_sieve_build()
+typedef struct {
+    uint64_t base;
+    uint8_t  div[FGEN_BATCH_WINDOW];
+} fgen_sieve_t;
+
+// Unsigned 128 bit integer, for the weighted costs of the joint search
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} fgen_u128_t;
+
+// A request of fgen_info_batch() and its period in APB ticks
+typedef struct {
+    double   period;
+    size_t   index;
+} fgen_batch_t;
+
+// A (prescaler, N) pair under consideration and its figures of merit
+typedef struct {
+    uint64_t err;        // period error |prescaler * N - tnum/tden|, scaled by tden
+    uint32_t prescaler;  // also the wraparound jitter in APB ticks
+    uint32_t N;
+    uint8_t  mem_blocks;
+} fgen_candidate_t;
+
+// Split of one period into RMT items, see fgen_plan_items()
+typedef struct {
+    uint32_t     hfull;
+    rmt_item32_t mid;
+    uint32_t     lfull;
+    rmt_item32_t tail;     // tail.val == 0 if there is no tail item
+} fgen_items_plan_t;
+
+// Split of the last period of a loop started late, see fgen_phase_plan()
+typedef struct {
+    bool         high;     // cut in its high level
+    uint32_t     run;      // ticks of the single level lead (low) or trail (high)
+    uint32_t     NH;       // the other one, a whole period: trail if low, lead if high
+    uint32_t     NL;
+} fgen_phase_plan_t;
+
+typedef void (*fgen_visitor_t)(const fgen_candidate_t* cand, void* ctx);
+
+typedef struct {
+    uint32_t         objective;
+    bool             found;
+    fgen_candidate_t best;
+} fgen_best_ctx_t;
+
+typedef struct {
+    size_t           n;
+    bool             truncated;
+    fgen_candidate_t set[FGEN_PARETO_MAX];
+} fgen_pareto_ctx_t;
+
+// The pattern in RAM and where the RMT channel is in it.
+// Kept in internal RAM, as the refill ISR runs with the flash cache off
+struct fgen_stream_s {
+    const rmt_item32_t* items;   // nitems long pattern, looped over
+    uint32_t      nitems;
+    uint32_t      next;          // next pattern item to write into RMT RAM
+    uint32_t      half;          // next RMT block half to refill
+    rmt_channel_t channel;
+    uint32_t      refills;       // ISR load figures since started
+    uint64_t      cycles;
+    int64_t       started;       // esp_timer_get_time() at start and stop
+    int64_t       stopped;       // 0 while running
+};
+
+struct fgen_sweep_s {
+    fgen_resources_t*  res;
+    fgen_info_t*       steps;     // solved beforehand, freed once done
+    esp_timer_handle_t timer;     // ticks every dwell time
+    TaskHandle_t       task;      // taking a step at every tick
+    int64_t            first;     // when the first step took over
+    int64_t            last;      // when the last one did
+    double             err_sum;   // absolute dwell time errors (us)
+    uint32_t           dwells;    // dwell times measured
+    volatile bool      abort;
+    volatile bool      running;
+    fgen_sweep_stats_t stats;
+};
+
+// A burst of loops * nrep + last periods. The last loop ends at the new
+// EoTx item, the one before it made a full low item. Times are in ticks
+// from the start of a loop
+struct fgen_burst_s {
+    fgen_resources_t*  res;
+    TaskHandle_t       task;      // ending the burst
+    TaskHandle_t       notify;    // told when done, if not NULL
+    esp_timer_handle_t timer;     // waking the task up before the last loop
+    double             tick_us;
+    uint32_t           loop;      // loop length, idle tick included
+    size_t             eotx;      // new EoTx item
+    size_t             changed;   // last item changed, eotx or the one before
+    uint32_t           passed;    // end of the items changed, in the old loop
+    uint32_t           reached;   // start of the item before eotx, in both
+    uint32_t           ending;    // start of eotx, in the last loop
+    rmt_item32_t       low;       // item put before eotx
+    rmt_item32_t       saved[2];  // items overwritten, put back into zero-copy ones
+    int64_t            started;
+    volatile int64_t   ended;     // end of transmission, 0 until then
+    volatile bool      abort;
+    volatile bool      running;
+    fgen_burst_stats_t stats;
+};
+
+// A scheduled event and, once run, how it went
+typedef struct {
+    fgen_resources_t* res;      // NULL if cancelled while being run
+    fgen_event_t      event;
+    int64_t           at;
+    fgen_info_t*      info;     // retune solution, freed once run
+    rmt_channel_t     handle;   // logged, as the generator may be gone by then
+    int32_t           err;      // us
+    esp_err_t         ret;
+} fgen_sched_t;
+
+// A custom pattern is a sequence of runs of alternating levels
+typedef struct {
+    uint64_t ns;            // requested length
+    uint32_t ticks;         // rounded length, in ticks of the chosen clock
+    uint32_t level;
+} fgen_run_t;
+
+struct fgen_pattern_s {
+    size_t     nruns;
+    size_t     split;       // run written with one more half, so that halves pair into items
+    fgen_run_t runs[];
+};
+
+// The resources of a generator. There cannot be more generators than
+// RMT channels, so they live in a static arena with a slot per channel
+typedef struct {
+    fgen_resources_t res;
+    fgen_stream_t    stream;
+    rmt_item32_t     items[FGEN_SLOT_ITEMS];
+    bool             used;
+    bool             driver;    // RMT driver installed on res.channel
+} fgen_slot_t;
+
+typedef struct {
+    fgen_target_t key;      // what was asked
+    fgen_info_t   info;     // and its solution
+    uint32_t      stamp;    // last time it was used, 0 if the entry is empty
+} fgen_cache_entry_t;
+
 
 /* ************************************************************************* */
 /*                          GLOBAL VARIABLES SECTION                         */
 /* ************************************************************************* */
 
-#define FREQ_GPIO_NUM 4
-
-fgen_gpio_t FREQ_GPIO[FREQ_GPIO_NUM] = {
-    { GPIO_NUM_5,  false },
-    { GPIO_NUM_18, false },
-    { GPIO_NUM_19, false },
-    { GPIO_NUM_21, false }
-}; 
+// Filled from CONFIG_FGEN_GPIO_POOL on first use, see fgen_gpio_pool_init()
+fgen_gpio_t FREQ_GPIO[RMT_CHANNEL_MAX];
+size_t      FREQ_GPIO_NUM;
+static bool FREQ_GPIO_READY;
 
 
 fgen_channel_t FREQ_CHANNEL[RMT_CHANNEL_MAX] = {
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_0
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_1
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_2
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_3
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_4
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_5
-    { 1, FGEN_CHANNEL_FREE }, // RMT_CHANNEL_6
-    { 1, FGEN_CHANNEL_FREE }  // RMT_CHANNEL_7
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_0
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_1
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_2
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_3
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_4
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_5
+    { 1, FGEN_CHANNEL_FREE, NULL }, // RMT_CHANNEL_6
+    { 1, FGEN_CHANNEL_FREE, NULL }  // RMT_CHANNEL_7
 }; 
 
+// Primes up to FGEN_MAX_PRESCALER, used to factor the prescaler candidates
+static const uint8_t FGEN_PRIMES[] = {
+      2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,
+     53,  59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113,
+    127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197,
+    199, 211, 223, 227, 229, 233, 239, 241, 251
+};
+
+#define FGEN_NPRIMES (sizeof(FGEN_PRIMES)/sizeof(FGEN_PRIMES[0]))
+
+// Highest power of each of the above primes not exceeding FGEN_MAX_PRESCALER.
+// A single 64 bit remainder by it gives the whole multiplicity that matters.
+static const uint8_t FGEN_PRIME_POWERS[FGEN_NPRIMES] = {
+    128, 243, 125,  49, 121, 169,  17,  19,  23,  29,  31,  37,  41,  43,  47,
+     53,  59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113,
+    127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197,
+    199, 211, 223, 227, 229, 233, 239, 241, 251
+};
+
+// Recently computed solutions, evicted on a least recently used basis
+static fgen_cache_entry_t FGEN_CACHE[FGEN_CACHE_SIZE];
+static uint32_t           FGEN_CACHE_CLOCK;
+static fgen_cache_stats_t FGEN_CACHE_STATS = { .size = FGEN_CACHE_SIZE };
+
+// Channels being streamed, as seen by the refill ISR
+static DRAM_ATTR fgen_stream_t* FGEN_STREAMS[RMT_CHANNEL_MAX];
+static intr_handle_t            FGEN_STREAM_INTR;
+static bool                     FGEN_STREAM_WRAP;   // mem_tx_wrap_en before the first stream started
+static portMUX_TYPE             FGEN_STREAM_LOCK = portMUX_INITIALIZER_UNLOCKED;
+
+// Generator slots, in internal RAM as the refill ISR reads the streamed items
+static fgen_slot_t FGEN_SLOTS[RMT_CHANNEL_MAX];
+
+// Serializes the calls changing generators, channels or the GPIO pool, so
+// that any task can make them. Recursive, as some of them make others,
+// such as fgen_alloc() moving generators with fgen_stop() and fgen_start()
+static SemaphoreHandle_t FGEN_LOCK;
+static StaticSemaphore_t FGEN_LOCK_BUFFER;
+static portMUX_TYPE      FGEN_LOCK_INIT = portMUX_INITIALIZER_UNLOCKED;
+
+// The solution cache is updated by fgen_info() and its variants, which
+// take no lock otherwise
+static portMUX_TYPE      FGEN_CACHE_LOCK = portMUX_INITIALIZER_UNLOCKED;
+
+// Keeps the RMT reader from being lost sight of while items are written ahead of
+// it, and group starts from being spread out by interrupts
+static portMUX_TYPE      FGEN_RETUNE_LOCK = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE      FGEN_GROUP_LOCK  = portMUX_INITIALIZER_UNLOCKED;
+
+// Whether fgen_burst_end() is the RMT driver end of transmission callback
+static bool              FGEN_BURST_CALLBACK;
+
+// Events scheduled by fgen_schedule(), sorted by time, those being run,
+// and the task running them, woken up by an esp_timer shortly before the
+// first one. All of them are changed with the lock taken
+static fgen_sched_t          FGEN_SCHED[FGEN_SCHED_MAX];
+static size_t                FGEN_SCHED_N;
+static fgen_sched_t          FGEN_SCHED_RUN[FGEN_SCHED_MAX];
+static size_t                FGEN_SCHED_RUN_N;
+static TaskHandle_t          FGEN_SCHED_TASK;
+static esp_timer_handle_t    FGEN_SCHED_TIMER;
+static fgen_schedule_stats_t FGEN_SCHED_STATS;
+static double                FGEN_SCHED_ERR_SUM;
 
 
 /* ************************************************************************* */
 /*                        AUXILIAR FUNCTIONS SECTION                         */
 /* ************************************************************************* */
 
+// Created on first use, whichever task gets there first
+
+static
+void fgen_lock()
+{
+    if (FGEN_LOCK == NULL) {
+        portENTER_CRITICAL(&FGEN_LOCK_INIT);
+        if (FGEN_LOCK == NULL) {
+            FGEN_LOCK = xSemaphoreCreateRecursiveMutexStatic(&FGEN_LOCK_BUFFER);
+        }
+        portEXIT_CRITICAL(&FGEN_LOCK_INIT);
+    }
+    xSemaphoreTakeRecursive(FGEN_LOCK, portMAX_DELAY);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static
+void fgen_unlock()
+{
+    xSemaphoreGiveRecursive(FGEN_LOCK);
+}
+
+/* ------------------------------------------------------------------------- */
+
+
+// Whether a GPIO pin can drive a generator: neither input only nor taken
+// by the SPI flash or the console UART. Strapping pins are fine once
+// booted, as long as nothing outside pulls them at reset.
+
+static
+esp_err_t fgen_gpio_check(gpio_num_t gpio_num)
+{
+    static const gpio_num_t strapping[] = { GPIO_NUM_0, GPIO_NUM_2, GPIO_NUM_5, GPIO_NUM_12, GPIO_NUM_15 };
+
+    if (!GPIO_IS_VALID_OUTPUT_GPIO(gpio_num)) {
+        ESP_LOGE(FGEN_TAG,"%s: GPIO %d is input only or does not exist", __FUNCTION__, gpio_num);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((gpio_num >= GPIO_NUM_6 && gpio_num <= GPIO_NUM_11) || gpio_num == GPIO_NUM_1 || gpio_num == GPIO_NUM_3) {
+        ESP_LOGE(FGEN_TAG,"%s: GPIO %d is taken by the SPI flash or the console UART", __FUNCTION__, gpio_num);
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < sizeof(strapping)/sizeof(strapping[0]); i++) {
+        if (gpio_num == strapping[i]) {
+            ESP_LOGW(FGEN_TAG,"GPIO %d is a strapping pin, not to be pulled at reset", gpio_num);
+        }
+    }
+    return ESP_OK;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Whether a generator already drives a GPIO pin
+
+static
+bool fgen_gpio_used(gpio_num_t gpio_num)
+{
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        if (FGEN_SLOTS[i].used && FGEN_SLOTS[i].res.gpio_num == gpio_num) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Parses a comma separated GPIO list, such as CONFIG_FGEN_GPIO_POOL
+
+static
+esp_err_t fgen_gpio_parse(const char* str, gpio_num_t* pins, size_t* n)
+{
+    char* end;
+
+    for (*n = 0; *str != 0; (*n)++) {
+        FGEN_CHECK(*n < RMT_CHANNEL_MAX, "More GPIO pins than RMT channels", ESP_ERR_INVALID_SIZE);
+        pins[*n] = strtol(str, &end, 10);
+        FGEN_CHECK(end != str && (*end == ',' || *end == 0), "GPIO pins must be given as <GPIO>,...", ESP_ERR_INVALID_ARG);
+        str = end + (*end == ',');
+    }
+    return ESP_OK;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// fgen_gpio_pool_set() with the lock taken, as generators take pool pins
+
+static
+esp_err_t fgen_gpio_pool_set_locked(const gpio_num_t* pins, size_t n)
+{
+    gpio_num_t pool[RMT_CHANNEL_MAX];
+    esp_err_t  ret;
+
+    if (pins == NULL) {
+        ret = fgen_gpio_parse(CONFIG_FGEN_GPIO_POOL, pool, &n);
+        FGEN_CHECK(ret == ESP_OK, "Bad CONFIG_FGEN_GPIO_POOL", ret);
+        pins = pool;
+    }
+    FGEN_CHECK(n <= RMT_CHANNEL_MAX, "More GPIO pins than RMT channels", ESP_ERR_INVALID_SIZE);
+    for (size_t i = 0; i < n; i++) {
+        ret = fgen_gpio_check(pins[i]);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        for (size_t j = 0; j < i; j++) {
+            FGEN_CHECK(pins[j] != pins[i], "GPIO pin given twice", ESP_ERR_INVALID_ARG);
+        }
+    }
+
+    // Pool pins already driving a generator stay allocated
+    for (size_t i = 0; i < n; i++) {
+        FREQ_GPIO[i].gpio_num  = pins[i];
+        FREQ_GPIO[i].allocated = fgen_gpio_used(pins[i]);
+    }
+    FREQ_GPIO_NUM   = n;
+    FREQ_GPIO_READY = true;
+    return ESP_OK;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// The configured pool, unless set before first use
+
+static
+void fgen_gpio_pool_init()
+{
+    if (!FREQ_GPIO_READY && fgen_gpio_pool_set_locked(NULL, 0) != ESP_OK) {
+        ESP_LOGE(FGEN_TAG,"No GPIO pool, only given pins can be used");
+        FREQ_GPIO_READY = true;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Gives a generator the pin it asks for, once checked and if no other
+// generator drives it, or else the first free one in the pool
 
 static
 gpio_num_t fgen_gpio_alloc(gpio_num_t gpio_num)
 {
+    fgen_gpio_pool_init();
     if (gpio_num != GPIO_NUM_NC) {
+        if (fgen_gpio_check(gpio_num) != ESP_OK) {
+            return GPIO_NUM_NC;
+        }
+        if (fgen_gpio_used(gpio_num)) {
+            ESP_LOGE(FGEN_TAG,"%s: GPIO %d already driven by another generator", __FUNCTION__, gpio_num);
+            return GPIO_NUM_NC;
+        }
         ESP_LOGD(FGEN_TAG,"returning same GPIO %d as given", gpio_num);
+        // Not to be handed out again if it is a pool one
+        for (int i=0; i<FREQ_GPIO_NUM; i++) {
+            if (FREQ_GPIO[i].gpio_num == gpio_num) {
+                FREQ_GPIO[i].allocated = true;
+            }
+        }
         return gpio_num;
     }
 
@@ -141,7 +623,7 @@ void fgen_gpio_free(gpio_num_t gpio_num)
 /* ------------------------------------------------------------------------- */
 
 // A given channel has its block and all the blocks of the
-// other upper channels if they are not already allocated 
+// other upper channels up to the first one already allocated
 // RMT Channel 7 -> only 1 block
 // RMT Channel 6 -> up to 2 blocks
 // RMT Channel 5 -> up to 3 blocks
@@ -151,40 +633,66 @@ static
 size_t fgen_max_mem_blocks(rmt_channel_t channel)
 {
     size_t sum = 0;
-    for (rmt_channel_t i=channel; i<RMT_CHANNEL_MAX; i++) {
-        if  (FREQ_CHANNEL[i].state == FGEN_CHANNEL_FREE)
-            sum += 1;
+    for (rmt_channel_t i=channel; i<RMT_CHANNEL_MAX && FREQ_CHANNEL[i].state == FGEN_CHANNEL_FREE; i++) {
+        sum += 1;
     }
     return sum;
 }
 
 /* ------------------------------------------------------------------------- */
 
+// Free channel with room for mem_blocks, -1 if none.
+// Channels are packed from the top, unless the one with the most room
+// is wanted, to spread repetitions over its spare blocks.
 
 static
-rmt_channel_t fgen_channel_alloc(size_t mem_blocks)
+rmt_channel_t fgen_channel_find(size_t mem_blocks, bool roomy)
 {
-    size_t N;
+    rmt_channel_t found = -1;
+    size_t N, room = 0;
+
     for (rmt_channel_t i = 0; i < RMT_CHANNEL_MAX; i++) {
         rmt_channel_t ch = RMT_CHANNEL_MAX-1-i;
         N = fgen_max_mem_blocks(ch);
-        if (FREQ_CHANNEL[ch].state == FGEN_CHANNEL_FREE && mem_blocks <= N) {
-            ESP_LOGD(FGEN_TAG,"Allocating new RMT channel %d with %d blocks", ch, mem_blocks);
-            FREQ_CHANNEL[ch].state = FGEN_CHANNEL_USED;
-            FREQ_CHANNEL[ch].mem_blocks = mem_blocks;
-            if (mem_blocks > 1) {
-                mem_blocks -= 1;
-                // Marking channels > ch as unavailable because we use their memory blocks
-                for(rmt_channel_t j = ch+1; j<ch+1+mem_blocks; j++) {
-                    ESP_LOGD(FGEN_TAG,"Marking RMT channel %d as unavailable", j);
-                    FREQ_CHANNEL[j].state = FGEN_CHANNEL_UNAVAILABLE;
-                    FREQ_CHANNEL[j].mem_blocks = 0;
-                }
+        if (mem_blocks <= N && N > room) {
+            found = ch;
+            room  = N;
+            if (!roomy) {
+                break;
             }
-            return ch;
         }
     }
-    return -1;
+    return found;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static
+void fgen_channel_take(rmt_channel_t ch, size_t mem_blocks)
+{
+    ESP_LOGD(FGEN_TAG,"Allocating new RMT channel %d with %d blocks", ch, mem_blocks);
+    FREQ_CHANNEL[ch].state = FGEN_CHANNEL_USED;
+    FREQ_CHANNEL[ch].mem_blocks = mem_blocks;
+    // Marking channels > ch as unavailable because we use their memory blocks
+    for(rmt_channel_t j = ch+1; j<ch+mem_blocks; j++) {
+        ESP_LOGD(FGEN_TAG,"Marking RMT channel %d as unavailable", j);
+        FREQ_CHANNEL[j].state = FGEN_CHANNEL_UNAVAILABLE;
+        FREQ_CHANNEL[j].mem_blocks = 0;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Gives the blocks of a channel beyond the first mem_blocks back
+static
+void fgen_channel_shrink(rmt_channel_t channel, size_t mem_blocks)
+{
+    for (rmt_channel_t ch = channel+mem_blocks; ch < channel+FREQ_CHANNEL[channel].mem_blocks; ch++) {
+        ESP_LOGD(FGEN_TAG,"Freeing adjacent RMT channel %d", ch);
+        FREQ_CHANNEL[ch].state = FGEN_CHANNEL_FREE;
+        FREQ_CHANNEL[ch].mem_blocks = 1;
+    }
+    FREQ_CHANNEL[channel].mem_blocks = mem_blocks;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -203,381 +711,4034 @@ void fgen_channel_free(rmt_channel_t channel)
         FREQ_CHANNEL[ch].state = FGEN_CHANNEL_FREE;
         FREQ_CHANNEL[ch].mem_blocks = 1;
     }
+    FREQ_CHANNEL[channel].spread = NULL;
 }
 
+/* ------------------------------------------------------------------------- */
 
-// Find two fgen N and Prescaler so that
-// FGEN_APB = Fout * (Prescaler * N)
-// being Prescaler and N both integers
+// A free slot, cleared, with no GPIO nor channel yet. NULL if none
 
-static 
-esp_err_t fgen_find_freq(double fout, double duty_cycle, fgen_info_t* fgen)
+static
+fgen_resources_t* fgen_slot_take()
 {
-
-    double whole; 
-    double new_N;
-    double err, new_err;
-    double dNhigh, dNlow;
-
-    fgen->prescaler = 255;   // Assume highest prescaler
-
-    whole   = round(FGEN_APB/fout);
-    fgen->N = whole / fgen->prescaler;
-    err     = fmod(whole,  fgen->prescaler);
-
-    while (fgen->prescaler > 1) {
-        new_N     = whole / fgen->prescaler;
-        new_err   = fmod(whole, fgen->prescaler);
-        if (new_err == 0.0 && new_N > 1.0) {
-            err     = new_err;
-            fgen->N = new_N;
-            break;
-        } else if (new_err < err) {
-            err     = new_err;
-            fgen->N = new_N;
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        if (!FGEN_SLOTS[i].used) {
+            memset(&FGEN_SLOTS[i].res, 0, sizeof(fgen_resources_t));
+            FGEN_SLOTS[i].used         = true;
+            FGEN_SLOTS[i].driver       = false;
+            FGEN_SLOTS[i].res.gpio_num = GPIO_NUM_NC;
+            FGEN_SLOTS[i].res.channel  = -1;
+            FGEN_SLOTS[i].res.handle   = -1;
+            return &FGEN_SLOTS[i].res;
         }
-        fgen->prescaler -= 1; 
     }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
 
-    if (fgen->prescaler == 2 && err != 0.0) {
-        fgen->prescaler = 1;
-        fgen->N         = whole;
+static
+fgen_slot_t* fgen_slot_of(const fgen_resources_t* res)
+{
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        if (&FGEN_SLOTS[i].res == res) {
+            return &FGEN_SLOTS[i];
+        }
     }
+    return NULL;
+}
 
-    // Now that N has been fixed, we find its High and low part
-    // taking into account the duty cycle
-    // If N is odd, there will be a roundoff error
-    // and we will increment N by one to preserve 50% duty cycle if requested
+/* ------------------------------------------------------------------------- */
 
-    dNhigh = fgen->N * duty_cycle; // floating point
-    dNlow  = fgen->N - dNhigh;     // still floating point
+// Generator on a given RMT channel, NULL if none
 
-    FGEN_CHECK(dNhigh >=1.0, "High state count NH < 1", ESP_ERR_INVALID_SIZE);
-    FGEN_CHECK(dNlow >= 1.0, "Low  state count NL < 1", ESP_ERR_INVALID_SIZE);
+static
+fgen_resources_t* fgen_slot_on(rmt_channel_t channel)
+{
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        if (FGEN_SLOTS[i].used && FGEN_SLOTS[i].res.channel == channel && FREQ_CHANNEL[channel].state == FGEN_CHANNEL_USED) {
+            return &FGEN_SLOTS[i].res;
+        }
+    }
+    return NULL;
+}
 
-    // If Ntot is odd, we'd better round to even parts
-    // and increment Ntot by one to preserve 50% duty cycle if requested
-    fgen->NH = (uint32_t)(round(dNhigh));
-    fgen->NL = (uint32_t)(round(dNlow));
-    fgen->N  = fgen->NH + fgen->NL;   // May be changed by one unit by rounding
+/* ------------------------------------------------------------------------- */
 
-    return ESP_OK;
+static
+bool fgen_handle_used(rmt_channel_t handle, const fgen_resources_t* res)
+{
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        if (FGEN_SLOTS[i].used && &FGEN_SLOTS[i].res != res && FGEN_SLOTS[i].res.handle == handle) {
+            return true;
+        }
+    }
+    return false;
 }
 
+/* ------------------------------------------------------------------------- */
 
+// Channel number shown for a new generator: the RMT channel it takes,
+// unless a generator moved away from that channel still goes by it.
+// There are as many numbers as slots, so one is always left.
 
-/* -------------------------------------------------------------------------- */
-
-static 
-uint16_t fgen_count_items(uint32_t NH, uint32_t NL)
+static
+rmt_channel_t fgen_handle_pick(const fgen_resources_t* res)
 {
-    uint16_t count = 0;
+    rmt_channel_t handle = res->channel;
 
-    // Quick way out for only 1 item
-    if (NH < 32768 && NL < 32768) {
-        count += 1;  // item
-        return count;
+    for (rmt_channel_t h = 0; fgen_handle_used(handle, res); h++) {
+        handle = h;
     }
+    return handle;
+}
 
-    // Long high period
-    while (NH > 32767*2) {
-        NH   -= 32767*2;
-        count += 1;
-    }
+/* ------------------------------------------------------------------------- */
 
-    // Ending high part
-    if ((32767 < NH) && (NH <= 32767*2)) {
-        NH -= 32767;
-        count += 1;
-    } else {
-        uint32_t padding = min(NL, 32767);
-        NL -= padding;
-        count += 1;
-    }
-        
-    // Long low period
-    while (NL > 32767*2) {
-        NL   -= 32767*2;
-        count += 1;
-    }
+static
+size_t fgen_free_blocks()
+{
+    size_t sum = 0;
 
-    // Ending low part
-    if ((32767 < NL) && (NL <= 32767*2)) {
-        NL -= 32767;
-        count += 1;
-    } else if (NL > 0) {
-        count += 1;
+    for (rmt_channel_t ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+        sum += (FREQ_CHANNEL[ch].state == FGEN_CHANNEL_FREE);
     }
-
-    // The count does not include a final EoTx item
-    return count;
+    return sum;
 }
 
-/* -------------------------------------------------------------------------- */
 
-// Fills an array of items
-// Give an updated pointer so that we can mark the end of transmission
-// or concatenate more items
-// NO EoTX value is written, must be written outside
-static 
-rmt_item32_t* fgen_fill_items(rmt_item32_t* item, uint32_t NH, uint32_t NL)
+// Largest divisor of M within [pmin, pmax], 0 if there is none.
+// Short ranges are simply scanned. Otherwise M is factored over the small
+// primes and its divisors up to pmax are built from those factors, which
+// takes far less 64 bit divisions than trying every value in the range.
+
+static
+uint32_t fgen_best_divisor(uint64_t M, uint32_t pmin, uint32_t pmax)
 {
+    bool     divisor[FGEN_MAX_PRESCALER+1] = { false };
+    uint32_t p, q, d, r;
+    uint8_t  e, j;
 
-    // Quick way out for only 1 item
-    if (NH < 32768 && NL < 32768) {
-        item->duration0 = NH; item->level0 = 1;
-        item->duration1 = NL; item->level1 = 0;
-        item++;
-        return item;
+    if (pmin > pmax) {
+        return 0;
     }
 
-    // Long high period
-    while (NH > 32767*2) {
-        NH   -= 32767*2;
-        item->duration0 = 32767; item->level0 = 1;
-        item->duration1 = 32767; item->level1 = 1;
-        item++;
+    if (pmax - pmin < FGEN_NPRIMES) {
+        for (p = pmax; p >= pmin; p--) {
+            if (M % p == 0) {
+                return p;
+            }
+        }
+        return 0;
     }
 
-    // Ending high part
-    if ((32767 < NH) && (NH <= 32767*2)) {
-        NH -= 32767;
-        item->duration0 = 32767; item->level0 = 1;
-        item->duration1 = NH;    item->level1 = 1;
-        item++;
-        
-    } else {
-        uint32_t padding = min(NL, 32767);
-        item->duration0 = NH;      item->level0 = 1;
-        item->duration1 = padding; item->level1 = 0;
-        item++;
-        NL -= padding;
-    }
-        
-    // Long low period
-    while (NL > 32767*2) {
-        NL   -= 32767*2;
-        item->duration0 = 32767; item->level0 = 0;
-        item->duration1 = 32767; item->level1 = 0;
-        item++;
-    }
-
-    // Ending low part
-    if ((32767 < NL) && (NL <= 32767*2)) {
-        NL -= 32767;
-        item->duration0 = 32767; item->level0 = 0;
-        item->duration1 = NL;    item->level1 = 0;
-        item++;
-    } else if (NL > 0) {
-        item->duration0 = NL; item->level0 = 0;
-        item->duration1 = 0;  item->level1 = 0;
-        item++;
+    divisor[1] = true;
+    for (size_t i = 0; i < FGEN_NPRIMES && FGEN_PRIMES[i] <= pmax; i++) {
+        p = FGEN_PRIMES[i];
+        r = M % FGEN_PRIME_POWERS[i];
+        // Only the multiplicity up to pmax matters
+        for (e = 0, q = p; q <= pmax && (r % q) == 0; q *= p) {
+            e += 1;
+        }
+        // Going downwards, divisors added here are not multiplied by p again
+        for (d = pmax; e > 0 && d >= 1; d--) {
+            if (divisor[d]) {
+                for (j = 0, q = d; j < e && q * p <= pmax; j++) {
+                    q *= p;
+                    divisor[q] = true;
+                }
+            }
+        }
     }
-    return item;
+
+    for (p = pmax; p >= pmin; p--) {
+        if (divisor[p]) {
+            return p;
+        }
+    }
+    return 0;
 }
 
 /* -------------------------------------------------------------------------- */
 
-static 
-void fgen_print_items(const rmt_item32_t* p, uint32_t N)
+static
+uint32_t fgen_gcd(uint32_t a, uint32_t b)
 {
-    ESP_LOGD(FGEN_TAG,"Displaying %d items + EoTx", N-1);
+    uint32_t t;
 
-#if CONFIG_LOG_DEFAULT_LEVEL == ESP_LOG_VERBOSE
-    const uint32_t NN = 8;
-    uint32_t rows = N / NN;
-    uint32_t rem  = N % NN;
-    uint32_t row, offset, i, j;  
-    ESP_LOGV(FGEN_TAG,"%d complete rows with %d items each and %d more items in the last row", rows, NN, rem);
-    printf("-------------------------------------------------------------------\n");
-    for (row = 0; row < rows; row++) {
-        for (i=0; i<NN; i++) {
-            offset = NN*row+i;
-            printf("{{{%d,%d,%d,%d}}},\t", p[offset].duration0, p[offset].level0, p[offset].duration1, p[offset].level1);
-        }
-        printf("\n");
+    while (b != 0) {
+        t = a % b;
+        a = b;
+        b = t;
     }
-    for (j=0; j<rem; j++) {
-        offset = NN*rows+j;
-        printf("{{{%d,%d,%d,%d}}},\t", p[offset].duration0, p[offset].level0, p[offset].duration1, p[offset].level1);
-    }
-    if (rem) printf("\n");
-    printf("-------------------------------------------------------------------\n");
-#endif
+    return a;
 }
 
 /* -------------------------------------------------------------------------- */
 
-static 
-void fgen_log_params(double Fout, double duty_cycle, fgen_info_t* fgen)
-{
-    double Tclk, ErrFreq, Errduty_cycle;
-
-    // Recompute the Fout frequency with all that rounding taking place
-    // and check the relative  error
-    fgen->freq       = FGEN_APB / (fgen->prescaler * (double)(fgen->N));
-    fgen->duty_cycle = fgen->NH / (double)(fgen->N);
-    ErrFreq          = (fgen->freq - Fout)/Fout;
-    Errduty_cycle    = (fgen->duty_cycle - duty_cycle)/duty_cycle; 
-    Tclk             = (double) fgen->prescaler / FGEN_APB;
+// Smallest prescaler that keeps N = M / prescaler within FGEN_MAX_N
 
-    ESP_LOGD(FGEN_TAG,"Ref Clock = %.0f Hz, Prescaler = %d, RMT Clock = %.2f Hz", FGEN_APB, fgen->prescaler, 1/Tclk);    
-    ESP_LOGD(FGEN_TAG,"Ntot = %d, Nhigh = %d, Nlow = %d", fgen->N, fgen->NH, fgen->NL);
-    ESP_LOGD(FGEN_TAG,"Fout = %.3f Hz => %.3f Hz (%.2f%%), Duty Cycle = %.2f%% => %.2f%% (%.2f%%)", Fout, fgen->freq, ErrFreq*100, duty_cycle*100, fgen->duty_cycle*100, Errduty_cycle*100);
+static inline
+uint32_t fgen_min_prescaler(uint64_t M)
+{
+    uint64_t pmin = (M + FGEN_MAX_N - 1) / FGEN_MAX_N;
+    return (pmin < 1) ? 1 : min(pmin, FGEN_MAX_PRESCALER);
 }
 
 /* -------------------------------------------------------------------------- */
 
+// Marks every multiple M of p within the window with p, for every p in
+// ascending order, so that the largest one is left. p is only a prescaler
+// of M if M >= 2p. About 6 byte writes per entry, where fgen_best_divisor()
+// takes tens of 64 bit divisions per product.
 
 static
-void fgen_waveform(fgen_resources_t* res)
+void fgen_sieve_build(fgen_sieve_t* sieve, uint64_t base)
 {
-    // Generate the pattern and repeat it as much as we can within a 64 -item block
-    rmt_item32_t* p = res->items;
+    uint64_t M;
+
+    sieve->base = base;
+    memset(sieve->div, 1, sizeof(sieve->div));
+    for (uint32_t p = 2; p <= FGEN_MAX_PRESCALER; p++) {
+        M = (base + p - 1) / p * p;
+        M = (M < 2 * p) ? 2 * p : M;
+        for (; M < base + FGEN_BATCH_WINDOW; M += p) {
+            sieve->div[M - base] = p;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Same as fgen_best_divisor(M, fgen_min_prescaler(M), min(M/2, FGEN_MAX_PRESCALER)),
+// looked up in the sieve if given and M falls within it
+
+static inline
+uint32_t fgen_divisor(const fgen_sieve_t* sieve, uint64_t M)
+{
+    uint32_t p;
+
+    if (sieve != NULL && M >= sieve->base && M - sieve->base < FGEN_BATCH_WINDOW) {
+        p = sieve->div[M - sieve->base];
+        return (p >= fgen_min_prescaler(M)) ? p : 0;
+    }
+    return fgen_best_divisor(M, fgen_min_prescaler(M), min(M/2, FGEN_MAX_PRESCALER));
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Splits N into its high and low parts according to the duty cycle.
+// Returns false if either of them would be empty.
+
+static inline
+bool fgen_split_duty(const fgen_target_t* target, uint32_t N, uint32_t* NH, uint32_t* NL)
+{
+    uint64_t high = ((uint64_t) N * target->dnum + target->dden/2) / target->dden;
+
+    *NH = min(high, (uint64_t) N - 1);
+    *NL = N - *NH;
+    return (uint64_t) N * target->dnum >= target->dden && 
+           (uint64_t) N * (target->dden - target->dnum) >= target->dden;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Find two fgen N and Prescaler so that
+// FGEN_APB = Fout * (Prescaler * N)
+// being Prescaler and N both integers.
+//
+// The product M = Prescaler * N is an integer number of APB ticks, so the
+// lowest period error is given by the integer M closest to FGEN_APB/Fout
+// that can be split as Prescaler * N. Candidate products are visited in order
+// of increasing distance to the exact period and the first one with a
+// divisor in the allowed prescaler range is the optimum. Among equal errors,
+// the highest prescaler is chosen as it yields the shortest item sequence.
+// Any 255 consecutive integers contain a multiple of 255, so no more than
+// 256 candidates are ever visited, and usually only the first one.
+// All the arithmetic is done in 64 bit integers on the exact target ratios.
+// The divisors are looked up in sieve, if not NULL, when within it.
+
+static 
+esp_err_t fgen_find_freq(const fgen_target_t* target, const fgen_sieve_t* sieve, fgen_info_t* fgen)
+{
+    uint64_t lo,  hi;   // next candidate products below and above the period
+    uint64_t dlo, dhi;  // their distances to the period, scaled by tden
+    uint64_t M;
+    uint32_t prescaler;
+
+    FGEN_CHECK(target->tnum >= 2 * target->tden, "Fout above half the APB clock", ESP_ERR_INVALID_ARG);
+
+    lo  = target->tnum / target->tden;
+    hi  = lo + 1;
+    dlo = target->tnum - lo * target->tden;
+    dhi = hi * target->tden - target->tnum;
+    do {
+        if (lo >= 2 && dlo < dhi) {
+            M    = lo--;
+            dlo += target->tden;
+        } else {
+            M    = hi++;
+            dhi += target->tden;
+        }
+        prescaler = fgen_divisor(sieve, M);
+    } while (prescaler == 0);
+
+    FGEN_CHECK(M / prescaler < (1UL << 31), "Fout too low", ESP_ERR_INVALID_SIZE);
+    fgen->prescaler = prescaler;
+    fgen->N         = M / prescaler;
+    ESP_LOGD(FGEN_TAG,"Period = %llu/%llu ticks => %llu ticks (%d x %d)", target->tnum, target->tden, M, fgen->prescaler, fgen->N);
+
+    // Now that N has been fixed, we find its High and low part
+    // taking into account the duty cycle
+    // If N is odd, there will be a roundoff error in the duty cycle.
+    // N itself is kept so that the frequency found above is preserved
+
+    FGEN_CHECK(fgen->N * target->dnum >= target->dden,                  "High state count NH < 1", ESP_ERR_INVALID_SIZE);
+    FGEN_CHECK(fgen->N * (target->dden - target->dnum) >= target->dden, "Low  state count NL < 1", ESP_ERR_INVALID_SIZE);
+
+    fgen_split_duty(target, fgen->N, &fgen->NH, &fgen->NL);
+    return ESP_OK;
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+
+// How NH high ticks followed by NL low ticks are laid out in RMT items,
+// each item holding two halves of up to FGEN_ITEM_TICKS:
+//   hfull items full of high level,
+//   a middle item with the rest of the high level and, if it fits
+//   in its second half, the beginning of the low level,
+//   lfull items full of low level,
+//   a tail item with the rest of the low level, if any.
+// A period shorter than two halves is thus a single (NH, NL) middle item.
+
+static inline
+void fgen_plan_items(uint32_t NH, uint32_t NL, fgen_items_plan_t* lay)
+{
+    const uint32_t FULL = 2 * FGEN_ITEM_TICKS;
+    uint32_t rest;
+
+    // Full high items, leaving 1 to FULL high ticks for the middle item
+    lay->hfull = (NH > 0) ? (NH - 1) / FULL : 0;
+    NH        -= lay->hfull * FULL;
+    if (NH > FGEN_ITEM_TICKS) {
+        lay->mid.duration0 = FGEN_ITEM_TICKS;      lay->mid.level0 = 1;
+        lay->mid.duration1 = NH - FGEN_ITEM_TICKS; lay->mid.level1 = 1;
+    } else {
+        rest = min(NL, FGEN_ITEM_TICKS);
+        lay->mid.duration0 = NH;   lay->mid.level0 = 1;
+        lay->mid.duration1 = rest; lay->mid.level1 = 0;
+        NL -= rest;
+    }
+
+    // Full low items, leaving 0 to FULL low ticks for the tail item
+    lay->lfull = (NL > 0) ? (NL - 1) / FULL : 0;
+    NL        -= lay->lfull * FULL;
+    lay->tail.val = 0;
+    if (NL > FGEN_ITEM_TICKS) {
+        lay->tail.duration0 = FGEN_ITEM_TICKS;      lay->tail.level0 = 0;
+        lay->tail.duration1 = NL - FGEN_ITEM_TICKS; lay->tail.level1 = 0;
+    } else {
+        lay->tail.duration0 = NL;  lay->tail.level0 = 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Number of items needed by the NH + NL period, in constant time.
+// The count does not include a final EoTx item
+
+static 
+uint16_t fgen_count_items(uint32_t NH, uint32_t NL)
+{
+    fgen_items_plan_t lay;
+
+    fgen_plan_items(NH, NL, &lay);
+    return lay.hfull + 1 + lay.lfull + (lay.tail.val != 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills an array of items
+// Give an updated pointer so that we can mark the end of transmission
+// or concatenate more items
+// NO EoTX value is written, must be written outside
+static 
+rmt_item32_t* fgen_fill_items(rmt_item32_t* item, uint32_t NH, uint32_t NL)
+{
+    fgen_items_plan_t lay;
+    rmt_item32_t      high = {{{ FGEN_ITEM_TICKS, 1, FGEN_ITEM_TICKS, 1 }}};
+    rmt_item32_t      low  = {{{ FGEN_ITEM_TICKS, 0, FGEN_ITEM_TICKS, 0 }}};
+
+    fgen_plan_items(NH, NL, &lay);
+    for (uint32_t i = 0; i < lay.hfull; i++) {
+        *item++ = high;
+    }
+    *item++ = lay.mid;
+    for (uint32_t i = 0; i < lay.lfull; i++) {
+        *item++ = low;
+    }
+    if (lay.tail.val != 0) {
+        *item++ = lay.tail;
+    }
+    return item;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// RMT item halves needed by a pattern run, one more for the split one
+
+static inline
+uint32_t fgen_run_halves(const fgen_pattern_t* pat, size_t i)
+{
+    return (pat->runs[i].ticks + FGEN_ITEM_TICKS - 1) / FGEN_ITEM_TICKS + (i == pat->split);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Rounds the pattern edges to the nearest tick of prescaler and clock,
+// measuring the rounding errors in ps, and returns the items it needs or
+// 0 if some run gets no tick. Runs take as many halves as their length
+// needs. If that makes an odd number, the first run at least 2 ticks
+// long is split in one more half, so that every item is a whole one.
+
+static
+size_t fgen_pattern_ticks(fgen_pattern_t* pat, uint64_t clock, uint32_t prescaler, uint64_t* edge_err, uint64_t* period_err)
+{
+    uint64_t tick = prescaler * (1000000000000ULL / clock);
+    uint64_t t = 0, E = 0, prev = 0, err = 0;
+    size_t   halves = 0;
+
+    *edge_err  = 0;
+    pat->split = pat->nruns;
+    for (size_t i = 0; i < pat->nruns; i++) {
+        t += pat->runs[i].ns * 1000;
+        E  = (t + tick/2) / tick;
+        if (E == prev || E > UINT32_MAX) {
+            return 0;
+        }
+        pat->runs[i].ticks = E - prev;
+        err       = (E * tick > t) ? E * tick - t : t - E * tick;
+        *edge_err = (err > *edge_err) ? err : *edge_err;
+        halves   += fgen_run_halves(pat, i);
+        prev      = E;
+    }
+    *period_err = err;
+
+    for (size_t i = 0; i < pat->nruns && (halves % 2); i++) {
+        if (pat->runs[i].ticks >= 2) {
+            pat->split = i;
+            halves    += 1;
+        }
+    }
+    return (halves % 2) ? 0 : halves / 2;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills an array of items with a pattern, splitting its runs in halves of
+// at most FGEN_ITEM_TICKS. The compensated one gives a tick of its last run
+// to the loop idle tick. NO EoTX value is written, must be written outside.
+// Items are stored whole, as RMT RAM is only written 32 bits at a time
+
+static
+rmt_item32_t* fgen_fill_runs(rmt_item32_t* item, const fgen_pattern_t* pat, bool compensated)
+{
+    rmt_item32_t cur = {{{ 0 }}};
+    uint32_t t, d, m;
+    bool     second = false;
+
+    for (size_t i = 0; i < pat->nruns; i++) {
+        t = pat->runs[i].ticks - (compensated && i == pat->nruns - 1);
+        for (m = fgen_run_halves(pat, i); m > 0; m--) {
+            // leaving at least one tick for each half to come
+            d  = min(t - (m - 1), FGEN_ITEM_TICKS);
+            t -= d;
+            if (second) {
+                cur.duration1 = d; cur.level1 = pat->runs[i].level;
+                *item++ = cur;
+            } else {
+                cur.duration0 = d; cur.level0 = pat->runs[i].level;
+            }
+            second = !second;
+        }
+    }
+    return item;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Whether the k-th of nrep periods is one of the nlong N+1 tick ones.
+// They are spread as evenly as possible, keeping the edges within half
+// a tick of a clock at the average frequency.
+
+static inline
+bool fgen_long_period(uint32_t k, uint32_t nrep, uint32_t nlong)
+{
+    return ((k + 1) * nlong + nrep/2) / nrep != (k * nlong + nrep/2) / nrep;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static inline
+uint8_t fgen_blocks(const fgen_target_t* target, uint32_t N)
+{
+    uint32_t NH, NL;
+
+    fgen_split_duty(target, N, &NH, &NL);
+    return 1 + fgen_count_items(NH, NL) / 64;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+bool fgen_candidate(const fgen_target_t* target, uint32_t prescaler, uint64_t N, fgen_candidate_t* cand)
+{
+    uint32_t NH, NL;
+    uint64_t MT;
+
+    if (N < 2 || N > FGEN_MAX_N || !fgen_split_duty(target, N, &NH, &NL)) {
+        return false;
+    }
+    MT = prescaler * N * target->tden;
+    cand->err        = (MT > target->tnum) ? MT - target->tnum : target->tnum - MT;
+    cand->prescaler  = prescaler;
+    cand->N          = N;
+    cand->mem_blocks = 1 + fgen_count_items(NH, NL) / 64;
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Visits the candidates worth considering for any objective: the lowest
+// error solution found by fgen_find_freq(), if valid, and for every prescaler the N
+// closest to the period within the tolerance window plus, going down from it,
+// the closest N giving each lower number of memory blocks. The block count
+// never decreases with N, so each of those is found by bisection.
+// Any other N is worse than one of these in error, blocks and jitter.
+
+static
+esp_err_t fgen_search(const fgen_target_t* target, const fgen_sieve_t* sieve, fgen_visitor_t visit, void* ctx)
+{
+    fgen_info_t      best;
+    fgen_candidate_t cand;
+    uint64_t w, mlo, mhi, pden;
+    uint64_t N, Nlo, Nhi, lo, hi, mid;
+    esp_err_t ret;
+
+    // Its N may be unusable for the duty cycle while others are not
+    ret = fgen_find_freq(target, sieve, &best);
+    if (ret == ESP_ERR_INVALID_ARG) {
+        return ret;
+    }
+    if (ret == ESP_OK && fgen_candidate(target, best.prescaler, best.N, &cand)) {
+        visit(&cand, ctx);
+    }
+
+    // Products M = prescaler * N within tol_ppm of the period
+    w   = (target->tnum / 1000000) * target->tol_ppm + (target->tnum % 1000000) * target->tol_ppm / 1000000;
+    mlo = (target->tnum - w + target->tden - 1) / target->tden;
+    mhi = (target->tnum + w) / target->tden;
+
+    for (uint32_t p = 1; p <= FGEN_MAX_PRESCALER; p++) {
+        Nlo = (mlo + p - 1) / p;
+        Nlo = (Nlo < 2) ? 2 : Nlo;
+        Nhi = min(mhi / p, FGEN_MAX_N);
+        if (Nlo > Nhi) {
+            continue;
+        }
+        pden = p * target->tden;
+        N    = target->tnum / pden;
+        if ((N + 1) * pden - target->tnum < target->tnum - N * pden) {
+            N += 1;
+        }
+        N = (N < Nlo) ? Nlo : (N > Nhi) ? Nhi : N;
+        if (!fgen_candidate(target, p, N, &cand)) {
+            continue;
+        }
+        visit(&cand, ctx);
+
+        while (cand.mem_blocks > 1 && fgen_blocks(target, Nlo) < cand.mem_blocks) {
+            lo = Nlo;
+            hi = cand.N - 1;
+            while (lo < hi) {
+                mid = lo + (hi - lo + 1) / 2;
+                if (fgen_blocks(target, mid) < cand.mem_blocks) {
+                    lo = mid;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            if (!fgen_candidate(target, p, lo, &cand)) {
+                break;
+            }
+            visit(&cand, ctx);
+        }
+    }
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Lexicographic order given by the objective. Ties in error are broken
+// as fgen_find_freq() does, in favour of the highest prescaler.
+
+static
+bool fgen_better(const fgen_candidate_t* a, const fgen_candidate_t* b, uint32_t objective)
+{
+    switch (objective) {
+        case FGEN_OBJ_BLOCKS:
+            if (a->mem_blocks != b->mem_blocks) return a->mem_blocks < b->mem_blocks;
+            if (a->err != b->err)               return a->err < b->err;
+            return a->prescaler < b->prescaler;
+        case FGEN_OBJ_JITTER:
+            if (a->prescaler != b->prescaler)   return a->prescaler < b->prescaler;
+            if (a->err != b->err)               return a->err < b->err;
+            return a->mem_blocks < b->mem_blocks;
+        default:
+            if (a->err != b->err)               return a->err < b->err;
+            if (a->mem_blocks != b->mem_blocks) return a->mem_blocks < b->mem_blocks;
+            return a->prescaler > b->prescaler;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_visit_best(const fgen_candidate_t* cand, void* ctx)
+{
+    fgen_best_ctx_t* best = ctx;
+
+    if (!best->found || fgen_better(cand, &best->best, best->objective)) {
+        best->best  = *cand;
+        best->found = true;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_visit_pareto(const fgen_candidate_t* cand, void* ctx)
+{
+    fgen_pareto_ctx_t* pareto = ctx;
+    size_t i, j;
+
+    for (i = 0; i < pareto->n; i++) {
+        const fgen_candidate_t* s = &pareto->set[i];
+        if (s->err <= cand->err && s->mem_blocks <= cand->mem_blocks && s->prescaler <= cand->prescaler) {
+            return;
+        }
+    }
+    // Drop the solutions the new one dominates
+    for (i = 0, j = 0; i < pareto->n; i++) {
+        const fgen_candidate_t* s = &pareto->set[i];
+        if (!(cand->err <= s->err && cand->mem_blocks <= s->mem_blocks && cand->prescaler <= s->prescaler)) {
+            pareto->set[j++] = *s;
+        }
+    }
+    pareto->n = j;
+    if (pareto->n < FGEN_PARETO_MAX) {
+        pareto->set[pareto->n++] = *cand;
+    } else {
+        pareto->truncated = true;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// 128 bit helpers for the joint search costs. The ESP32 has no native
+// 128 bit type, so products are built from 32 bit halves
+
+static inline
+fgen_u128_t fgen_mul_u128(uint64_t a, uint32_t b)
+{
+    fgen_u128_t r;
+    uint64_t    lo = (a & 0xFFFFFFFF) * b;
+    uint64_t    hi = (a >> 32) * b;
+
+    r.lo = lo + (hi << 32);
+    r.hi = (hi >> 32) + (r.lo < lo);
+    return r;
+}
+
+static inline
+fgen_u128_t fgen_add_u128(fgen_u128_t a, fgen_u128_t b)
+{
+    fgen_u128_t r;
+
+    r.lo = a.lo + b.lo;
+    r.hi = a.hi + b.hi + (r.lo < a.lo);
+    return r;
+}
+
+static inline
+int fgen_cmp_u128(fgen_u128_t a, fgen_u128_t b)
+{
+    if (a.hi != b.hi) {
+        return (a.hi < b.hi) ? -1 : 1;
+    }
+    return (a.lo < b.lo) ? -1 : (a.lo > b.lo);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// num/den as a 64 bit binary fraction, den below 2^63, saturated to
+// UINT64_MAX for ratios of 1 or more, found by long division. Errors are
+// small, so the leading zero bits of the quotient are skipped at once
+
+static
+uint64_t fgen_frac64(uint64_t num, uint64_t den)
+{
+    uint64_t q = 0;
+    int      skip;
+
+    if (num >= den) {
+        return UINT64_MAX;
+    }
+    if (num == 0) {
+        return 0;
+    }
+    skip = __builtin_clzll(num) - __builtin_clzll(den);
+    skip = (skip > 0) ? skip - 1 : 0;
+    num <<= skip;
+    for (int i = skip; i < 64; i++) {
+        num <<= 1;
+        q   <<= 1;
+        if (num >= den) {
+            num -= den;
+            q   |= 1;
+        }
+    }
+    return q;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Relative frequency error of (p, N), |p * N * tden - tnum| / tnum, and
+// relative duty cycle error of N split as NH, |NH * dden - N * dnum| / (N * dnum),
+// both as 64 bit binary fractions
+
+static inline
+uint64_t fgen_freq_err(const fgen_target_t* target, uint32_t p, uint64_t N)
+{
+    uint64_t MT = p * N;
+
+    if (MT > UINT64_MAX / target->tden) {
+        return UINT64_MAX;
+    }
+    MT *= target->tden;
+    return fgen_frac64((MT > target->tnum) ? MT - target->tnum : target->tnum - MT, target->tnum);
+}
+
+static inline
+uint64_t fgen_duty_err(const fgen_target_t* target, uint64_t N, uint64_t NH)
+{
+    uint64_t high = NH * target->dden;
+    uint64_t want = N * target->dnum;
+
+    return fgen_frac64((high > want) ? high - want : want - high, want);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Lowest weighted frequency and duty cycle error, computed in integers on
+// the exact target ratios. For every prescaler, N is scanned both ways
+// from the period until the frequency error alone costs more than the best
+// solution so far, FGEN_JOINT_MAX candidates at most in all. Among equal
+// costs, the highest prescaler is kept as it yields the shortest item
+// sequence, then the lowest N.
+
+static
+esp_err_t fgen_joint(const fgen_target_t* target, const fgen_sieve_t* sieve, fgen_info_t* fgen)
+{
+    fgen_u128_t best = { UINT64_MAX, UINT64_MAX }, fcost, cost;
+    uint32_t    budget = FGEN_JOINT_MAX;
+    uint32_t    best_p = 0, best_N = 0, NH, NL;
+    uint64_t    N0, N;
+    int         dir, c;
+
+    FGEN_CHECK(target->tnum >= 2 * target->tden, "Fout above half the APB clock", ESP_ERR_INVALID_ARG);
+
+    for (uint32_t p = 1; p <= FGEN_MAX_PRESCALER && budget > 0; p++) {
+        N0 = target->tnum / target->tden / p;
+        for (dir = -1; dir <= 1; dir += 2) {
+            for (uint32_t k = 0; k < FGEN_JOINT_SCAN && budget > 0; k++) {
+                if (dir < 0 && k > N0) {
+                    break;
+                }
+                N = (dir > 0) ? N0 + 1 + k : N0 - k;
+                if (N > FGEN_MAX_N || (dir < 0 && N < 2)) {
+                    break;
+                }
+                if (N < 2) {
+                    continue;
+                }
+                budget -= 1;
+                fcost = fgen_mul_u128(fgen_freq_err(target, p, N), target->freq_weight);
+                if (fgen_cmp_u128(fcost, best) > 0) {
+                    break;
+                }
+                if (!fgen_split_duty(target, N, &NH, &NL)) {
+                    continue;
+                }
+                cost = fgen_add_u128(fcost, fgen_mul_u128(fgen_duty_err(target, N, NH), target->duty_weight));
+                c    = fgen_cmp_u128(cost, best);
+                if (c < 0 || (c == 0 && (p > best_p || N < best_N))) {
+                    best   = cost;
+                    best_p = p;
+                    best_N = N;
+                }
+            }
+        }
+    }
+    if (best_p == 0) {
+        // Let fgen_find_freq() tell what is wrong
+        return fgen_find_freq(target, sieve, fgen);
+    }
+    fgen->prescaler = best_p;
+    fgen->N         = best_N;
+    fgen_split_duty(target, fgen->N, &fgen->NH, &fgen->NL);
+    ESP_LOGD(FGEN_TAG,"Weighted %u:%u search => %d x %d (%d high + %d low)", target->freq_weight, target->duty_weight, fgen->prescaler, fgen->N, fgen->NH, fgen->NL);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Best (prescaler, N) for the target objective within its error tolerance
+
+static
+esp_err_t fgen_optimize(const fgen_target_t* target, const fgen_sieve_t* sieve, fgen_info_t* fgen)
+{
+    fgen_best_ctx_t ctx = { .objective = target->objective, .found = false };
+    esp_err_t ret;
+
+    if (target->objective == FGEN_OBJ_ERROR) {
+        return (target->duty_weight) ? fgen_joint(target, sieve, fgen) : fgen_find_freq(target, sieve, fgen);
+    }
+    ret = fgen_search(target, sieve, fgen_visit_best, &ctx);
+    if (ret != ESP_OK || !ctx.found) {
+        // Let fgen_find_freq() tell what is wrong
+        return fgen_find_freq(target, sieve, fgen);
+    }
+    fgen->prescaler = ctx.best.prescaler;
+    fgen->N         = ctx.best.N;
+    fgen_split_duty(target, fgen->N, &fgen->NH, &fgen->NL);
+    ESP_LOGD(FGEN_TAG,"Objective %d within %u ppm => %d x %d", target->objective, target->tol_ppm, fgen->prescaler, fgen->N);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Best approximation j/K of F/2^32 (F < 2^32) with K <= kmax, taken from
+// the continued fraction convergents of F/2^32 and their last semiconvergent
+
+static
+void fgen_best_fraction(uint64_t F, uint32_t kmax, uint32_t* j, uint32_t* K)
+{
+    uint64_t num = F, den = 1ULL << 32;
+    uint64_t h0 = 0, k0 = 1, h1 = 1, k1 = 0;
+    uint64_t a, h2, k2, t, e1, e2;
+
+    while (den != 0) {
+        a  = num / den;
+        k2 = a * k1 + k0;
+        if (k2 > kmax) {
+            break;
+        }
+        h2 = a * h1 + h0;
+        h0 = h1; k0 = k1;
+        h1 = h2; k1 = k2;
+        t   = num - a * den;
+        num = den;
+        den = t;
+    }
+    *j = h1;
+    *K = k1;
+    if (den != 0 && k1 > 0 && (t = (kmax - k0) / k1) > 0) {
+        h2 = h0 + t * h1;
+        k2 = k0 + t * k1;
+        e1 = (k1 * F > (h1 << 32)) ? k1 * F - (h1 << 32) : (h1 << 32) - k1 * F;
+        e2 = (k2 * F > (h2 << 32)) ? k2 * F - (h2 << 32) : (h2 << 32) - k2 * F;
+        if (e2 * k1 < e1 * k2) {
+            *j = h2;
+            *K = k2;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fractional-N: the nrep periods held in RMT RAM last either N or N+1 ticks,
+// nlong of them being the longer ones, so that the average period gets
+// within a fraction of a tick of the target one. The ratio nlong/nrep is the
+// best fraction whose periods fit in the blocks the integer solution needs.
+// Every prescaler is tried, as a lower one gives both a finer tick and
+// longer item sequences.
+
+static
+void fgen_fractional(const fgen_target_t* target, fgen_info_t* fgen)
+{
+    uint8_t  budget = fgen_blocks(target, fgen->N);
+    uint64_t unit   = (target->tnum / target->tden) * 4295 / 1000 + 1;   // ~1 ppb of the period, in 1/2^32 ticks
+    uint64_t s, r, N, F, e, best_e = 0;
+    uint32_t NH, NL, j, K, kmax, c;
+    uint32_t best_p = 0, best_N = 0, best_j = 0, best_K = 1, best_kmax = 1;
+    int      sh;
+
+    for (uint32_t p = 1; p <= FGEN_MAX_PRESCALER; p++) {
+        s = p * target->tden;
+        N = target->tnum / s;
+        r = target->tnum - N * s;
+        if (N < 2 || N >= FGEN_MAX_N || !fgen_split_duty(target, N, &NH, &NL)) {
+            continue;
+        }
+        c    = fgen_count_items(NH, NL + 1);
+        kmax = min(budget * 63 / c, 62);
+        if (kmax == 0) {
+            continue;
+        }
+        // Fractional part of the period in 1/2^32 ticks
+        for (sh = 0; (s >> sh) >= (1ULL << 32); sh++);
+        F = ((r >> sh) << 32) / (s >> sh);
+        fgen_best_fraction(F, kmax, &j, &K);
+        // Average period error in 1/2^32 APB ticks is p * e / K, compared
+        // in ppb steps. Ties go to the lowest prescaler, whose finer tick
+        // gives the lowest phase error
+        e = (K * F > ((uint64_t) j << 32)) ? K * F - ((uint64_t) j << 32) : ((uint64_t) j << 32) - K * F;
+        e = p * e / K / unit;
+        if (best_p == 0 || e < best_e) {
+            best_p = p; best_N = N; best_j = j; best_K = K; best_e = e; best_kmax = kmax;
+        }
+    }
+    if (best_p == 0) {
+        return;
+    }
+
+    fgen->prescaler = best_p;
+    fgen->N         = best_N;
+    if (best_j == best_K) {
+        fgen->N += 1;
+        best_j   = 0;
+    }
+    fgen_split_duty(target, fgen->N, &fgen->NH, &fgen->NL);
+    if (best_j != 0) {
+        // Repeat the K periods pattern as much as it fits
+        fgen->nrep  = best_K * (best_kmax / best_K);
+        fgen->nlong = best_j * (best_kmax / best_K);
+    }
+    ESP_LOGD(FGEN_TAG,"Fractional period => %d x (%d + %d/%d)", fgen->prescaler, fgen->N, best_j, best_K);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+bool fgen_cache_lookup(const fgen_target_t* target, fgen_info_t* info)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&FGEN_CACHE_LOCK);
+    for (size_t i = 0; i < FGEN_CACHE_SIZE && !found; i++) {
+        if (FGEN_CACHE[i].stamp && memcmp(&FGEN_CACHE[i].key, target, sizeof(fgen_target_t)) == 0) {
+            FGEN_CACHE[i].stamp = ++FGEN_CACHE_CLOCK;
+            *info = FGEN_CACHE[i].info;
+            found = true;
+        }
+    }
+    FGEN_CACHE_STATS.hits   += found;
+    FGEN_CACHE_STATS.misses += !found;
+    portEXIT_CRITICAL(&FGEN_CACHE_LOCK);
+    return found;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_cache_insert(const fgen_target_t* target, const fgen_info_t* info)
+{
+    size_t victim = 0;
+
+    // Take an empty entry if any, otherwise the least recently used one
+    portENTER_CRITICAL(&FGEN_CACHE_LOCK);
+    for (size_t i = 0; i < FGEN_CACHE_SIZE; i++) {
+        if (FGEN_CACHE[i].stamp < FGEN_CACHE[victim].stamp) {
+            victim = i;
+        }
+    }
+    if (FGEN_CACHE[victim].stamp) {
+        FGEN_CACHE_STATS.evictions += 1;
+    } else {
+        FGEN_CACHE_STATS.entries += 1;
+    }
+    FGEN_CACHE[victim].key   = *target;
+    FGEN_CACHE[victim].info  = *info;
+    FGEN_CACHE[victim].stamp = ++FGEN_CACHE_CLOCK;
+    portEXIT_CRITICAL(&FGEN_CACHE_LOCK);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static 
+void fgen_print_items(const rmt_item32_t* p, uint32_t N)
+{
+    ESP_LOGD(FGEN_TAG,"Displaying %d items + EoTx", N-1);
+
+#if CONFIG_LOG_DEFAULT_LEVEL == ESP_LOG_VERBOSE
+    const uint32_t NN = 8;
+    uint32_t rows = N / NN;
+    uint32_t rem  = N % NN;
+    uint32_t row, offset, i, j;  
+    ESP_LOGV(FGEN_TAG,"%d complete rows with %d items each and %d more items in the last row", rows, NN, rem);
+    printf("-------------------------------------------------------------------\n");
+    for (row = 0; row < rows; row++) {
+        for (i=0; i<NN; i++) {
+            offset = NN*row+i;
+            printf("{{{%d,%d,%d,%d}}},\t", p[offset].duration0, p[offset].level0, p[offset].duration1, p[offset].level1);
+        }
+        printf("\n");
+    }
+    for (j=0; j<rem; j++) {
+        offset = NN*rows+j;
+        printf("{{{%d,%d,%d,%d}}},\t", p[offset].duration0, p[offset].level0, p[offset].duration1, p[offset].level1);
+    }
+    if (rem) printf("\n");
+    printf("-------------------------------------------------------------------\n");
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Relative error num/den in parts per million, without overflowing 64 bits
+
+static
+int32_t fgen_ppm(int64_t num, uint64_t den)
+{
+    uint64_t a = (num < 0) ? -num : num;
+    uint64_t q;
+
+    if (a < (1ULL << 43)) {
+        q = (a * 1000000 + den/2) / den;
+    } else {
+        q = a / ((den + 500000) / 1000000);
+    }
+    return (num < 0) ? -(int32_t)q : (int32_t)q;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Frequency of the clock counted by the RMT items
+
+static inline
+uint64_t fgen_clock_hz(const fgen_info_t* fgen)
+{
+    return (fgen->encoding == FGEN_ENC_REF_TICK) ? FGEN_REF_HZ : FGEN_APB_HZ;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The target period is given in ticks of the chosen encoding clock
+
+static 
+void fgen_log_params(const fgen_target_t* target, fgen_info_t* fgen)
+{
+    uint64_t clock = fgen_clock_hz(fgen);
+    uint64_t M = (uint64_t) fgen->prescaler * fgen->N;
+    uint64_t L = (uint64_t) fgen->N * fgen->nrep + fgen->nlong;   // ticks in the whole loop
+    int32_t  ErrFreq, Errduty_cycle;
+    uint32_t duty_ppm;
+
+    // Recompute the Fout frequency with all that rounding taking place
+    // and check the relative  error
+    duty_ppm         = (target->dnum * 1000000 + target->dden/2) / target->dden;
+    if (fgen->nlong == 0) {
+        fgen->freq_mhz   = (clock * 1000 + M/2) / M;
+        fgen->duty_ppm   = ((uint64_t) fgen->NH * 1000000 + fgen->N/2) / fgen->N;
+        ErrFreq          = fgen_ppm((int64_t)(target->tnum - M * target->tden), M * target->tden);
+        Errduty_cycle    = fgen_ppm((int64_t)((uint64_t) fgen->NH * target->dden - fgen->N * target->dnum), fgen->N * target->dnum);
+    } else {
+        // Averaged over the loop. The error is only displayed, so the
+        // 64 bit overflow of the exact computation is avoided with doubles
+        M                = fgen->prescaler * L;
+        fgen->freq_mhz   = (clock * 1000 * fgen->nrep + M/2) / M;
+        fgen->duty_ppm   = ((uint64_t) fgen->NH * fgen->nrep * 1000000 + L/2) / L;
+        ErrFreq          = lround(((double) target->tnum / target->tden * fgen->nrep / M - 1.0) * 1e6);
+        Errduty_cycle    = fgen_ppm((int64_t)((uint64_t) fgen->NH * fgen->nrep * target->dden - L * target->dnum), L * target->dnum);
+    }
+    fgen->freq_err   = ErrFreq;
+    fgen->duty_err   = Errduty_cycle;
+
+    ESP_LOGD(FGEN_TAG,"Ref Clock = %llu Hz, Prescaler = %d, RMT Clock = %llu Hz", clock, fgen->prescaler, clock / fgen->prescaler);    
+    ESP_LOGD(FGEN_TAG,"Ntot = %d, Nhigh = %d, Nlow = %d", fgen->N, fgen->NH, fgen->NL);
+    ESP_LOGD(FGEN_TAG,"Fout => %llu mHz (%d ppm), Duty Cycle = %u ppm => %u ppm (%d ppm)", fgen->freq_mhz, ErrFreq, duty_ppm, fgen->duty_ppm, Errduty_cycle);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Items of the nrep periods loop, without EoTx nor idle tick compensation
+
+static inline
+size_t fgen_loop_items(const fgen_info_t* info)
+{
+    return (info->nrep - info->nlong) * info->onitems + info->nlong * fgen_count_items(info->NH, info->NL + 1);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The idle tick at every loop is taken out of the low level of the last
+// period, which can only make its items fewer. A single low tick is kept.
+// Loops too large for RMT RAM (nrep 0) are streamed, see fgen_solve()
+
+static
+void fgen_compensate(fgen_info_t* info, bool compensate)
+{
+    uint32_t NL;
+
+    NL = (info->nrep > 0) ? info->NL + fgen_long_period(info->nrep - 1, info->nrep, info->nlong) : 0;
+    info->compensated = compensate && !info->streaming && NL > 1;
+    if (info->compensated) {
+        info->nitems -= fgen_count_items(info->NH, NL) - fgen_count_items(info->NH, NL - 1);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// RMT item halves needed by a single level run
+
+static inline
+uint32_t fgen_level_halves(uint32_t ticks)
+{
+    return (ticks + FGEN_ITEM_TICKS - 1) / FGEN_ITEM_TICKS;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills a single level run in as many halves, continuing the item at cur
+// if its first half is already taken. Items are stored whole, as in
+// fgen_fill_runs()
+
+static
+rmt_item32_t* fgen_fill_level(rmt_item32_t* item, rmt_item32_t* cur, bool* second, uint32_t level, uint32_t ticks, uint32_t halves)
+{
+    uint32_t d;
+
+    for (uint32_t m = halves; m > 0; m--) {
+        // leaving at least one tick for each half to come
+        d      = min(ticks - (m - 1), FGEN_ITEM_TICKS);
+        ticks -= d;
+        if (*second) {
+            cur->duration1 = d; cur->level1 = level;
+            *item++ = *cur;
+        } else {
+            cur->duration0 = d; cur->level0 = level;
+        }
+        *second = !*second;
+    }
+    return item;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// A loop started phase_ticks late is the same loop rotated: the end of its
+// last period, idle tick included, comes first. Cut in its low level, the
+// loop begins with a low run, the lead, and ends with the rest of that
+// period, the trail. Cut in its high level, the lead is the end of that
+// period and the trail a high run. The idle tick is taken out of the
+// trail, the loop idle level being the one of the run it ends.
+
+static
+void fgen_phase_plan(const fgen_info_t* info, fgen_phase_plan_t* plan)
+{
+    uint32_t NL = info->NL + fgen_long_period(info->nrep - 1, info->nrep, info->nlong) - info->compensated + 1;
+    uint32_t d  = info->phase_ticks;
+
+    plan->high = d >= NL;
+    if (plan->high) {
+        plan->run = info->NH + NL - d - 1;
+        plan->NH  = d - NL;     // no high level at all if cut at the rising edge
+        plan->NL  = NL;
+    } else {
+        plan->run = d;
+        plan->NH  = info->NH;
+        plan->NL  = NL - d - 1;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Halves of the lead of a phased loop, see fgen_phase_plan(). The loop
+// goes on only if they make whole items, so its low run takes one more
+// half if needed, having at least two ticks
+
+static
+void fgen_phase_lead(const fgen_phase_plan_t* plan, uint32_t* high, uint32_t* low)
+{
+    *high = (plan->high) ? fgen_level_halves(plan->NH) : 0;
+    *low  = fgen_level_halves((plan->high) ? plan->NL : plan->run);
+    *low += (*high + *low) % 2;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Items a phased loop takes in place of its last period, fewer or more
+
+static
+int32_t fgen_phase_items(const fgen_info_t* info)
+{
+    fgen_phase_plan_t plan;
+    uint32_t          NL, high, low, trail;
+
+    if (info->phase_ticks == 0) {
+        return 0;
+    }
+    fgen_phase_plan(info, &plan);
+    fgen_phase_lead(&plan, &high, &low);
+    NL    = info->NL + fgen_long_period(info->nrep - 1, info->nrep, info->nlong) - info->compensated;
+    trail = (plan.high) ? (fgen_level_halves(plan.run) + 1) / 2 : fgen_count_items(plan.NH, plan.NL);
+    return (int32_t) ((high + low) / 2 + trail) - fgen_count_items(info->NH, NL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills the lead of a phased loop
+
+static
+rmt_item32_t* fgen_fill_lead(rmt_item32_t* item, const fgen_phase_plan_t* plan)
+{
+    rmt_item32_t cur = {{{ 0 }}};
+    bool         second = false;
+    uint32_t     high, low;
+
+    fgen_phase_lead(plan, &high, &low);
+    item = fgen_fill_level(item, &cur, &second, 1, plan->NH, high);
+    return fgen_fill_level(item, &cur, &second, 0, (plan->high) ? plan->NL : plan->run, low);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills the trail of a phased loop, in place of its last period. A high
+// one ends the loop, with a zero second half if it has an odd one
+
+static
+rmt_item32_t* fgen_fill_trail(rmt_item32_t* item, const fgen_phase_plan_t* plan)
+{
+    rmt_item32_t cur = {{{ 0 }}};
+    bool         second = false;
+
+    if (!plan->high) {
+        return fgen_fill_items(item, plan->NH, plan->NL);
+    }
+    item = fgen_fill_level(item, &cur, &second, 1, plan->run, fgen_level_halves(plan->run));
+    if (second) {
+        cur.duration1 = 0; cur.level1 = 1;
+        *item++ = cur;
+    }
+    return item;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Loop start delay, the period being N ticks on average. A single tick
+// run cannot make an item of its own, so a one tick delay becomes two.
+// Loops repeating a short period lose repetitions if needed to fit.
+
+static
+void fgen_phase(const fgen_target_t* target, fgen_info_t* info)
+{
+    double N = info->N + info->nlong / (double) info->nrep;
+
+    info->phase_res   = 360.0 / N;
+    // a whole period, or nearly so, being no delay at all
+    info->phase_ticks = (info->streaming) ? 0 : llround(target->phase_mdeg / 360000.0 * N);
+    info->phase_ticks = (info->phase_ticks >= info->N) ? 0 : info->phase_ticks;
+    info->phase_ticks = (info->phase_ticks == 1) ? 2 % info->N : info->phase_ticks;
+    info->phase       = info->phase_ticks * info->phase_res;
+    if (info->phase_ticks == 0) {
+        return;
+    }
+    info->nitems += fgen_phase_items(info);
+    while (info->nlong == 0 && info->nrep > 1 && (info->nitems - 1 + 62) / 63 > info->mem_blocks) {
+        info->nrep  -= 1;
+        info->nitems = info->onitems * info->nrep + 1;
+        fgen_compensate(info, info->compensated);
+        info->nitems += fgen_phase_items(info);
+    }
+    if ((info->nitems - 1 + 62) / 63 > info->mem_blocks) {
+        info->mem_blocks = (info->nitems - 1 + 62) / 63;
+    }
+    ESP_LOGD(FGEN_TAG,"Loop started %u ticks late => %0.3f deg", info->phase_ticks, info->phase);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Long run frequency, loop idle tick included
+
+static inline
+double fgen_loop_freq(const fgen_info_t* info)
+{
+    uint64_t L = (uint64_t) info->N * info->nrep + info->nlong + !(info->streaming || info->compensated);
+
+    return fgen_clock_hz(info) * info->nrep / ((double) info->prescaler * L);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Repeats the loop of a solved layout as many times as mem_blocks hold,
+// so that it wraps around that many times less often. Fractional loops
+// are repeated whole, keeping their ratio of long periods. Average
+// frequency and duty cycle stay the same, only the loop figures change.
+// Returns false if no more repetitions fit.
+
+static
+bool fgen_spread(fgen_info_t* info, size_t mem_blocks)
+{
+    fgen_info_t old = *info;
+    double      freq;
+    uint32_t    m, nrep;
+
+    if (info->streaming || mem_blocks <= info->mem_blocks) {
+        return false;
+    }
+    m    = (mem_blocks * 63) / fgen_loop_items(info);
+    nrep = (info->nlong == 0) ? (mem_blocks * 63) / info->onitems : m * info->nrep;
+    if (nrep <= info->nrep) {
+        return false;
+    }
+
+    // Requested frequency, the target being no longer at hand
+    freq = info->loop_freq / (1.0 + info->loop_err * 1e-6);
+
+    info->nlong      = m * info->nlong;
+    info->nrep       = nrep;
+    info->nitems     = fgen_loop_items(info) + 1;
+    fgen_compensate(info, info->compensated);
+    info->nitems    += fgen_phase_items(info);
+    info->mem_blocks = (info->nitems - 1 + 62) / 63;
+    if (info->mem_blocks > mem_blocks) {
+        // a phased loop end taking more items than the period it replaces
+        *info = old;
+        return false;
+    }
+    info->loop_freq  = fgen_loop_freq(info);
+    info->loop_err   = lround((info->loop_freq / freq - 1.0) * 1e6);
+    ESP_LOGD(FGEN_TAG,"Spread over %d blocks => %d periods per loop", info->mem_blocks, info->nrep);
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The RMT ends a transmission at the first zero duration, which is what
+// closes a period whose tail item has a single half. A stream must never
+// end, so such a tail is split in two, borrowing one tick from the item
+// before if it has only one.
+
+static
+void fgen_stream_tail(rmt_item32_t* first, rmt_item32_t* end)
+{
+    rmt_item32_t* last = end - 1;
+    rmt_item32_t* prev = end - 2;
+
+    if (last->duration1 != 0 || last == first) {
+        return;
+    }
+    last->level1 = last->level0;
+    if (last->duration0 > 1) {
+        last->duration1  = last->duration0 / 2;
+        last->duration0 -= last->duration1;
+        return;
+    }
+    last->duration1 = 1;
+    last->level0    = prev->level1;
+    if (prev->duration1 > 1) {
+        prev->duration1--;
+    } else {
+        prev->duration0--;      // a full high item, both halves alike
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Writes the next FGEN_STREAM_HALF pattern items into one half of the RMT block
+
+static IRAM_ATTR
+void fgen_stream_copy(fgen_stream_t* stream, uint32_t half)
+{
+    extern rmt_mem_t RMTMEM;
+    volatile rmt_item32_t* mem = &RMTMEM.chan[stream->channel].data32[half * FGEN_STREAM_HALF];
+
+    for (uint32_t i = 0; i < FGEN_STREAM_HALF; i++) {
+        mem[i].val   = stream->items[stream->next].val;
+        stream->next = (stream->next + 1 < stream->nitems) ? stream->next + 1 : 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Refills, for every streamed channel, the half of its block that is not
+// being read, once per pass of the reader. The read address is looked at
+// rather than the TX threshold events, as the RMT driver ISR sharing the
+// interrupt clears the events of the channels it does not own.
+
+static IRAM_ATTR
+void fgen_stream_isr(void* arg)
+{
+    fgen_stream_t* stream;
+    uint32_t       start;
+
+    portENTER_CRITICAL_ISR(&FGEN_STREAM_LOCK);
+    for (int ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+        stream = FGEN_STREAMS[ch];
+        if (stream == NULL) {
+            continue;
+        }
+        RMT.int_clr.val = FGEN_TX_THR_INT(ch);
+        if (FGEN_TX_RADDR(ch) / FGEN_STREAM_HALF != stream->half) {
+            start = XTHAL_GET_CCOUNT();
+            fgen_stream_copy(stream, stream->half);
+            stream->half   ^= 1;
+            stream->refills++;
+            stream->cycles += XTHAL_GET_CCOUNT() - start;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&FGEN_STREAM_LOCK);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t fgen_stream_start(fgen_resources_t* res)
+{
+    fgen_stream_t* stream = res->stream;
+    esp_err_t      ret;
+
+    // Both halves are filled before starting, the ISR takes over from then on
+    stream->next    = 0;
+    stream->half    = 0;
+    stream->refills = 0;
+    stream->cycles  = 0;
+    fgen_stream_copy(stream, 0);
+    fgen_stream_copy(stream, 1);
+
+    // The wraparound bit is shared by all the RMT channels, so it is only
+    // kept set while there are streams, and put back as it was afterwards
+    if (FGEN_STREAM_INTR == NULL) {
+        ret = esp_intr_alloc(ETS_RMT_INTR_SOURCE, DEFAULT_ALLOC_FLAGS, fgen_stream_isr, NULL, &FGEN_STREAM_INTR);
+        FGEN_CHECK(ret == ESP_OK, "Error allocating RMT streaming interrupt",  ret);
+        FGEN_STREAM_WRAP = RMT.apb_conf.mem_tx_wrap_en;
+    }
+    RMT.apb_conf.mem_tx_wrap_en = 1;    // go on reading from the block start
+
+    portENTER_CRITICAL(&FGEN_STREAM_LOCK);
+    FGEN_STREAMS[res->channel] = stream;
+    portEXIT_CRITICAL(&FGEN_STREAM_LOCK);
+    stream->started = esp_timer_get_time();
+    stream->stopped = 0;
+
+    ret = rmt_set_tx_thr_intr_en(res->channel, true, FGEN_STREAM_HALF);
+    FGEN_CHECK(ret == ESP_OK, "Error enabling RMT Tx threshold interrupt",  ret);
+    return rmt_tx_start(res->channel, true);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The refills must end before rmt_tx_stop() writes its EoTx into the block
+
+static
+void fgen_stream_stop(fgen_resources_t* res)
+{
+    bool idle = true;
+
+    rmt_set_tx_thr_intr_en(res->channel, false, FGEN_STREAM_HALF);
+    portENTER_CRITICAL(&FGEN_STREAM_LOCK);
+    FGEN_STREAMS[res->channel] = NULL;
+    for (int ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+        idle = idle && (FGEN_STREAMS[ch] == NULL);
+    }
+    portEXIT_CRITICAL(&FGEN_STREAM_LOCK);
+
+    if (res->stream->started != 0 && res->stream->stopped == 0) {
+        res->stream->stopped = esp_timer_get_time();
+    }
+    if (idle && FGEN_STREAM_INTR != NULL) {
+        esp_intr_free(FGEN_STREAM_INTR);
+        FGEN_STREAM_INTR = NULL;
+        RMT.apb_conf.mem_tx_wrap_en = FGEN_STREAM_WRAP;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+
+static
+void fgen_waveform_fill(const fgen_resources_t* res, rmt_item32_t* items)
+{
+    // Generate the pattern and repeat it as much as we can within a 64 -item block
+    rmt_item32_t* p = items;
+    rmt_item32_t* period;
+    fgen_phase_plan_t plan;
+
+    // A phased loop starts with the end of its last period
+    if (res->info.phase_ticks != 0) {
+        fgen_phase_plan(&res->info, &plan);
+        p = fgen_fill_lead(p, &plan);
+    }
     for(int i = 0 ; i<res->info.nrep; i++) {
-        p = fgen_fill_items(p, res->info.NH, res->info.NL);
+        if (res->pattern != NULL) {
+            p = fgen_fill_runs(p, res->pattern, res->info.compensated && i == res->info.nrep - 1);
+            continue;
+        }
+        if (res->info.phase_ticks != 0 && i == res->info.nrep - 1) {
+            p = fgen_fill_trail(p, &plan);
+            continue;
+        }
+        period = p;
+        p = fgen_fill_items(p, res->info.NH, res->info.NL + fgen_long_period(i, res->info.nrep, res->info.nlong)
+                                             - (res->info.compensated && i == res->info.nrep - 1));
+        if (res->info.streaming) {
+            fgen_stream_tail(period, p);
+        }
+    }
+    if (!res->info.streaming) {
+        p->val = 0; // mark end of sequence
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// A compensated last period ends in the idle tick, so it must be low, or
+// for patterns, at the level of their last run. A phased loop ends in it
+// too, low or high as the run it was cut in, see fgen_phase_plan()
+
+static
+rmt_idle_level_t fgen_idle_level(const fgen_resources_t* res)
+{
+    fgen_phase_plan_t plan;
+
+    if (res->pattern != NULL) {
+        return (res->pattern->runs[res->pattern->nruns - 1].level) ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW;
+    }
+    if (res->info.phase_ticks == 0) {
+        return RMT_IDLE_LEVEL_LOW;
+    }
+    fgen_phase_plan(&res->info, &plan);
+    return (plan.high) ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_waveform(fgen_resources_t* res)
+{
+    fgen_waveform_fill(res, res->items);
+    fgen_print_items(res->items, res->info.nitems);
+
+    // Items written straight into RMT RAM are left stopped, as rmt_tx_stop()
+    // leaves them, their first one being kept for fgen_start() to put back
+    if (res->info.zero_copy) {
+        res->head          = res->items[0];
+        res->items[0].val  = 0;
+    }
+}
+/* -------------------------------------------------------------------------- */
+
+// A generator spread over spare blocks goes back to its solved layout
+// and hands them back. If running, it is restarted, glitching its output.
+
+static
+esp_err_t fgen_give_back(fgen_resources_t* res)
+{
+    bool      busy = fgen_get_state(res) == RMT_CHANNEL_BUSY;
+    esp_err_t ret;
+
+    // Its burst was planned on the loop it has
+    FGEN_CHECK(res->burst == NULL || !res->burst->running, "Bursting generators keep their blocks", ESP_ERR_INVALID_STATE);
+    ESP_LOGW(FGEN_TAG,"RMT channel %d gives %d spare blocks back", res->channel, res->info.mem_blocks - res->solved.mem_blocks);
+    ret = rmt_tx_stop(res->channel);
+    FGEN_CHECK(ret == ESP_OK, "Error stopping RMT Tx",  ret);
+
+    // The shorter loop fits in the items array or the remaining blocks
+    res->info = res->solved;
+    fgen_waveform(res);
+    fgen_channel_shrink(res->channel, res->info.mem_blocks);
+    FREQ_CHANNEL[res->channel].spread = NULL;
+
+    ret = rmt_set_mem_block_num(res->channel, res->info.mem_blocks);
+    FGEN_CHECK(ret == ESP_OK, "Error setting RMT memory blocks",  ret);
+    return (busy) ? fgen_start(res) : ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Configures the RMT channel taken by a generator, with its items
+// either in RMT RAM or in its slot. Also used when it is moved
+
+static
+esp_err_t fgen_configure(fgen_resources_t* res)
+{
+    extern rmt_mem_t RMTMEM;
+    esp_err_t ret;
+
+    // Zero-copy items are the channel blocks themselves, contiguous in RMT RAM.
+    // Streams of periods longer than the whole RMT RAM are the only ones in heap
+    if (res->info.zero_copy) {
+        res->items  = (rmt_item32_t*) &RMTMEM.chan[res->channel].data32[0];
+    } else if (res->info.nitems <= FGEN_SLOT_ITEMS) {
+        res->items  = fgen_slot_of(res)->items;
+    } else if (res->items == NULL) {
+        res->items  = (rmt_item32_t*) calloc(res->info.nitems, sizeof(rmt_item32_t));
+        FGEN_CHECK(res->items != NULL, "Out of memory allocating RMT items",  ESP_ERR_NO_MEM);
+    }
+
+    // Configure and load the RMT driver
+    rmt_config_t config = {
+        // Common config
+        .channel              = res->channel,
+        .rmt_mode             = RMT_MODE_TX,
+        .gpio_num             = res->gpio_num,
+        .mem_block_num        = res->info.mem_blocks,
+        .clk_div              = res->info.prescaler,
+        // Tx only config
+        .tx_config.loop_en    = !res->info.streaming,
+        .tx_config.carrier_en = false,
+        // Loops ending in the idle tick output it, see fgen_idle_level()
+        .tx_config.idle_output_en = res->info.compensated || res->info.phase_ticks != 0,
+        .tx_config.idle_level     = fgen_idle_level(res)
+    };
+
+    ret = rmt_config(&config);
+    FGEN_CHECK(ret == ESP_OK, "Error configure RMT module",  ret);
+
+    // rmt_config() always selects the APB clock
+    if (res->info.encoding == FGEN_ENC_REF_TICK) {
+        ret = rmt_set_source_clk(res->channel, RMT_BASECLK_REF);
+        FGEN_CHECK(ret == ESP_OK, "Error selecting RMT REF_TICK clock",  ret);
+    }
+
+    // Generate the pattern and repeat it as much as we can within a 64 -item block.
+    // Once configured, as RMT RAM can only be written with the module enabled
+    fgen_waveform(res);
+
+    // The RMT driver ISR would end the stream, writing an EoTx in the block
+    // when it gets a TX threshold event, so the channel is left to ours
+    if (res->info.streaming) {
+        res->stream = &fgen_slot_of(res)->stream;
+        memset(res->stream, 0, sizeof(fgen_stream_t));
+        res->stream->items   = res->items;
+        res->stream->nitems  = res->info.nitems;
+        res->stream->channel = res->channel;
+        // Leaving the EoTx mark of a stopped channel, as looped ones do below
+        return rmt_tx_stop(res->channel);
+    }
+
+    ret = rmt_driver_install(res->channel, NO_RX_BUFFER, DEFAULT_ALLOC_FLAGS);
+    FGEN_CHECK(ret == ESP_OK, "Error installing RMT driver",  ret);
+    fgen_slot_of(res)->driver = true;
+    ESP_LOGD(FGEN_TAG, "%s: rmt_driver_install() returned ok.", __FUNCTION__ );
+
+    ret = rmt_tx_stop(res->channel);
+    FGEN_CHECK(ret == ESP_OK, "Error stopping RMT Tx",  ret);
+   
+    // This is a needed hack for Tx looping since the rmt_config does not do it.
+    ret = rmt_set_tx_intr_en(res->channel, false);
+    FGEN_CHECK(ret == ESP_OK, "Error disabling RMT Tx interrupt",  ret);
+
+    return ESP_OK;
+    
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Moves a generator to another RMT channel with room for its blocks and
+// configures it there from scratch. If running, it is restarted, its
+// output pausing meanwhile. Not while bursting, as the burst task and
+// fgen_burst_end() keep on with its items where they were.
+
+static
+esp_err_t fgen_relocate(fgen_resources_t* res, rmt_channel_t channel)
+{
+    bool              busy   = fgen_get_state(res) == RMT_CHANNEL_BUSY;
+    fgen_resources_t* spread = FREQ_CHANNEL[res->channel].spread;
+    esp_err_t         ret;
+
+    FGEN_CHECK(res->burst == NULL || !res->burst->running, "Bursting generators cannot be moved", ESP_ERR_INVALID_STATE);
+    ESP_LOGW(FGEN_TAG,"RMT channel %d moves to channel %d", res->channel, channel);
+    ret = fgen_stop(res);
+    FGEN_CHECK(ret == ESP_OK, "Error stopping RMT Tx",  ret);
+    if (fgen_slot_of(res)->driver) {
+        ret = rmt_driver_uninstall(res->channel);
+        FGEN_CHECK(ret == ESP_OK, "Error uninstalling RMT driver",  ret);
+        fgen_slot_of(res)->driver = false;
+    }
+    fgen_channel_free(res->channel);
+    fgen_channel_take(channel, res->info.mem_blocks);
+    FREQ_CHANNEL[channel].spread = spread;
+    res->channel = channel;
+    res->stream  = NULL;
+
+    ret = fgen_configure(res);
+    FGEN_CHECK(ret == ESP_OK, "Error configuring RMT channel",  ret);
+    return (busy) ? fgen_start(res) : ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Packs the generators towards channel 7, so that the free blocks end up
+// together below them. Going down from the top, each one is moved up to
+// just below those already packed, never onto a block still in use by
+// another one, and only if it is not there already.
+
+static
+esp_err_t fgen_compact()
+{
+    rmt_channel_t     top = RMT_CHANNEL_MAX;
+    fgen_resources_t* res;
+    esp_err_t         ret;
+
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        rmt_channel_t ch = RMT_CHANNEL_MAX-1-i;
+        res = fgen_slot_on(ch);
+        if (res == NULL) {
+            continue;
+        }
+        top -= res->info.mem_blocks;
+        if (top != ch) {
+            ret = fgen_relocate(res, top);
+            FGEN_CHECK(ret == ESP_OK, "Error moving RMT channel",  ret);
+        }
+    }
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Order in which a set of generators is created: most blocks first,
+// as given otherwise. An insertion sort will do for 8 of them at most
+
+static
+void fgen_plan_order(const fgen_placement_t* place, size_t n, uint8_t* order)
+{
+    size_t j;
+
+    for (size_t i = 0; i < n; i++) {
+        for (j = i; j > 0 && place[order[j-1]].info.mem_blocks < place[i].info.mem_blocks; j--) {
+            order[j] = order[j-1];
+        }
+        order[j] = i;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Places a set of generators on the channel map in the given order, as
+// fgen_allocate() would, after spread generators give their spare blocks
+// back and the others are packed as fgen_compact() does, if so asked.
+// The map is changed, so it must be saved before and restored after.
+
+static
+bool fgen_plan_place(fgen_placement_t* place, const uint8_t* order, size_t n, bool give_back, bool compact)
+{
+    size_t           blocks[RMT_CHANNEL_MAX];
+    rmt_channel_t    ch, top = RMT_CHANNEL_MAX;
+    fgen_placement_t* p;
+
+    for (ch = 0; give_back && ch < RMT_CHANNEL_MAX; ch++) {
+        if (FREQ_CHANNEL[ch].spread != NULL) {
+            fgen_channel_shrink(ch, FREQ_CHANNEL[ch].spread->solved.mem_blocks);
+        }
+    }
+    if (compact) {
+        for (ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+            blocks[ch] = (FREQ_CHANNEL[ch].state == FGEN_CHANNEL_USED) ? FREQ_CHANNEL[ch].mem_blocks : 0;
+        }
+        for (ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+            fgen_channel_free(ch);
+        }
+        for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+            ch = RMT_CHANNEL_MAX-1-i;
+            if (blocks[ch] > 0) {
+                top -= blocks[ch];
+                fgen_channel_take(top, blocks[ch]);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < n; k++) {
+        p = &place[order[k]];
+        p->channel = fgen_channel_find(p->info.mem_blocks, false);
+        if (p->channel == -1) {
+            return false;
+        }
+        fgen_channel_take(p->channel, p->info.mem_blocks);
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t fgen_allocate(const fgen_info_t* info, gpio_num_t gpio_num, fgen_resources_t* res)
+{
+    bool      roomy = info->min_wrap && !info->streaming;
+
+    res->info   = *info;      // copy structure
+    res->solved = *info;
+   
+    // Allocate a free GPIO pin
+    res->gpio_num   = fgen_gpio_alloc(gpio_num);
+    FGEN_CHECK(res->gpio_num != GPIO_NUM_NC, "No Free or usable GPIO",  ESP_ERR_NO_MEM);
+
+    // Allocate a free RMT channel, taking spare blocks back if needed
+    res->channel = fgen_channel_find(res->info.mem_blocks, roomy);
+    for (rmt_channel_t ch = 0; res->channel == -1 && ch < RMT_CHANNEL_MAX; ch++) {
+        if (FREQ_CHANNEL[ch].spread != NULL) {
+            fgen_give_back(FREQ_CHANNEL[ch].spread);
+            res->channel = fgen_channel_find(res->info.mem_blocks, roomy);
+        }
+    }
+
+    // Or else moving the others, if the free blocks are enough but scattered
+    if (res->channel == -1 && fgen_free_blocks() >= res->info.mem_blocks && fgen_compact() == ESP_OK) {
+        res->channel = fgen_channel_find(res->info.mem_blocks, roomy);
+    }
+    FGEN_CHECK(res->channel != -1, "No Free RMT channel",  ESP_ERR_NO_MEM);
+
+    // With fewer wraparounds if so requested and the channel has room for it
+    if (roomy && fgen_spread(&res->info, fgen_max_mem_blocks(res->channel))) {
+        FREQ_CHANNEL[res->channel].spread = res;
+    }
+    fgen_channel_take(res->channel, res->info.mem_blocks);
+    res->handle = fgen_handle_pick(res);
+
+    return fgen_configure(res);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Gives back whatever a generator holds, whether fgen_allocate()
+// got through or failed half way, and its slot last
+
+static
+void fgen_release(fgen_resources_t* res)
+{
+    fgen_slot_t* slot = fgen_slot_of(res);
+    esp_err_t    ret;
+
+    if (res->stream != NULL) {
+        fgen_stream_stop(res);
+    }
+    // Failing half way, the driver may not have been installed yet
+    if (slot->driver) {
+        ret = rmt_driver_uninstall(res->channel);
+        if (ret != ESP_OK) {
+            ESP_LOGE(FGEN_TAG,"Error uninstalling RMT driver of channel %d (%d)", res->channel, ret);
+        }
+        slot->driver = false;
+    }
+    if (res->channel != -1) {
+        fgen_channel_free(res->channel);
+    }
+    fgen_gpio_free(res->gpio_num);
+    if (res->info.nitems > FGEN_SLOT_ITEMS) {
+        free(res->items);
+    }
+    free(res->pattern);
+    slot->used = false;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Whether the items [from, to) of a running loop last at least ticks.
+// Each one read as a whole word, the RMT going through them meanwhile
+
+static
+bool fgen_ticks_over(const volatile rmt_item32_t* ram, size_t from, size_t to, uint32_t ticks)
+{
+    uint32_t sum = 0;
+    uint32_t val;
+
+    for (size_t i = from; i < to && sum < ticks; i++) {
+        val  = ram[i].val;
+        sum += (val & 0x7FFF) + ((val >> 16) & 0x7FFF);
+    }
+    return sum >= ticks;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Writes new items over a running loop at its boundary, in two parts. The
+// first one once the RMT reads the second part of the old loop, the rest
+// once it wrapped around into the first part of the new one, each with
+// time to spare before the RMT gets there. Returns false if the moment
+// did not come in time or, the RMT wrapping around twice in between, one
+// loop went out mixed. The prescaler and clock source must stay the same.
+
+static
+bool fgen_retune_chase(const fgen_resources_t* res, const fgen_info_t* old, const rmt_item32_t* items)
+{
+    extern rmt_mem_t RMTMEM;
+    volatile rmt_item32_t* ram = (volatile rmt_item32_t*) &RMTMEM.chan[res->channel].data32[0];
+    size_t   last = old->nitems - 1;                       // old EoTx
+    size_t   p    = min(res->info.nitems - 1, last) / 2;
+    double   tpus = fgen_clock_hz(old) / (old->prescaler * 1e6);
+    double   loop = old->nrep * 1e6 / old->loop_freq;
+    int64_t  deadline = esp_timer_get_time() + 3 * loop + FGEN_RETUNE_MARGIN_US;
+    int64_t  first;
+    uint32_t ahead;
+    size_t   r;
+    bool     done;
+    bool     mixed = false;
+
+    if (p == 0) {
+        return false;
+    }
+
+    // First part, behind the RMT reading the old second one. Looked for
+    // with interrupts enabled, then checked again with them disabled
+    ahead = ceil((FGEN_RETUNE_MARGIN_US + p * FGEN_RETUNE_WORD_NS * 1e-3) * tpus);
+    for (done = false; !done && esp_timer_get_time() < deadline; ) {
+        r = FGEN_TX_RADDR(res->channel);
+        if (r < p || r >= last) {
+            continue;
+        }
+        portENTER_CRITICAL(&FGEN_RETUNE_LOCK);
+        first = esp_timer_get_time();
+        r     = FGEN_TX_RADDR(res->channel);
+        if (r >= p && r < last && fgen_ticks_over(ram, r + 1, last, ahead)) {
+            for (size_t i = 0; i < p; i++) {
+                ram[i].val = items[i].val;
+            }
+            done = true;
+        }
+        portEXIT_CRITICAL(&FGEN_RETUNE_LOCK);
+    }
+    if (!done) {
+        return false;
+    }
+
+    // The rest, ahead of the RMT reading the new first part
+    ahead = ceil((FGEN_RETUNE_MARGIN_US + (res->info.nitems - p) * FGEN_RETUNE_WORD_NS * 1e-3) * tpus);
+    for (done = false; !done && esp_timer_get_time() < deadline; ) {
+        if (FGEN_TX_RADDR(res->channel) >= p) {
+            continue;
+        }
+        portENTER_CRITICAL(&FGEN_RETUNE_LOCK);
+        r = FGEN_TX_RADDR(res->channel);
+        if (r < p && fgen_ticks_over(ram, r + 1, p, ahead)) {
+            for (size_t i = p; i < res->info.nitems; i++) {
+                ram[i].val = items[i].val;
+            }
+            done  = true;
+            mixed = esp_timer_get_time() - first >= loop;
+        }
+        portEXIT_CRITICAL(&FGEN_RETUNE_LOCK);
+    }
+    if (mixed) {
+        ESP_LOGW(FGEN_TAG,"RMT channel %d went out mixed for one loop", res->channel);
+    }
+    return done && !mixed;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Sets the clock and idle output of a retuned generator, the others being kept
+
+static
+esp_err_t fgen_retune_clock(const fgen_resources_t* res)
+{
+    esp_err_t ret;
+
+    ret = rmt_set_clk_div(res->channel, res->info.prescaler);
+    FGEN_CHECK(ret == ESP_OK, "Error setting RMT prescaler",  ret);
+    ret = rmt_set_source_clk(res->channel, (res->info.encoding == FGEN_ENC_REF_TICK) ? RMT_BASECLK_REF : RMT_BASECLK_APB);
+    FGEN_CHECK(ret == ESP_OK, "Error selecting RMT clock",  ret);
+    ret = rmt_set_idle_level(res->channel, res->info.compensated || res->info.phase_ticks != 0, fgen_idle_level(res));
+    FGEN_CHECK(ret == ESP_OK, "Error setting RMT idle level",  ret);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Retunes a generator on its RMT channel and blocks. The new items are
+// laid out in its slot first, then either left there for fgen_start(),
+// written ahead of the RMT at a loop boundary, or written with the
+// channel stopped for the few microseconds it takes
+
+static
+esp_err_t fgen_retune(fgen_resources_t* res, const fgen_info_t* info)
+{
+    fgen_info_t      old   = res->info;
+    rmt_item32_t*    items = fgen_slot_of(res)->items;
+    int64_t          start = esp_timer_get_time();
+    bool             busy  = fgen_get_state(res) == RMT_CHANNEL_BUSY;
+    rmt_idle_level_t idle  = fgen_idle_level(res);
+    bool             same;
+    esp_err_t     ret;
+
+    FGEN_CHECK(res->stream == NULL && res->pattern == NULL, "Streams and patterns cannot be retuned", ESP_ERR_NOT_SUPPORTED);
+    FGEN_CHECK(res->burst == NULL || !res->burst->running, "Bursts cannot be retuned", ESP_ERR_INVALID_STATE);
+    FGEN_CHECK(!info->streaming, "Cannot be retuned to a stream", ESP_ERR_NOT_SUPPORTED);
+    FGEN_CHECK(info->mem_blocks <= old.mem_blocks, "More RMT blocks needed than held",  ESP_ERR_INVALID_SIZE);
+
+    // Spare blocks are kept, lent as those of min_wrap generators are
+    res->solved           = *info;
+    res->solved.zero_copy = old.zero_copy;
+    res->solved.min_wrap  = old.min_wrap;
+    res->info             = res->solved;
+    if (old.min_wrap) {
+        fgen_spread(&res->info, old.mem_blocks);
+    }
+    res->info.mem_blocks  = old.mem_blocks;
+    FREQ_CHANNEL[res->channel].spread = (res->solved.mem_blocks < old.mem_blocks) ? res : NULL;
+
+    fgen_waveform_fill(res, items);
+    fgen_print_items(items, res->info.nitems);
+    same = res->info.prescaler == old.prescaler && res->info.encoding == old.encoding && res->info.compensated == old.compensated
+        && (old.compensated || old.phase_ticks != 0) == (res->info.compensated || res->info.phase_ticks != 0) && fgen_idle_level(res) == idle;
+
+    res->retune.seamless = true;
+    if (!busy) {
+        // Zero-copy items left stopped, their first one kept for fgen_start()
+        if (res->info.zero_copy) {
+            ret = rmt_fill_tx_items(res->channel, items + 1, res->info.nitems - 1, 1);
+            FGEN_CHECK(ret == ESP_OK, "Error copying RMT items to shared mem",  ret);
+        }
+        ret = fgen_retune_clock(res);
+    } else if (!(same && old.nrep * 1e6 / old.loop_freq <= FGEN_RETUNE_WAIT_US && fgen_retune_chase(res, &old, items))) {
+        res->retune.seamless = false;
+        ret = rmt_tx_stop(res->channel);
+        FGEN_CHECK(ret == ESP_OK, "Error stopping RMT Tx",  ret);
+        ret = rmt_fill_tx_items(res->channel, items, res->info.nitems, 0);
+        FGEN_CHECK(ret == ESP_OK, "Error copying RMT items to shared mem",  ret);
+        ret = fgen_retune_clock(res);
+        FGEN_CHECK(ret == ESP_OK, "Error setting RMT clock",  ret);
+        ret = rmt_tx_start(res->channel, true);
+    } else {
+        ret = ESP_OK;
+    }
+    if (res->info.zero_copy) {
+        res->head = items[0];
+    }
+    res->retune.latency_us = esp_timer_get_time() - start;
+    ESP_LOGD(FGEN_TAG,"RMT channel %d retuned in %u us%s", res->channel, res->retune.latency_us, (res->retune.seamless) ? "" : ", paused");
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_sweep_tick(void* arg)
+{
+    fgen_sweep_t* sweep = arg;
+
+    xTaskNotifyGive(sweep->task);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Measures a dwell time, from the last step taking over to t
+
+static
+void fgen_sweep_dwell(fgen_sweep_t* sweep, int64_t t)
+{
+    uint32_t err = llabs(t - sweep->last - sweep->stats.dwell_us);
+
+    sweep->err_sum += err;
+    sweep->dwells  += 1;
+    sweep->stats.dwell_err_max_us = (err > sweep->stats.dwell_err_max_us) ? err : sweep->stats.dwell_err_max_us;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Takes the next step of a sweep. Its items take over when the retune
+// is done, or at the loop boundary it waited for, its latency telling
+
+static
+void fgen_sweep_step(fgen_sweep_t* sweep)
+{
+    fgen_sweep_stats_t* stats = &sweep->stats;
+    fgen_resources_t*   res   = sweep->res;
+    int64_t             t     = esp_timer_get_time();
+
+    if (fgen_update_info(res, &sweep->steps[stats->steps]) == ESP_OK) {
+        t += res->retune.latency_us;
+        stats->seamless      += res->retune.seamless;
+        stats->latency_max_us = (res->retune.latency_us > stats->latency_max_us) ? res->retune.latency_us : stats->latency_max_us;
+    } else {
+        stats->failed += 1;
+    }
+    if (stats->steps == 0) {
+        sweep->first = t;
+    } else {
+        fgen_sweep_dwell(sweep, t);
+    }
+    sweep->last   = t;
+    stats->steps += 1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Takes the first step right away, then one at every timer tick, the
+// last tick ending the last dwell time. Ticks missed while retuning are
+// counted as overruns, the steps being taken late rather than skipped
+
+static
+void fgen_sweep_task(void* arg)
+{
+    fgen_sweep_t* sweep = arg;
+    uint32_t      ticks;
+
+    fgen_lock();
+    fgen_sweep_step(sweep);
+    if (fgen_get_state(sweep->res) != RMT_CHANNEL_BUSY) {
+        fgen_start(sweep->res);
+    }
+    fgen_unlock();
+
+    esp_timer_start_periodic(sweep->timer, sweep->stats.dwell_us);
+    while (!sweep->abort) {
+        ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (sweep->abort) {
+            break;
+        }
+        sweep->stats.overruns += ticks - 1;
+        if (sweep->stats.steps == sweep->stats.total) {
+            fgen_sweep_dwell(sweep, esp_timer_get_time());
+            break;
+        }
+        fgen_sweep_step(sweep);
+    }
+    esp_timer_stop(sweep->timer);
+    esp_timer_delete(sweep->timer);
+    sweep->stats.elapsed_us = esp_timer_get_time() - sweep->first;
+    free(sweep->steps);
+    sweep->steps   = NULL;
+    ESP_LOGD(FGEN_TAG,"RMT channel %d swept in %lld us", sweep->res->channel, sweep->stats.elapsed_us);
+
+    // Last access, fgen_free() being free to take it away from then on. With
+    // the lock taken, so that no one notifies the task once it is gone
+    fgen_lock();
+    sweep->running = false;
+    fgen_unlock();
+    vTaskDelete(NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Loop item i of a generator, the first one of zero-copy ones being kept
+// aside, as every stop overwrites it in RMT RAM
+
+static inline
+rmt_item32_t fgen_loop_item(const fgen_resources_t* res, size_t i)
+{
+    return (res->info.zero_copy && i == 0) ? res->head : res->items[i];
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Splits a burst into whole loops and a last one of 1 to nrep periods,
+// which ends at a new EoTx item written where the next period begins. The
+// item before it, the last one of the last period, is made a full low one,
+// so that loop mode can be cleared while the RMT goes through it
+
+static
+void fgen_burst_plan(fgen_burst_t* burst, uint64_t periods)
+{
+    const fgen_resources_t* res   = burst->res;
+    const fgen_info_t*      info  = &res->info;
+    fgen_burst_stats_t*     stats = &burst->stats;
+    size_t                  last  = info->nitems - 1;   // loop EoTx
+    uint32_t                ticks = 0;
+    rmt_item32_t            item;
+
+    stats->periods = periods;
+    stats->loops   = (periods - 1) / info->nrep;
+    stats->last    = periods - stats->loops * info->nrep;
+
+    burst->eotx = 0;
+    for (uint32_t i = 0; i < stats->last; i++) {
+        burst->eotx += fgen_count_items(info->NH, info->NL + fgen_long_period(i, info->nrep, info->nlong)
+                                                  - (info->compensated && i == info->nrep - 1));
+    }
+    burst->changed = (burst->eotx == last) ? last - 1 : burst->eotx;
+    for (size_t i = 0; i < last; i++) {
+        item = fgen_loop_item(res, i);
+        if (i == burst->eotx - 1) {
+            burst->reached = ticks;
+        }
+        ticks += item.duration0 + item.duration1;
+        if (i == burst->changed) {
+            burst->passed = ticks;
+        }
+    }
+    burst->loop     = ticks + 1;
+    burst->saved[0] = fgen_loop_item(res, burst->eotx - 1);
+    burst->saved[1] = fgen_loop_item(res, burst->eotx);
+
+    // Kept high if it starts so, the period being low from then on
+    burst->low.val       = 0;
+    burst->low.duration0 = (burst->saved[0].level0) ? burst->saved[0].duration0 : FGEN_ITEM_TICKS;
+    burst->low.level0    = burst->saved[0].level0;
+    burst->low.duration1 = FGEN_ITEM_TICKS;
+    burst->ending        = burst->reached + burst->low.duration0 + burst->low.duration1;
+    burst->tick_us       = info->prescaler * 1e6 / fgen_clock_hz(info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// esp_timer time at which the RMT is ticks into the loop after loops ones
+
+static inline
+int64_t fgen_burst_time(const fgen_burst_t* burst, uint64_t loops, uint32_t ticks)
+{
+    return burst->started + llround(((double) loops * burst->loop + ticks) * burst->tick_us);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_burst_tick(void* arg)
+{
+    fgen_burst_t* burst = arg;
+
+    xTaskNotifyGive(burst->task);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// RMT driver end of transmission callback, called for any channel from its
+// ISR, which is allocated in IRAM, so it must be there as well
+
+static IRAM_ATTR
+void fgen_burst_end(rmt_channel_t channel, void* arg)
+{
+    BaseType_t    woken = pdFALSE;
+    fgen_burst_t* burst;
+
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        burst = FGEN_SLOTS[i].res.burst;
+        if (FGEN_SLOTS[i].used && burst != NULL && burst->running && burst->res->channel == channel && burst->ended == 0) {
+            burst->ended = esp_timer_get_time();
+            vTaskNotifyGiveFromISR(burst->task, &woken);
+        }
+    }
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Changes the last loop of a burst. Its two items once the RMT went past
+// them in the loop before, or loop mode once it got into the last one.
+// Sleeps until shortly before, then spins, the RMT read address checked
+// again with interrupts disabled. Returns false if aborted or too late.
+
+static
+bool fgen_burst_chase(fgen_burst_t* burst, bool last)
+{
+    extern rmt_mem_t RMTMEM;
+    rmt_channel_t          ch    = burst->res->channel;
+    volatile rmt_item32_t* ram   = (volatile rmt_item32_t*) &RMTMEM.chan[ch].data32[0];
+    uint64_t               loops = burst->stats.loops;
+    int64_t                from  = (last) ? fgen_burst_time(burst, loops, 0) : fgen_burst_time(burst, loops - 1, burst->passed);
+    int64_t                to    = (last) ? fgen_burst_time(burst, loops, burst->ending) : fgen_burst_time(burst, loops, burst->reached);
+    int64_t                now   = esp_timer_get_time();
+    size_t                 r;
+    bool                   done  = false;
+
+    from += FGEN_RETUNE_MARGIN_US;
+    to   -= FGEN_RETUNE_MARGIN_US;
+    if (from - now > FGEN_BURST_SPIN_US) {
+        esp_timer_start_once(burst->timer, from - now - FGEN_BURST_SPIN_US);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    while (!done && !burst->abort && (now = esp_timer_get_time()) < to) {
+        if (now < from) {
+            continue;
+        }
+        portENTER_CRITICAL(&FGEN_RETUNE_LOCK);
+        now = esp_timer_get_time();
+        r   = FGEN_TX_RADDR(ch);
+        if (now < to && last && r < burst->eotx) {
+            RMT.conf_ch[ch].conf1.tx_conti_mode = 0;
+            RMT.int_clr.val = FGEN_TX_END_INT(ch);
+            done = true;
+        } else if (now < to && !last && (r < burst->eotx - 1 || r > burst->changed)) {
+            ram[burst->eotx - 1].val = burst->low.val;
+            ram[burst->eotx].val     = 0;
+            done = true;
+        }
+        portEXIT_CRITICAL(&FGEN_RETUNE_LOCK);
+    }
+    if (done && (!last || to + FGEN_RETUNE_MARGIN_US - now < burst->stats.slack_us)) {
+        burst->stats.slack_us = to + FGEN_RETUNE_MARGIN_US - now;
+    }
+    return done;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Let go once the generator started, changes its last loop if it has more
+// than one and waits for the end of transmission. The generator is then
+// stopped, its loop mode set back and its zero-copy items put back, but
+// for the first one, put back by fgen_start() as after any stop
+
+static
+void fgen_burst_task(void* arg)
+{
+    extern rmt_mem_t RMTMEM;
+    fgen_burst_t*       burst  = arg;
+    fgen_burst_stats_t* stats  = &burst->stats;
+    fgen_resources_t*   res    = burst->res;
+    TaskHandle_t        notify;
+    int64_t             end;
+    int64_t             now;
+    bool                ok     = true;
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (stats->loops > 0 && !burst->abort) {
+        ok = fgen_burst_chase(burst, false) && fgen_burst_chase(burst, true);
+        if (ok) {
+            rmt_set_tx_intr_en(res->channel, true);
+        }
+    }
+    end = fgen_burst_time(burst, stats->loops, burst->ending) + FGEN_BURST_END_MS * 1000;
+    while (ok && !burst->abort && burst->ended == 0 && (now = esp_timer_get_time()) < end) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((end - now) / 1000 + 1));
+    }
+    esp_timer_stop(burst->timer);
+    esp_timer_delete(burst->timer);
+
+    fgen_lock();
+    rmt_set_tx_intr_en(res->channel, false);
+    rmt_tx_stop(res->channel);
+    rmt_set_tx_loop_mode(res->channel, true);
+    if (res->info.zero_copy) {
+        for (size_t i = 0; i < 2; i++) {
+            if (burst->eotx - 1 + i > 0) {
+                RMTMEM.chan[res->channel].data32[burst->eotx - 1 + i].val = burst->saved[i].val;
+            }
+        }
+    }
+    if (!(ok && burst->ended != 0) && !burst->abort) {
+        ESP_LOGW(FGEN_TAG,"RMT channel %d missed the end of its burst, stopped", res->channel);
+    }
+
+    // Last access, as in fgen_sweep_task()
+    stats->exact      = ok && burst->ended != 0;
+    stats->elapsed_us = ((burst->ended) ? burst->ended : esp_timer_get_time()) - burst->started;
+    ESP_LOGD(FGEN_TAG,"RMT channel %d sent %llu periods in %lld us", res->channel, stats->periods, stats->elapsed_us);
+    notify         = burst->notify;
+    burst->running = false;
+    fgen_unlock();
+    if (notify != NULL) {
+        xTaskNotifyGive(notify);
+    }
+    vTaskDelete(NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Loads the items of a stopped looping generator back into RMT RAM
+
+static
+esp_err_t fgen_preload(fgen_resources_t* res)
+{
+    esp_err_t ret;
+
+    // Copy the generated pattern we've just generated to the internal RMT buffers
+    // The rmt_tx_stop places an EoTx in the beginning of the RMT memory buffer,
+    // the only item to be put back when they are already there
+    if (res->info.zero_copy) {
+        res->items[0] = res->head;
+    } else {
+        ret = rmt_fill_tx_items(res->channel, res->items, res->info.nitems, 0);
+        FGEN_CHECK(ret == ESP_OK, "Error copying RMT items to shared mem",  ret);
+    }
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void fgen_sched_tick(void* arg)
+{
+    xTaskNotifyGive(FGEN_SCHED_TASK);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Wakes the scheduler task up shortly before the first event, right away
+// if that is already past
+
+static
+void fgen_sched_arm()
+{
+    int64_t delay;
+
+    esp_timer_stop(FGEN_SCHED_TIMER);
+    if (FGEN_SCHED_N == 0) {
+        return;
+    }
+    delay = FGEN_SCHED[0].at - FGEN_SCHED_SPIN_US - esp_timer_get_time();
+    if (delay > 0) {
+        esp_timer_start_once(FGEN_SCHED_TIMER, delay);
+    } else {
+        xTaskNotifyGive(FGEN_SCHED_TASK);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Checks an event about to be run, with the lock taken, and loads the
+// items of a stopped generator to be started. Done once when taken out of
+// the queue, and again right before, as the lock is not held in between
+// and another task may have stopped, moved or deleted the generator.
+// Loading again is then what may make the event late. Bursts end by
+// themselves, so they are not started or stopped, retunes refusing them
+// already
+
+static
+void fgen_sched_prepare(fgen_sched_t* ev)
+{
+    if (ev->res == NULL) {
+        ev->ret = ESP_ERR_INVALID_STATE;
+    } else if (ev->event != FGEN_EVENT_RETUNE && ev->res->burst != NULL && ev->res->burst->running) {
+        ev->ret = ESP_ERR_INVALID_STATE;
+    } else if (ev->event == FGEN_EVENT_START && fgen_get_state(ev->res) != RMT_CHANNEL_BUSY) {
+        ev->ret = fgen_preload(ev->res);
+    } else {
+        ev->ret = ESP_OK;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Runs the starts and stops due at the same time as the first event, with
+// the lock taken and interrupts disabled. Starts write their RMT_CONF1_CHn
+// registers as fgen_start_group() does. Stops do what rmt_tx_stop() does,
+// an end of transmission marker first, as the driver takes a spinlock of
+// its own. Returns how many
+
+static
+size_t fgen_sched_edges(fgen_sched_t* ev, size_t n)
+{
+    extern rmt_mem_t RMTMEM;
+    rmt_channel_t ch[FGEN_SCHED_MAX];
+    uint32_t      conf[FGEN_SCHED_MAX];
+    size_t        k;
+
+    for (k = 0; k < n && ev[k].event != FGEN_EVENT_RETUNE && ev[k].at == ev[0].at; k++) {
+        fgen_sched_prepare(&ev[k]);
+        if (ev[k].ret == ESP_OK) {
+            ch[k]   = ev[k].res->channel;
+            conf[k] = RMT.conf_ch[ch[k]].conf1.val & ~FGEN_CONF1_TX_START;
+        }
+    }
+    while (esp_timer_get_time() < ev[0].at - FGEN_SCHED_CRIT_US) {
+    }
+    portENTER_CRITICAL(&FGEN_GROUP_LOCK);
+    while (esp_timer_get_time() < ev[0].at) {
+    }
+    for (size_t i = 0; i < k; i++) {
+        if (ev[i].ret != ESP_OK) {
+            continue;
+        }
+        if (ev[i].event == FGEN_EVENT_START) {
+            RMT.conf_ch[ch[i]].conf1.val = conf[i] | FGEN_CONF1_MEM_RD_RST | FGEN_CONF1_REF_CNT_RST;
+            RMT.conf_ch[ch[i]].conf1.val = conf[i];
+            RMT.conf_ch[ch[i]].conf1.val = conf[i] | FGEN_CONF1_TX_START;
+        } else {
+            RMTMEM.chan[ch[i]].data32[0].val = 0;
+            RMT.conf_ch[ch[i]].conf1.val = conf[i] | FGEN_CONF1_MEM_RD_RST;
+            RMT.conf_ch[ch[i]].conf1.val = conf[i];
+        }
+        ev[i].err = esp_timer_get_time() - ev[i].at;
+    }
+    portEXIT_CRITICAL(&FGEN_GROUP_LOCK);
+    return k;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Runs the events due before the scheduler task would spin no more. They
+// are taken out of the queue into FGEN_SCHED_RUN first, where
+// fgen_schedule_cancel() still finds them, and the items of those starting
+// are all loaded beforehand. Running generators restart with the items
+// they have. The lock is released while spinning, and only taken again
+// shortly before every batch of events, and for retunes, which need it
+// until done. Then arms the timer for the next ones. Returns how many
+// were run
+
+static
+size_t fgen_sched_run()
+{
+    fgen_sched_t* done = FGEN_SCHED_RUN;
+    int64_t       start;
+    size_t        n, k;
+
+    fgen_lock();
+    for (n = 0; n < FGEN_SCHED_N && FGEN_SCHED[n].at - esp_timer_get_time() <= FGEN_SCHED_SPIN_US; n++) {
+    }
+    memcpy(done, FGEN_SCHED, n * sizeof(fgen_sched_t));
+    memmove(FGEN_SCHED, FGEN_SCHED + n, (FGEN_SCHED_N - n) * sizeof(fgen_sched_t));
+    FGEN_SCHED_N    -= n;
+    FGEN_SCHED_RUN_N = n;
+    for (size_t i = 0; i < n; i++) {
+        done[i].handle = done[i].res->handle;
+        fgen_sched_prepare(&done[i]);
+    }
+    fgen_unlock();
+
+    for (size_t i = 0; i < n; i += k) {
+        if (done[i].event != FGEN_EVENT_RETUNE) {
+            while (esp_timer_get_time() < done[i].at - FGEN_SCHED_LOCK_US) {
+            }
+            fgen_lock();
+            k = fgen_sched_edges(done + i, n - i);
+            fgen_unlock();
+            continue;
+        }
+        while (esp_timer_get_time() < done[i].at) {
+        }
+        fgen_lock();
+        start = esp_timer_get_time();
+        fgen_sched_prepare(&done[i]);
+        if (done[i].ret == ESP_OK) {
+            done[i].ret = fgen_retune(done[i].res, done[i].info);
+            done[i].err = start + done[i].res->retune.latency_us - done[i].at;
+        }
+        fgen_unlock();
+        k = 1;
+    }
+
+    fgen_lock();
+    for (size_t i = 0; i < n; i++) {
+        free(done[i].info);
+        done[i].info = NULL;
+        FGEN_SCHED_STATS.done   += 1;
+        FGEN_SCHED_STATS.failed += (done[i].ret != ESP_OK);
+        if (done[i].ret != ESP_OK) {
+            continue;
+        }
+        if (FGEN_SCHED_STATS.done - FGEN_SCHED_STATS.failed == 1) {
+            FGEN_SCHED_STATS.err_min_us = done[i].err;
+            FGEN_SCHED_STATS.err_max_us = done[i].err;
+        }
+        FGEN_SCHED_STATS.err_min_us = (done[i].err < FGEN_SCHED_STATS.err_min_us) ? done[i].err : FGEN_SCHED_STATS.err_min_us;
+        FGEN_SCHED_STATS.err_max_us = (done[i].err > FGEN_SCHED_STATS.err_max_us) ? done[i].err : FGEN_SCHED_STATS.err_max_us;
+        FGEN_SCHED_ERR_SUM += abs(done[i].err);
+    }
+    FGEN_SCHED_RUN_N = 0;
+    fgen_sched_arm();
+    fgen_unlock();
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Runs the events as they come due, logging them once done, as logging
+// takes far longer than the time between those scheduled together. Only
+// this task writes FGEN_SCHED_RUN, so it is read without the lock
+
+static
+void fgen_sched_task(void* arg)
+{
+    static const char*  name[] = { "started", "stopped", "retuned" };
+    const fgen_sched_t* done   = FGEN_SCHED_RUN;
+    size_t              n;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        n = fgen_sched_run();
+        for (size_t i = 0; i < n; i++) {
+            if (done[i].ret == ESP_OK) {
+                ESP_LOGI(FGEN_TAG,"Channel %d %s %+d us from its schedule at %lld us", done[i].handle, name[done[i].event], done[i].err, done[i].at);
+            } else {
+                ESP_LOGW(FGEN_TAG,"Channel %d not %s as scheduled at %lld us", done[i].handle, name[done[i].event], done[i].at);
+            }
+        }
+    }
+}
+
+/* ************************************************************************* */
+/*                               API FUNCTIONS                               */
+/* ************************************************************************* */
+
+
+// Repeats a period of onitems items as many times as the blocks it needs
+// hold, EoTx included. Periods longer than 63 items per block fit once.
+
+static
+void fgen_repeat(fgen_info_t* info)
+{
+    info->mem_blocks = (info->onitems > 0 ) ? 1 + (info->onitems / 64) : 0;
+    info->nrep       = (info->mem_blocks * 63) / info->onitems;
+    // This is a hack due to a firmware's bug
+    info->nrep       = (info->nrep == 63) ? 62 : info->nrep;
+    info->nrep       = (info->nrep == 0)  ? 1  : info->nrep;
+    info->nitems     = info->onitems * info->nrep + 1; // global array size including final EoTx
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills in the frequency, duty cycle and jitter figures of a laid out solution
+
+static
+void fgen_figures(const fgen_target_t* target, fgen_info_t* info)
+{
+    double   clock = fgen_clock_hz(info);
+    uint32_t K;
+
+    fgen_log_params(target, info);
+    ESP_LOGD(FGEN_TAG,"Nitems = %d, Mem Blocks = %d", info->onitems, info->mem_blocks);
+    ESP_LOGD(FGEN_TAG,"This sequence can be duplicated %d times + final EoTx (0,0,0,0)",info->nrep);
+    ESP_LOGD(FGEN_TAG,"Loop jitter %llu APB ticks", info->prescaler * (FGEN_APB_HZ / fgen_clock_hz(info)));
+
+    // Floating point figures kept for display and NVS storage only
+    info->freq       = clock * info->nrep / ((double) info->prescaler * ((uint64_t) info->N * info->nrep + info->nlong));
+    info->duty_cycle = info->NH * (double) info->nrep / ((uint64_t) info->N * info->nrep + info->nlong);
+    info->jitter     = (info->streaming || info->compensated) ? 0.0 : info->prescaler / clock;
+    info->refill_rate = (info->streaming) ? info->freq * info->nitems / info->nrep / FGEN_STREAM_HALF : 0.0;
+
+    // What is really output in the long run, idle tick included
+    info->loop_freq  = fgen_loop_freq(info);
+    info->loop_err   = lround(((double) target->tnum / target->tden / clock * info->loop_freq - 1.0) * 1e6);
+
+    // Edges are within floor(K/2)/K ticks of the average clock, K being
+    // the length of the pattern of long and short periods
+    K = (info->nlong) ? info->nrep / fgen_gcd(info->nrep, info->nlong) : 1;
+    info->phase_err  = info->prescaler * (double)(K / 2) / K / clock;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Fills in the info fields derived from prescaler, N, NH and NL
+
+static
+void fgen_layout(const fgen_target_t* target, fgen_info_t* info)
+{
+    // See how many RMT 32-bit items needs this frequency generation
+    // How many channes does it take and how many repetitions withon a channel
+    // to minimize wraparround jitter (1 Tclk delay is introduced by wraparound)
+
+    info->onitems    = fgen_count_items(info->NH, info->NL);  // without EoTx
+    if (info->streaming) {
+        // The pattern stays in RAM and there is no wraparound, so a single
+        // period will do, unless fractional periods need all of them
+        info->nrep       = (info->nlong == 0) ? 1 : info->nrep;
+        info->nitems     = fgen_loop_items(info);
+        info->mem_blocks = 1;
+    } else if (info->nlong == 0) {
+        fgen_repeat(info);
+    } else {
+        // nrep and nlong already chosen by fgen_fractional()
+        info->nitems     = fgen_loop_items(info) + 1;
+        info->mem_blocks = (info->nitems - 1 + 62) / 63;
+    }
+    fgen_compensate(info, target->compensate);
+    fgen_phase(target, info);
+    fgen_figures(target, info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t fgen_solve_clock(const fgen_target_t* target, const fgen_sieve_t* sieve, fgen_encoding_t encoding, fgen_info_t* info)
+{
+    esp_err_t ret;
+
+    // Decompose Frequency into the product of 2 factors: prescaler and N
+    // Decompose N into NH and NL taking into account dyty cycle
+    info->encoding  = encoding;
+    info->streaming = target->streaming;
+    info->min_wrap  = target->min_wrap;
+    info->zero_copy = target->zero_copy && !target->streaming;
+    info->nlong     = 0;
+    ret = fgen_optimize(target, sieve, info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (target->fractional) {
+        fgen_fractional(target, info);
+    }
+    fgen_layout(target, info);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Error of a solution in ppb as ranked by the target objective: the
+// frequency error, weighted with the duty cycle one if so requested.
+// Only used to compare solutions, so floating point is good enough.
+
+static
+double fgen_rank_err(const fgen_target_t* target, const fgen_info_t* info)
+{
+    double ferr = fabs(info->freq * target->tnum / target->tden / FGEN_APB - 1.0);
+    double derr = fabs(info->duty_cycle * target->dden / target->dnum - 1.0);
+
+    if (target->duty_weight == 0) {
+        return round(ferr * 1e9);
+    }
+    return round((target->freq_weight * ferr + target->duty_weight * derr) * 1e9);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Whether the REF_TICK solution ref is to be preferred to the APB one.
+// It must take fewer blocks without a larger error, or without leaving the
+// tolerance when fewer blocks is the objective. Its coarser tick means
+// more jitter, so it is never preferred for the jitter objective.
+
+static
+bool fgen_prefer_ref(const fgen_target_t* target, const fgen_info_t* apb, const fgen_info_t* ref)
+{
+    double err = fgen_rank_err(target, ref);
+
+    if (ref->mem_blocks >= apb->mem_blocks || target->objective == FGEN_OBJ_JITTER) {
+        return false;
+    }
+    if (target->objective == FGEN_OBJ_BLOCKS && err <= 1000.0 * target->tol_ppm) {
+        return true;
+    }
+    return err <= fgen_rank_err(target, apb);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The optional sieve is only of use to APB tick products, REF_TICK ones
+// being too far from it
+
+static
+esp_err_t fgen_solve(const fgen_target_t* target, const fgen_sieve_t* sieve, fgen_info_t* info)
+{
+    fgen_target_t ref;
+    fgen_info_t   alt;
+    esp_err_t     ret;
+
+    // Same frequency, duty cycle and options as a recent request
+    if (fgen_cache_lookup(target, info)) {
+        ESP_LOGD(FGEN_TAG,"Solution found in cache");
+        return ESP_OK;
+    }
+
+    ret = fgen_solve_clock(target, sieve, FGEN_ENC_APB, info);
+
+    // Long periods may also be counted in REF_TICK ticks, each one being
+    // FGEN_REF_TICKS APB ticks, i.e. the same target with a scaled period.
+    // Periods too long for N to fit in 31 bits can only be counted that way
+    if ((ret == ESP_OK && info->mem_blocks > 1) || target->tnum / target->tden >= ((uint64_t) FGEN_MAX_PRESCALER << 31)) {
+        ref       = *target;
+        ref.tden *= FGEN_REF_TICKS;
+        if (fgen_solve_clock(&ref, sieve, FGEN_ENC_REF_TICK, &alt) == ESP_OK && (ret != ESP_OK || 
+            (alt.mem_blocks <= 8 && (info->mem_blocks > 8 || fgen_prefer_ref(target, info, &alt))))) {
+            ESP_LOGD(FGEN_TAG,"REF_TICK encoding => %d blocks", alt.mem_blocks);
+            *info = alt;
+            ret   = ESP_OK;
+        }
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Loops too large for the RMT RAM are streamed instead
+    if (info->mem_blocks > 8) {
+        ESP_LOGD(FGEN_TAG,"%d blocks needed => streaming", info->mem_blocks);
+        ref           = *target;
+        ref.streaming = true;
+        ref.tden     *= (info->encoding == FGEN_ENC_REF_TICK) ? FGEN_REF_TICKS : 1;
+        ret = fgen_solve_clock(&ref, sieve, info->encoding, info);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    FGEN_CHECK(!info->streaming || info->refill_rate <= FGEN_STREAM_MAX_RATE, "Fout too high to be streamed", ESP_ERR_INVALID_SIZE);
+    FGEN_CHECK(!info->streaming || target->phase_mdeg == 0, "Loop too large for RMT RAM to be phased", ESP_ERR_NOT_SUPPORTED);
+
+    fgen_cache_insert(target, info);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Custom patterns are rounded with every prescaler of both clocks, and the
+// lowest period error, then the lowest edge error, then the fewest blocks
+// win. Their target period is given in ticks of the winning clock.
+
+static
+esp_err_t fgen_pattern_solve(const fgen_segment_t* seg, size_t n, fgen_info_t* info, fgen_pattern_t** pattern)
+{
+    static const fgen_encoding_t encodings[] = { FGEN_ENC_APB, FGEN_ENC_REF_TICK };
+    fgen_pattern_t* pat;
+    fgen_target_t   target;
+    uint64_t total = 0, high = 0;
+    uint64_t eerr, perr, best_eerr = 0, best_perr = 0, clock;
+    size_t   items, best_items = 0;
+    uint32_t best_p = 0;
+    fgen_encoding_t best_enc = FGEN_ENC_APB;
+
+    FGEN_CHECK(n > 0, "Empty pattern", ESP_ERR_INVALID_ARG);
+    for (size_t i = 0; i < n; i++) {
+        FGEN_CHECK(seg[i].level <= 1, "Pattern levels must be 0 or 1", ESP_ERR_INVALID_ARG);
+        FGEN_CHECK(seg[i].duration_ns > 0 && seg[i].duration_ns <= FGEN_PATTERN_MAX_NS, "Pattern segment length out of range", ESP_ERR_INVALID_ARG);
+        total += seg[i].duration_ns;
+        high  += (seg[i].level) ? seg[i].duration_ns : 0;
+    }
+    FGEN_CHECK(total <= FGEN_PATTERN_MAX_NS, "Pattern too long", ESP_ERR_INVALID_SIZE);
+    FGEN_CHECK(high > 0 && high < total, "Pattern must have both levels", ESP_ERR_INVALID_ARG);
+
+    pat = (fgen_pattern_t*) calloc(1, sizeof(fgen_pattern_t) + n * sizeof(fgen_run_t));
+    FGEN_CHECK(pat != NULL, "Out of memory allocating pattern", ESP_ERR_NO_MEM);
+
+    // Consecutive segments at the same level make a single run
+    for (size_t i = 0; i < n; i++) {
+        if (pat->nruns > 0 && pat->runs[pat->nruns - 1].level == seg[i].level) {
+            pat->runs[pat->nruns - 1].ns += seg[i].duration_ns;
+        } else {
+            pat->runs[pat->nruns].ns    = seg[i].duration_ns;
+            pat->runs[pat->nruns].level = seg[i].level;
+            pat->nruns += 1;
+        }
+    }
+
+    for (size_t k = 0; k < sizeof(encodings)/sizeof(encodings[0]); k++) {
+        clock = (encodings[k] == FGEN_ENC_REF_TICK) ? FGEN_REF_HZ : FGEN_APB_HZ;
+        for (uint32_t p = 1; p <= FGEN_MAX_PRESCALER; p++) {
+            items = fgen_pattern_ticks(pat, clock, p, &eerr, &perr);
+            if (items == 0 || items > FGEN_MAX_ITEMS) {
+                continue;
+            }
+            if (best_p == 0 || perr < best_perr || (perr == best_perr && (eerr < best_eerr || 
+                (eerr == best_eerr && items/64 < best_items/64)))) {
+                best_p = p; best_perr = perr; best_eerr = eerr; best_items = items; best_enc = encodings[k];
+            }
+        }
+    }
+    if (best_p == 0) {
+        ESP_LOGE(FGEN_TAG,"%s: Pattern too short for a tick or too long for RMT RAM", __FUNCTION__);
+        free(pat);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(info, 0, sizeof(fgen_info_t));
+    info->encoding  = best_enc;
+    info->prescaler = best_p;
+    fgen_pattern_ticks(pat, fgen_clock_hz(info), best_p, &eerr, &perr);
+
+    for (size_t i = 0; i < pat->nruns; i++) {
+        info->N  += pat->runs[i].ticks;
+        info->NH += (pat->runs[i].level) ? pat->runs[i].ticks : 0;
+    }
+    info->NL      = info->N - info->NH;
+    info->onitems = best_items;
+    fgen_repeat(info);
+
+    // The last run gives a tick to the loop idle one, if it has a spare one
+    info->compensated = pat->runs[pat->nruns - 1].ticks > fgen_run_halves(pat, pat->nruns - 1);
+
+    memset(&target, 0, sizeof(fgen_target_t));
+    target.tnum = total * (fgen_clock_hz(info) / 1000000);
+    target.tden = 1000;
+    target.dnum = (uint64_t) llround((double) high / total * 1e9);
+    target.dden = 1000000000;
+    fgen_figures(&target, info);
+    info->phase_err = eerr * 1e-12;
+
+    *pattern = pat;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t fgen_target_options(const fgen_options_t* opt, fgen_target_t* target)
+{
+    target->objective  = FGEN_OBJ_ERROR;
+    target->tol_ppm    = 0;
+    target->fractional = false;
+    if (opt != NULL) {
+        FGEN_CHECK(opt->objective <= FGEN_OBJ_JITTER, "Unknown objective", ESP_ERR_INVALID_ARG);
+        FGEN_CHECK(opt->tol_ppm < 1000000, "Tolerance must be below 1000000 ppm", ESP_ERR_INVALID_ARG);
+        FGEN_CHECK(opt->duty_weight == 0 || opt->freq_weight > 0, "Frequency weight must be positive", ESP_ERR_INVALID_ARG);
+        FGEN_CHECK(opt->phase >= 0.0 && opt->phase < 360.0, "Phase must be in [0,360) degrees", ESP_ERR_INVALID_ARG);
+        FGEN_CHECK(opt->phase == 0.0 || !opt->streaming, "Streams cannot be phased", ESP_ERR_NOT_SUPPORTED);
+        target->objective  = opt->objective;
+        target->tol_ppm    = opt->tol_ppm;
+        target->fractional = opt->fractional;
+        target->freq_weight = opt->freq_weight;
+        target->duty_weight = opt->duty_weight;
+        target->streaming   = opt->streaming;
+        target->compensate  = opt->compensate;
+        target->min_wrap    = opt->min_wrap;
+        target->zero_copy   = opt->zero_copy;
+        target->phase_mdeg  = llround(opt->phase * 1000) % 360000;
+    }
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t fgen_target_double(double freq, double duty_cycle, const fgen_options_t* opt, fgen_target_t* target)
+{
+    double T;
+    int    exp;
+
+    memset(target, 0, sizeof(fgen_target_t));   // padding included, as it is compared by the cache
+    FGEN_CHECK(freq > 0.0, "Fout must be positive", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(duty_cycle > 0.0 && duty_cycle < 1.0, "Duty cycle out of (0,1) range", ESP_ERR_INVALID_ARG);
+
+    // The only floating point division. The period in APB ticks is then
+    // converted exactly to a ratio by scaling its 53 bit mantissa to an integer.
+    // Duty cycles are typed in decimal, so they are taken in parts per billion
+    T = FGEN_APB / freq;
+    FGEN_CHECK(T >= 2.0, "Fout above half the APB clock", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(T < 0x1p40, "Fout too low", ESP_ERR_INVALID_SIZE);
+    frexp(T, &exp);
+    target->tnum = (uint64_t) ldexp(T, 53 - exp);
+    target->tden = 1ULL << (53 - exp);
+    target->dnum = (uint64_t) llround(duty_cycle * 1e9);
+    target->dden = 1000000000;
+
+    return fgen_target_options(opt, target);
+}
+
+/* ************************************************************************* */
+/*                               API FUNCTIONS                               */
+/* ************************************************************************* */
+
+
+esp_err_t fgen_info(double freq, double duty_cycle, fgen_info_t* info)
+{
+    return fgen_info_opt(freq, duty_cycle, NULL, info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_info_opt(double freq, double duty_cycle, const fgen_options_t* opt, fgen_info_t* info)
+{
+    fgen_target_t target;
+    esp_err_t     ret;
+
+    ret = fgen_target_double(freq, duty_cycle, opt, &target);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return fgen_solve(&target, NULL, info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_info_ratio(uint64_t num, uint64_t den, uint32_t duty_ppm, fgen_info_t* info)
+{
+    return fgen_info_ratio_opt(num, den, duty_ppm, NULL, info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_info_ratio_opt(uint64_t num, uint64_t den, uint32_t duty_ppm, const fgen_options_t* opt, fgen_info_t* info)
+{
+    fgen_target_t target;
+    esp_err_t     ret;
+
+    FGEN_CHECK(num > 0 && den > 0, "Fout must be positive", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(num <= FGEN_MAX_RATIO_NUM && den <= FGEN_MAX_RATIO_DEN, "Fout ratio terms too large", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(duty_ppm > 0 && duty_ppm < 1000000, "Duty cycle out of (0,1000000) ppm range", ESP_ERR_INVALID_ARG);
+
+    // Period in APB ticks = FGEN_APB_HZ * den / num
+    memset(&target, 0, sizeof(fgen_target_t));   // padding included, as it is compared by the cache
+    target.tnum = FGEN_APB_HZ * den;
+    target.tden = num;
+    target.dnum = duty_ppm;
+    target.dden = 1000000;
+
+    ret = fgen_target_options(opt, &target);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return fgen_solve(&target, NULL, info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_info_mhz(uint64_t freq_mhz, uint32_t duty_ppm, fgen_info_t* info)
+{
+    return fgen_info_ratio(freq_mhz, 1000, duty_ppm, info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_info_pareto(double freq, double duty_cycle, uint32_t tol_ppm, fgen_info_t* set, size_t* n)
+{
+    fgen_options_t     opt = { .objective = FGEN_OBJ_ERROR, .tol_ppm = tol_ppm };
+    fgen_target_t      target;
+    fgen_pareto_ctx_t* ctx;
+    fgen_candidate_t   cand;
+    esp_err_t ret;
+    size_t    i, j;
+
+    ret = fgen_target_double(freq, duty_cycle, &opt, &target);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ctx = (fgen_pareto_ctx_t*) calloc(1, sizeof(fgen_pareto_ctx_t));
+    FGEN_CHECK(ctx != NULL, "Out of memory allocating Pareto set", ESP_ERR_NO_MEM);
+
+    ret = fgen_search(&target, NULL, fgen_visit_pareto, ctx);
+    if (ret != ESP_OK) {
+        free(ctx);
+        return ret;
+    }
+    if (ctx->truncated) {
+        ESP_LOGW(FGEN_TAG,"Pareto set truncated to %d solutions", FGEN_PARETO_MAX);
+    }
+
+    // Sort by increasing error
+    for (i = 1; i < ctx->n; i++) {
+        cand = ctx->set[i];
+        for (j = i; j > 0 && fgen_better(&cand, &ctx->set[j-1], FGEN_OBJ_ERROR); j--) {
+            ctx->set[j] = ctx->set[j-1];
+        }
+        ctx->set[j] = cand;
+    }
+
+    *n = min(*n, ctx->n);
+    for (i = 0; i < *n; i++) {
+        memset(&set[i], 0, sizeof(fgen_info_t));
+        set[i].prescaler = ctx->set[i].prescaler;
+        set[i].N         = ctx->set[i].N;
+        fgen_split_duty(&target, set[i].N, &set[i].NH, &set[i].NL);
+        fgen_layout(&target, &set[i]);
+    }
+    free(ctx);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Requests sorted by increasing period, for fgen_info_batch()
+
+static
+int fgen_batch_cmp(const void* a, const void* b)
+{
+    const fgen_batch_t* x = a;
+    const fgen_batch_t* y = b;
+
+    return (x->period > y->period) - (x->period < y->period);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_info_batch(const fgen_request_t* req, size_t n, fgen_info_t* info, esp_err_t* status)
+{
+    fgen_batch_t* order;
+    fgen_sieve_t* sieve = NULL;
+    fgen_target_t target;
+    esp_err_t ret;
+    esp_err_t first = ESP_OK;
+    size_t    first_i = n;
+    size_t    a, b, i;
+    double    base;
+
+    order = (fgen_batch_t*) malloc(n * sizeof(fgen_batch_t));
+    FGEN_CHECK(n == 0 || order != NULL, "Out of memory sorting the batch", ESP_ERR_NO_MEM);
+    for (i = 0; i < n; i++) {
+        order[i].period = (req[i].freq > 0.0) ? FGEN_APB / req[i].freq : 0.0;
+        order[i].index  = i;
+    }
+    qsort(order, n, sizeof(fgen_batch_t), fgen_batch_cmp);
+
+    // Runs of enough requests whose candidate tick products all fall in one
+    // window share the divisor table built for it. The rest are solved on
+    // their own, the last table being of no use to them but harmless
+    for (a = 0; a < n; a = b) {
+        base = floor(order[a].period) - FGEN_BATCH_MARGIN;
+        base = (base < 2.0) ? 2.0 : base;
+        b    = a;
+        while (b < n && order[b].period + FGEN_BATCH_MARGIN < base + FGEN_BATCH_WINDOW) {
+            b += 1;
+        }
+        if (b - a >= FGEN_BATCH_MIN && order[a].period >= 2.0 && 
+            (sieve != NULL || (sieve = (fgen_sieve_t*) malloc(sizeof(fgen_sieve_t))) != NULL)) {
+            fgen_sieve_build(sieve, (uint64_t) base);
+        } else {
+            b = a + 1;
+        }
+        for (; a < b; a++) {
+            i   = order[a].index;
+            ret = fgen_target_double(req[i].freq, req[i].duty_cycle, NULL, &target);
+            if (ret == ESP_OK) {
+                ret = fgen_solve(&target, sieve, &info[i]);
+            }
+            if (status != NULL) {
+                status[i] = ret;
+            }
+            if (ret != ESP_OK && i < first_i) {
+                first   = ret;
+                first_i = i;
+            }
+        }
+    }
+    free(sieve);
+    free(order);
+    return first;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_pattern_info(const fgen_segment_t* seg, size_t n, fgen_info_t* info)
+{
+    fgen_pattern_t* pat;
+    esp_err_t       ret;
+
+    ret = fgen_pattern_solve(seg, n, info, &pat);
+    if (ret == ESP_OK) {
+        free(pat);
+    }
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void fgen_cache_stats(fgen_cache_stats_t* stats)
+{
+    portENTER_CRITICAL(&FGEN_CACHE_LOCK);
+    *stats = FGEN_CACHE_STATS;
+    portEXIT_CRITICAL(&FGEN_CACHE_LOCK);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void fgen_cache_clear()
+{
+    portENTER_CRITICAL(&FGEN_CACHE_LOCK);
+    memset(FGEN_CACHE, 0, sizeof(FGEN_CACHE));
+    memset(&FGEN_CACHE_STATS, 0, sizeof(FGEN_CACHE_STATS));
+    FGEN_CACHE_STATS.size = FGEN_CACHE_SIZE;
+    FGEN_CACHE_CLOCK      = 0;
+    portEXIT_CRITICAL(&FGEN_CACHE_LOCK);
+}
+
+/* -------------------------------------------------------------------------- */
+
+fgen_resources_t* fgen_alloc(const fgen_info_t* info, gpio_num_t gpio_num)
+{
+    fgen_resources_t* resources;
+
+    fgen_lock();
+    resources = fgen_slot_take();
+    if (resources == NULL) {
+        ESP_LOGE(FGEN_TAG,"%s: No free frequency generator slot", __FUNCTION__);
+    } else if (fgen_allocate(info, gpio_num, resources) != ESP_OK) {
+        fgen_release(resources);
+        resources = NULL;
+    }
+    fgen_unlock();
+    return resources;
+}
+
+/* -------------------------------------------------------------------------- */
+
+fgen_resources_t* fgen_pattern_alloc(const fgen_segment_t* seg, size_t n, gpio_num_t gpio_num)
+{
+    fgen_resources_t* resources;
+    fgen_pattern_t*   pattern;
+    fgen_info_t       info;
+    esp_err_t ret;
+
+    // Solved before taking the lock, as it takes a while
+    ret = fgen_pattern_solve(seg, n, &info, &pattern);
+    if (ret != ESP_OK) {
+        return NULL;
+    }
+
+    fgen_lock();
+    resources = fgen_slot_take();
+    if (resources == NULL) {
+        ESP_LOGE(FGEN_TAG,"%s: No free frequency generator slot", __FUNCTION__);
+        free(pattern);
+    } else {
+        resources->pattern = pattern;
+        if (fgen_allocate(&info, gpio_num, resources) != ESP_OK) {
+            fgen_release(resources);
+            resources = NULL;
+        }
+    }
+    fgen_unlock();
+    return resources;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// fgen_plan() with the lock taken, as the channel map is changed meanwhile
+
+static
+esp_err_t fgen_plan_locked(const fgen_plan_req_t* req, size_t n, fgen_placement_t* place, fgen_plan_t* plan)
+{
+    fgen_channel_t saved[RMT_CHANNEL_MAX];
+    uint8_t        order[RMT_CHANNEL_MAX];
+    size_t         pool = 0, g = 0;
+    bool           taken, fits, spread;
+    esp_err_t      ret = ESP_OK;
+
+    fgen_gpio_pool_init();
+    memset(plan, 0, sizeof(fgen_plan_t));
+    for (rmt_channel_t ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+        plan->free_blocks += (FREQ_CHANNEL[ch].state == FGEN_CHANNEL_FREE);
+        if (FREQ_CHANNEL[ch].spread != NULL) {
+            plan->free_blocks += FREQ_CHANNEL[ch].mem_blocks - FREQ_CHANNEL[ch].spread->solved.mem_blocks;
+            plan->give_back    = true;
+        }
+        plan->free_slots += !FGEN_SLOTS[ch].used;
+    }
+
+    // Every generator solved, and given its own GPIO if it asks for one
+    for (size_t i = 0; i < n; i++) {
+        place[i].channel  = -1;
+        place[i].gpio_num = req[i].gpio_num;
+        place[i].status   = fgen_info(req[i].freq, req[i].duty_cycle, &place[i].info);
+        if (req[i].gpio_num == GPIO_NUM_NC) {
+            pool += 1;
+        }
+        taken = (req[i].gpio_num != GPIO_NUM_NC) && fgen_gpio_used(req[i].gpio_num);
+        for (size_t j = 0; j < i && req[i].gpio_num != GPIO_NUM_NC; j++) {
+            taken = taken || req[j].gpio_num == req[i].gpio_num;
+        }
+        if (req[i].gpio_num != GPIO_NUM_NC && place[i].status == ESP_OK && fgen_gpio_check(req[i].gpio_num) != ESP_OK) {
+            place[i].status = ESP_ERR_NOT_SUPPORTED;
+        }
+        if (taken && place[i].status == ESP_OK) {
+            ESP_LOGE(FGEN_TAG,"%s: GPIO %d taken twice", __FUNCTION__, req[i].gpio_num);
+            place[i].status = ESP_ERR_INVALID_STATE;
+        }
+        if (place[i].status != ESP_OK) {
+            ret = ESP_ERR_INVALID_ARG;
+            continue;
+        }
+        plan->blocks += place[i].info.mem_blocks;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Pool GPIOs asked for by the set are not left for the others
+    for (int i = 0; i < FREQ_GPIO_NUM; i++) {
+        taken = FREQ_GPIO[i].allocated;
+        for (size_t j = 0; j < n; j++) {
+            taken = taken || req[j].gpio_num == FREQ_GPIO[i].gpio_num;
+        }
+        plan->free_gpios += !taken;
+    }
+    FGEN_CHECK(n <= plan->free_slots, "More generators than free slots", ESP_ERR_NO_MEM);
+    FGEN_CHECK(pool <= plan->free_gpios, "Not enough free GPIO pins in the pool", ESP_ERR_NO_MEM);
+    FGEN_CHECK(plan->blocks <= plan->free_blocks, "Not enough free RMT blocks", ESP_ERR_NO_MEM);
+
+    // Pool GPIOs handed out in creation order, as fgen_gpio_alloc() would
+    fgen_plan_order(place, n, order);
+    for (size_t k = 0; k < n; k++) {
+        for (; place[order[k]].gpio_num == GPIO_NUM_NC && g < FREQ_GPIO_NUM; g++) {
+            taken = FREQ_GPIO[g].allocated;
+            for (size_t j = 0; j < n; j++) {
+                taken = taken || req[j].gpio_num == FREQ_GPIO[g].gpio_num;
+            }
+            if (!taken) {
+                place[order[k]].gpio_num = FREQ_GPIO[g].gpio_num;
+            }
+        }
+    }
+
+    // Tried on the channel map as is, then with spare blocks given back,
+    // then with the existing generators packed. There is always room by
+    // then, the free blocks being together and enough
+    spread = plan->give_back;
+    plan->give_back = false;
+    memcpy(saved, FREQ_CHANNEL, sizeof(saved));
+    fits = fgen_plan_place(place, order, n, false, false);
+    if (!fits && spread) {
+        memcpy(FREQ_CHANNEL, saved, sizeof(saved));
+        plan->give_back = true;
+        fits = fgen_plan_place(place, order, n, true, false);
+    }
+    if (!fits) {
+        memcpy(FREQ_CHANNEL, saved, sizeof(saved));
+        plan->give_back = spread;
+        plan->compact   = true;
+        fits = fgen_plan_place(place, order, n, true, true);
+    }
+    memcpy(FREQ_CHANNEL, saved, sizeof(saved));
+    FGEN_CHECK(fits, "No room found for the whole set", ESP_ERR_NO_MEM);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_plan(const fgen_plan_req_t* req, size_t n, fgen_placement_t* place, fgen_plan_t* plan)
+{
+    esp_err_t ret;
+
+    fgen_lock();
+    ret = fgen_plan_locked(req, n, place, plan);
+    fgen_unlock();
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// fgen_plan_locked() as if the nold generators in old[] were freed. Their
+// channels, slots and GPIO pins are let go of while planning, then taken
+// back as they were
+
+static
+esp_err_t fgen_plan_over_locked(const fgen_plan_req_t* req, size_t n, fgen_resources_t* const* old, size_t nold, 
+                                fgen_placement_t* place, fgen_plan_t* plan)
+{
+    fgen_channel_t channels[RMT_CHANNEL_MAX];
+    fgen_gpio_t    gpios[RMT_CHANNEL_MAX];
+    bool           used[RMT_CHANNEL_MAX];
+    esp_err_t      ret;
+
+    // Before it is saved, as planning sets it up the first time
+    fgen_gpio_pool_init();
+    memcpy(channels, FREQ_CHANNEL, sizeof(channels));
+    memcpy(gpios, FREQ_GPIO, sizeof(gpios));
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        used[i] = FGEN_SLOTS[i].used;
+    }
+    for (size_t i = 0; i < nold; i++) {
+        if (old[i]->channel != -1) {
+            fgen_channel_free(old[i]->channel);
+        }
+        fgen_gpio_free(old[i]->gpio_num);
+        fgen_slot_of(old[i])->used = false;
+    }
+    ret = fgen_plan_locked(req, n, place, plan);
+    memcpy(FREQ_CHANNEL, channels, sizeof(channels));
+    memcpy(FREQ_GPIO, gpios, sizeof(gpios));
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        FGEN_SLOTS[i].used = used[i];
+    }
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// fgen_plan_apply_over() with the lock taken, so that nothing else gets
+// the planned resources first
+
+static
+esp_err_t fgen_plan_apply_locked(const fgen_plan_req_t* req, size_t n, fgen_resources_t** old, size_t nold, fgen_resources_t** res)
+{
+    // Too large for the caller's stack, and only used with the lock taken
+    static fgen_placement_t place[RMT_CHANNEL_MAX];
+    uint8_t     order[RMT_CHANNEL_MAX];
+    fgen_plan_t plan;
+    size_t      k;
+    esp_err_t   ret;
+
+    FGEN_CHECK(n <= RMT_CHANNEL_MAX, "More generators than RMT channels", ESP_ERR_INVALID_SIZE);
+    // Their tasks take the lock, so they cannot be stopped from here
+    for (size_t i = 0; i < nold; i++) {
+        FGEN_CHECK((old[i]->sweep == NULL || !old[i]->sweep->running) && (old[i]->burst == NULL || !old[i]->burst->running), 
+                   "Generator to replace sweeping or bursting", ESP_ERR_INVALID_STATE);
+    }
+    ret = fgen_plan_over_locked(req, n, old, nold, place, &plan);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Only once the whole set is sure to fit
+    for (size_t i = 0; i < nold; i++) {
+        if (fgen_get_state(old[i]) == RMT_CHANNEL_BUSY) {
+            fgen_stop(old[i]);
+        }
+        fgen_free(old[i]);
+    }
+
+    // Room made as planned, so that each one gets its planned channel
+    for (rmt_channel_t ch = 0; plan.give_back && ch < RMT_CHANNEL_MAX; ch++) {
+        if (FREQ_CHANNEL[ch].spread != NULL) {
+            fgen_give_back(FREQ_CHANNEL[ch].spread);
+        }
+    }
+    if (plan.compact) {
+        ret = fgen_compact();
+        FGEN_CHECK(ret == ESP_OK, "Error moving RMT channels",  ret);
+    }
+
+    memset(res, 0, n * sizeof(fgen_resources_t*));
+    fgen_plan_order(place, n, order);
+    for (k = 0; k < n; k++) {
+        res[order[k]] = fgen_alloc(&place[order[k]].info, place[order[k]].gpio_num);
+        if (res[order[k]] == NULL) {
+            break;
+        }
+        ESP_LOGD(FGEN_TAG,"Planned RMT channel %d, got %d", place[order[k]].channel, res[order[k]]->channel);
+    }
+
+    // All or nothing
+    if (k < n) {
+        for (size_t i = 0; i < n; i++) {
+            if (res[i] != NULL) {
+                fgen_free(res[i]);
+                res[i] = NULL;
+            }
+        }
+        ESP_LOGE(FGEN_TAG,"%s: Could not create the whole set as planned", __FUNCTION__);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_plan_apply(const fgen_plan_req_t* req, size_t n, fgen_resources_t** res)
+{
+    return fgen_plan_apply_over(req, n, NULL, 0, res);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_plan_apply_over(const fgen_plan_req_t* req, size_t n, fgen_resources_t** old, size_t nold, fgen_resources_t** res)
+{
+    esp_err_t ret;
+
+    fgen_lock();
+    ret = fgen_plan_apply_locked(req, n, old, nold, res);
+    fgen_unlock();
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void fgen_free(fgen_resources_t* res)
+{
+    fgen_sweep_t* sweep;
+    fgen_burst_t* burst;
+
+    // Sweep and burst tasks take the lock, so they are stopped without it,
+    // and looked for again once it is back, as another task may start one
+    fgen_lock();
+    while ((res->sweep != NULL && res->sweep->running) || (res->burst != NULL && res->burst->running)) {
+        sweep = res->sweep;
+        burst = res->burst;
+        fgen_unlock();
+        if (sweep != NULL && sweep->running) {
+            fgen_sweep_stop(res);
+        }
+        if (burst != NULL && burst->running) {
+            fgen_burst_stop(res);
+        }
+        fgen_lock();
+    }
+    free(res->sweep);
+    res->sweep = NULL;
+    free(res->burst);
+    res->burst = NULL;
+    fgen_schedule_cancel(res);
+    fgen_release(res);
+    fgen_unlock();
+}
+
+/* -------------------------------------------------------------------------- */
+
+// fgen_start() with the lock taken, as generators are moved with it
+
+static
+esp_err_t fgen_start_locked(fgen_resources_t* res)
+{
+    esp_err_t ret;
+
+    ESP_LOGD(FGEN_TAG, "Starting RMT channel %d on GPIO %d => %0.2f Hz",res->channel, res->gpio_num, res->info.freq);
+    // Left to the burst task, which stops it when done
+    FGEN_CHECK(res->burst == NULL || !res->burst->running, "Generator bursting", ESP_ERR_INVALID_STATE);
+
+    if (res->stream != NULL) {
+        return fgen_stream_start(res);
+    }
+    ret = fgen_preload(res);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // and start
+    return rmt_tx_start(res->channel, true);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_start(fgen_resources_t* res)
+{
+    esp_err_t ret;
+
+    fgen_lock();
+    ret = fgen_start_locked(res);
+    fgen_unlock();
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// fgen_start_group() with the lock taken. The ESP32 RMT cannot start
+// several channels at once, so their RMT_CONF1_CHn registers are written
+// back to back with interrupts disabled, and nothing else in between
+
+static
+esp_err_t fgen_start_group_locked(fgen_resources_t** res, size_t n, uint32_t* window_ns)
+{
+    uint32_t  conf[RMT_CHANNEL_MAX];
+    uint32_t  first, last;
+    esp_err_t ret;
+
+    for (size_t i = 0; i < n; i++) {
+        FGEN_CHECK(res[i]->stream == NULL, "Streamed generators cannot be started together", ESP_ERR_NOT_SUPPORTED);
+        FGEN_CHECK(res[i]->burst == NULL || !res[i]->burst->running, "Generator bursting", ESP_ERR_INVALID_STATE);
+        if (res[i]->info.encoding != res[0]->info.encoding) {
+            ESP_LOGW(FGEN_TAG,"RMT channel %d counts another clock, aligned to a REF_TICK period only", res[i]->channel);
+        }
+    }
+
+    // Stopped and loaded first, so that only the starts remain
+    for (size_t i = 0; i < n; i++) {
+        ESP_LOGD(FGEN_TAG, "Starting RMT channel %d on GPIO %d => %0.2f Hz",res[i]->channel, res[i]->gpio_num, res[i]->info.freq);
+        ret = rmt_tx_stop(res[i]->channel);
+        FGEN_CHECK(ret == ESP_OK, "Error stopping RMT Tx",  ret);
+        ret = fgen_preload(res[i]);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        conf[i] = RMT.conf_ch[res[i]->channel].conf1.val & ~FGEN_CONF1_TX_START;
     }
-    p->val = 0; // mark end of sequence
-    fgen_print_items(res->items, res->info.nitems);
+
+    // Clock dividers reset together, so that the channels tick together
+    portENTER_CRITICAL(&FGEN_GROUP_LOCK);
+    for (size_t i = 0; i < n; i++) {
+        RMT.conf_ch[res[i]->channel].conf1.val = conf[i] | FGEN_CONF1_MEM_RD_RST | FGEN_CONF1_REF_CNT_RST;
+    }
+    for (size_t i = 0; i < n; i++) {
+        RMT.conf_ch[res[i]->channel].conf1.val = conf[i];
+    }
+    first = XTHAL_GET_CCOUNT();
+    for (size_t i = 0; i < n; i++) {
+        RMT.conf_ch[res[i]->channel].conf1.val = conf[i] | FGEN_CONF1_TX_START;
+    }
+    last = XTHAL_GET_CCOUNT();
+    portEXIT_CRITICAL(&FGEN_GROUP_LOCK);
+
+    // The cycle counter is read around the writes, so this bounds the skew
+    if (window_ns != NULL) {
+        *window_ns = (last - first) * 1000 / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    }
+    ESP_LOGD(FGEN_TAG,"%d RMT channels started within %u CPU cycles", n, last - first);
+    return ESP_OK;
 }
+
 /* -------------------------------------------------------------------------- */
 
-static
-esp_err_t fgen_allocate(const fgen_info_t* info, gpio_num_t gpio_num, fgen_resources_t* res)
+esp_err_t fgen_start_group(fgen_resources_t** res, size_t n, uint32_t* window_ns)
 {
     esp_err_t ret;
 
-    res->info = *info;      // copy structure
-   
-    // Allocate a free GPIO pin
-    res->gpio_num   = fgen_gpio_alloc(gpio_num);
-    FGEN_CHECK(res->gpio_num != GPIO_NUM_NC, "No Free GPIO",  ESP_ERR_NO_MEM);
+    FGEN_CHECK(n > 0 && n <= RMT_CHANNEL_MAX, "Wrong number of generators", ESP_ERR_INVALID_ARG);
+    fgen_lock();
+    ret = fgen_start_group_locked(res, n, window_ns);
+    fgen_unlock();
+    return ret;
+}
 
-    res->items      = (rmt_item32_t*) calloc(res->info.nitems, sizeof(rmt_item32_t));
-    FGEN_CHECK(res->items != NULL, "Out of memory allocating RMT items",  ESP_ERR_NO_MEM);
-   
-    // Generate the pattern and repeat it as much as we can within a 64 -item block
-    fgen_waveform(res);
+/* -------------------------------------------------------------------------- */
 
-    // Allocate a free RMT channel
-    res->channel = fgen_channel_alloc(res->info.mem_blocks);
-    FGEN_CHECK(res->channel != -1, "No Free RMT channel",  ESP_ERR_NO_MEM);
+esp_err_t fgen_stop(fgen_resources_t* res)
+{
+    esp_err_t ret;
 
-    // Configure and load the RMT driver
-    rmt_config_t config = {
-        // Common config
-        .channel              = res->channel,
-        .rmt_mode             = RMT_MODE_TX,
-        .gpio_num             = res->gpio_num,
-        .mem_block_num        = res->info.mem_blocks,
-        .clk_div              = res->info.prescaler,
-        // Tx only config
-        .tx_config.loop_en    = true,
-        .tx_config.carrier_en = false
+    fgen_lock();
+    ESP_LOGD(FGEN_TAG, "Stopping RMT channel %d on GPIO %d => %0.2f Hz",res->channel, res->gpio_num, res->info.freq);
+    if (res->burst != NULL && res->burst->running) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        if (res->stream != NULL) {
+            fgen_stream_stop(res);
+        }
+        ret = rmt_tx_stop(res->channel);
+    }
+    fgen_unlock();
+    FGEN_CHECK(ret != ESP_ERR_INVALID_STATE, "Generator bursting, stopped with fgen_burst_stop()", ret);
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_update_info(fgen_resources_t* res, const fgen_info_t* info)
+{
+    esp_err_t ret;
+
+    fgen_lock();
+    ret = fgen_retune(res, info);
+    fgen_unlock();
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Options a generator was created with, as far as its solution tells, read
+// with the lock taken as a retune or a move may be changing it meanwhile.
+// Its phase is kept if none is given
+
+static
+void fgen_options_of(const fgen_resources_t* res, const double* phase, fgen_options_t* opt)
+{
+    fgen_lock();
+    opt->fractional = res->solved.nlong > 0;
+    opt->compensate = res->solved.compensated;
+    opt->min_wrap   = res->info.min_wrap;
+    opt->zero_copy  = res->info.zero_copy;
+    opt->phase      = (phase != NULL) ? *phase : res->info.phase;
+    fgen_unlock();
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Solved as requested with fgen_info_opt(), the other options being those
+// of the generator. Solving is done without the lock
+
+static
+esp_err_t fgen_info_update(const fgen_resources_t* res, double freq, double duty_cycle, const double* phase, fgen_info_t* info)
+{
+    fgen_options_t opt = {
+        .objective  = FGEN_OBJ_ERROR
     };
 
-    ret = rmt_config(&config);
-    FGEN_CHECK(ret == ESP_OK, "Error configure RMT module",  ret);
+    fgen_options_of(res, phase, &opt);
+    return fgen_info_opt(freq, duty_cycle, &opt, info);
+}
 
-    ret = rmt_driver_install(res->channel, NO_RX_BUFFER, DEFAULT_ALLOC_FLAGS);
-    FGEN_CHECK(ret == ESP_OK, "Error installing RMT driver",  ret);
-    ESP_LOGD(FGEN_TAG, "%s: rmt_driver_install() returned ok.", __FUNCTION__ );
+/* -------------------------------------------------------------------------- */
 
-    ret = rmt_tx_stop(res->channel);
-    FGEN_CHECK(ret == ESP_OK, "Error stopping RMT Tx",  ret);
-   
-    // This is a needed hack for Tx looping since the rmt_config does not do it.
-    ret = rmt_set_tx_intr_en(res->channel, false);
-    FGEN_CHECK(ret == ESP_OK, "Error disabling RMT Tx interrupt",  ret);
+static
+esp_err_t fgen_update_solve(fgen_resources_t* res, double freq, double duty_cycle, const double* phase)
+{
+    fgen_info_t info;
+    esp_err_t   ret;
 
-    return ESP_OK;
-    
+    ret = fgen_info_update(res, freq, duty_cycle, phase, &info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return fgen_update_info(res, &info);
 }
 
-/* ************************************************************************* */
-/*                               API FUNCTIONS                               */
-/* ************************************************************************* */
+/* -------------------------------------------------------------------------- */
 
+esp_err_t fgen_update_phase(fgen_resources_t* res, double freq, double duty_cycle, double phase)
+{
+    return fgen_update_solve(res, freq, duty_cycle, &phase);
+}
 
-esp_err_t fgen_info(double freq, double duty_cycle, fgen_info_t* info)
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_update(fgen_resources_t* res, double freq, double duty_cycle)
 {
-    // Decompose Frequency into the product of 2 factors: prescaler and N
-    // Decompose N into NH and NL taking into account dyty cycle
-    fgen_find_freq(freq,  duty_cycle, info);
-    fgen_log_params(freq, duty_cycle, info);
- 
-    // See how many RMT 32-bit items needs this frequency generation
-    // How many channes does it take and how many repetitions withon a channel
-    // to minimize wraparround jitter (1 Tclk delay is introduced by wraparound)
+    return fgen_update_solve(res, freq, duty_cycle, NULL);
+}
 
-    info->jitter     = info->prescaler / FGEN_APB; 
-    info->onitems    = fgen_count_items(info->NH, info->NL);  // without EoTx
-    info->mem_blocks = (info->onitems > 0 ) ? 1 + (info->onitems / 64) : 0;
-    info->nrep       = (info->mem_blocks * 63) / info->onitems;
-    // This is a hack due to a firmware's bug
-    info->nrep       = (info->nrep == 63) ? 62 : info->nrep;
+/* -------------------------------------------------------------------------- */
 
-    FGEN_CHECK(info->mem_blocks <= 8, "Fout needs more than 8 RMT channels",  ESP_ERR_INVALID_SIZE);
-    ESP_LOGD(FGEN_TAG,"Nitems = %d, Mem Blocks = %d", info->onitems, info->mem_blocks);
-    ESP_LOGD(FGEN_TAG,"This sequence can be duplicated %d times + final EoTx (0,0,0,0)",info->nrep);
-    ESP_LOGD(FGEN_TAG,"Loop jitter %.02f (ms)", info->jitter);
+esp_err_t fgen_sweep_start(fgen_resources_t* res, const fgen_sweep_req_t* req)
+{
+    fgen_options_t opt = {
+        .objective  = req->objective,
+        .tol_ppm    = req->tol_ppm
+    };
+    esp_timer_create_args_t timer = {
+        .callback = fgen_sweep_tick,
+        .name     = "fgen_sweep"
+    };
+    fgen_sweep_t* sweep;
+    double        freq;
+    size_t        blocks;
+    esp_err_t     ret = ESP_OK;
 
-    info->nitems     = info->onitems * info->nrep + 1; // global array size including final EoTx
+    FGEN_CHECK(req->steps >= 2 && req->steps <= FGEN_SWEEP_MAX_STEPS, "Sweep steps out of range", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(req->start > 0.0 && req->stop > 0.0, "Sweep frequencies must be positive", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(req->dwell_us >= FGEN_SWEEP_MIN_DWELL_US, "Sweep dwell time too short", ESP_ERR_INVALID_ARG);
+
+    // What the steps are solved for, as the generator is now
+    fgen_lock();
+    if (res->stream != NULL || res->pattern != NULL) {
+        ret = ESP_ERR_NOT_SUPPORTED;
+    } else if ((res->sweep != NULL && res->sweep->running) || (res->burst != NULL && res->burst->running)) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    fgen_options_of(res, NULL, &opt);
+    blocks = res->info.mem_blocks;
+    fgen_unlock();
+    FGEN_CHECK(ret != ESP_ERR_NOT_SUPPORTED, "Streams and patterns cannot be swept", ret);
+    FGEN_CHECK(ret == ESP_OK, "Generator already sweeping or bursting", ret);
+
+    sweep = (fgen_sweep_t*) calloc(1, sizeof(fgen_sweep_t));
+    FGEN_CHECK(sweep != NULL, "Out of memory allocating sweep", ESP_ERR_NO_MEM);
+    sweep->steps = (fgen_info_t*) malloc(req->steps * sizeof(fgen_info_t));
+    if (sweep->steps == NULL) {
+        free(sweep);
+        ESP_LOGE(FGEN_TAG,"%s: Out of memory solving %u steps", __FUNCTION__, req->steps);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Solving takes far longer than retuning, so it is all done here
+    for (uint32_t k = 0; k < req->steps; k++) {
+        freq = (req->logscale) ? req->start * pow(req->stop / req->start, k / (req->steps - 1.0))
+                               : req->start + (req->stop - req->start) * k / (req->steps - 1.0);
+        ret  = fgen_info_opt(freq, req->duty_cycle, &opt, &sweep->steps[k]);
+        if (ret == ESP_OK && (sweep->steps[k].streaming || sweep->steps[k].mem_blocks > blocks)) {
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(FGEN_TAG,"%s: Step %u, %0.3f Hz, unsolved or not fitting in %d RMT blocks", __FUNCTION__, k, freq, blocks);
+            free(sweep->steps);
+            free(sweep);
+            return ret;
+        }
+    }
+
+    sweep->res            = res;
+    sweep->running        = true;
+    sweep->stats.total    = req->steps;
+    sweep->stats.dwell_us = req->dwell_us;
+    timer.arg             = sweep;
+
+    // Checked again, as another task may have started one while solving
+    fgen_lock();
+    if ((res->sweep != NULL && res->sweep->running) || (res->burst != NULL && res->burst->running)) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        ret = esp_timer_create(&timer, &sweep->timer);
+        if (ret == ESP_OK && xTaskCreatePinnedToCore(fgen_sweep_task, "fgen_sweep", FGEN_SWEEP_STACK, sweep, 
+                                                     FGEN_SWEEP_PRIO, &sweep->task, FGEN_SWEEP_CPU) != pdPASS) {
+            esp_timer_delete(sweep->timer);
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+    if (ret == ESP_OK) {
+        free(res->sweep);
+        res->sweep = sweep;
+    }
+    fgen_unlock();
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(FGEN_TAG,"%s: Generator sweeping or bursting, or error creating sweep timer or task", __FUNCTION__);
+        free(sweep->steps);
+        free(sweep);
+        return ret;
+    }
     return ESP_OK;
 }
 
 /* -------------------------------------------------------------------------- */
 
-fgen_resources_t* fgen_alloc(const fgen_info_t* info, gpio_num_t gpio_num)
+esp_err_t fgen_sweep_stop(fgen_resources_t* res)
 {
-    fgen_resources_t* resources;
-    esp_err_t ret;
+    fgen_sweep_t* sweep;
+    bool          running;
+
+    // The sweep is only looked at with the lock taken, as it is freed with it
+    // once replaced, and its task waited for without it, as it takes it too
+    fgen_lock();
+    sweep   = res->sweep;
+    running = sweep != NULL && sweep->running;
+    if (running) {
+        sweep->abort = true;
+        xTaskNotifyGive(sweep->task);
+    }
+    fgen_unlock();
+    FGEN_CHECK(running, "Generator not sweeping", ESP_ERR_INVALID_STATE);
+
+    while (running) {
+        vTaskDelay(1);
+        fgen_lock();
+        running = res->sweep == sweep && sweep->running;
+        fgen_unlock();
+    }
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_sweep_stats(const fgen_resources_t* res, fgen_sweep_stats_t* stats)
+{
+    const fgen_sweep_t* sweep;
+
+    fgen_lock();
+    sweep = res->sweep;
+    if (sweep != NULL) {
+        *stats = sweep->stats;
+        stats->running          = sweep->running;
+        stats->dwell_err_avg_us = (sweep->dwells > 0) ? sweep->err_sum / sweep->dwells : 0.0;
+        if (stats->running) {
+            stats->elapsed_us = esp_timer_get_time() - sweep->first;
+        }
+    }
+    fgen_unlock();
+    FGEN_CHECK(sweep != NULL, "Generator never swept", ESP_ERR_INVALID_STATE);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_burst_start(fgen_resources_t* res, uint64_t periods, TaskHandle_t notify)
+{
+    extern rmt_mem_t RMTMEM;
+    esp_timer_create_args_t timer = {
+        .callback = fgen_burst_tick,
+        .name     = "fgen_burst"
+    };
+    volatile rmt_item32_t* ram;
+    fgen_burst_t* burst;
+    esp_err_t     ret;
+
+    FGEN_CHECK(periods > 0, "Burst of no periods", ESP_ERR_INVALID_ARG);
 
-    resources = (fgen_resources_t*) calloc(1, sizeof(fgen_resources_t));
-    FGEN_CHECK(resources != NULL, "Out of memory allocating Resources RAM",  NULL); 
+    burst = (fgen_burst_t*) calloc(1, sizeof(fgen_burst_t));
+    FGEN_CHECK(burst != NULL, "Out of memory allocating burst", ESP_ERR_NO_MEM);
+    burst->notify  = notify;
+    burst->running = true;
+    timer.arg      = burst;
 
-    ret = fgen_allocate(info, gpio_num, resources);
+    // All checked with the lock taken, as another task may start one
+    // meanwhile. The task waits to be let go, as it runs above the caller
+    fgen_lock();
+    if (res->stream != NULL || res->pattern != NULL || res->info.phase_ticks != 0) {
+        ret = ESP_ERR_NOT_SUPPORTED;
+    } else if ((res->burst != NULL && res->burst->running) || (res->sweep != NULL && res->sweep->running)) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        burst->res = res;
+        fgen_burst_plan(burst, periods);
+        ret = esp_timer_create(&timer, &burst->timer);
+        if (ret == ESP_OK && xTaskCreatePinnedToCore(fgen_burst_task, "fgen_burst", FGEN_BURST_STACK, burst, 
+                                                     FGEN_BURST_PRIO, &burst->task, FGEN_BURST_CPU) != pdPASS) {
+            esp_timer_delete(burst->timer);
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
     if (ret != ESP_OK) {
-        free(resources);
-        return NULL;
+        fgen_unlock();
+        free(burst);
+        FGEN_CHECK(ret != ESP_ERR_NOT_SUPPORTED, "Streams, patterns and phased generators cannot burst", ret);
+        FGEN_CHECK(ret != ESP_ERR_INVALID_STATE, "Generator already bursting or sweeping", ret);
+        ESP_LOGE(FGEN_TAG,"%s: Error creating burst timer or task", __FUNCTION__);
+        return ret;
     }
-    return resources;
+    free(res->burst);
+    res->burst = burst;
+
+    if (!FGEN_BURST_CALLBACK) {
+        rmt_register_tx_end_callback(fgen_burst_end, NULL);
+        FGEN_BURST_CALLBACK = true;
+    }
+    // On the channel it has now, as it may have been moved before the lock was taken
+    ram = (volatile rmt_item32_t*) &RMTMEM.chan[res->channel].data32[0];
+    ret = rmt_tx_stop(res->channel);
+    if (ret == ESP_OK) {
+        ret = fgen_preload(res);
+    }
+    // A single loop is shortened before it starts, ending a one-shot transmission
+    if (ret == ESP_OK && burst->stats.loops == 0) {
+        ram[burst->eotx - 1].val = burst->low.val;
+        ram[burst->eotx].val     = 0;
+        ret = rmt_set_tx_loop_mode(res->channel, false);
+        RMT.int_clr.val = FGEN_TX_END_INT(res->channel);
+    }
+    if (ret == ESP_OK && burst->stats.loops == 0) {
+        ret = rmt_set_tx_intr_en(res->channel, true);
+    }
+    // Loops are timed from the start on
+    if (ret == ESP_OK) {
+        portENTER_CRITICAL(&FGEN_RETUNE_LOCK);
+        ret = rmt_tx_start(res->channel, true);
+        burst->started = esp_timer_get_time();
+        portEXIT_CRITICAL(&FGEN_RETUNE_LOCK);
+    }
+    fgen_unlock();
+
+    // Left to the task to clean up, telling no one
+    if (ret != ESP_OK) {
+        ESP_LOGE(FGEN_TAG,"%s: Error starting RMT channel %d", __FUNCTION__, res->channel);
+        burst->notify = NULL;
+        burst->abort  = true;
+    }
+    xTaskNotifyGive(burst->task);
+    return ret;
 }
 
 /* -------------------------------------------------------------------------- */
 
-void fgen_free(fgen_resources_t* res)
+esp_err_t fgen_burst_stop(fgen_resources_t* res)
 {
-    fgen_channel_free(res->channel);
-    fgen_gpio_free(res->gpio_num);
-    ESP_ERROR_CHECK( rmt_driver_uninstall(res->channel) );
-    free(res->items);
-    free(res);
+    fgen_burst_t* burst;
+    bool          running;
+
+    // As fgen_sweep_stop() does
+    fgen_lock();
+    burst   = res->burst;
+    running = burst != NULL && burst->running;
+    if (running) {
+        burst->abort = true;
+        xTaskNotifyGive(burst->task);
+    }
+    fgen_unlock();
+    FGEN_CHECK(running, "Generator not bursting", ESP_ERR_INVALID_STATE);
+
+    while (running) {
+        vTaskDelay(1);
+        fgen_lock();
+        running = res->burst == burst && burst->running;
+        fgen_unlock();
+    }
+    return ESP_OK;
 }
 
 /* -------------------------------------------------------------------------- */
 
-esp_err_t fgen_start(fgen_resources_t* res)
+esp_err_t fgen_burst_stats(const fgen_resources_t* res, fgen_burst_stats_t* stats)
 {
-    esp_err_t ret;
+    const fgen_burst_t* burst;
 
-    ESP_LOGD(FGEN_TAG, "Starting RMT channel %d on GPIO %d => %0.2f Hz",res->channel, res->gpio_num, res->info.freq);
+    fgen_lock();
+    burst = res->burst;
+    if (burst != NULL) {
+        *stats = burst->stats;
+        stats->running = burst->running;
+        if (stats->running) {
+            stats->elapsed_us = esp_timer_get_time() - burst->started;
+        }
+    }
+    fgen_unlock();
+    FGEN_CHECK(burst != NULL, "No burst sent yet", ESP_ERR_INVALID_STATE);
+    return ESP_OK;
+}
 
-    // Copy the generated pattern we've just generated to the internal RMT buffers
-    // The rmt_tx_stop places an EoTx in the beginning of the RMT memory buffer
-    ret = rmt_fill_tx_items(res->channel, res->items, res->info.nitems, 0);
-    FGEN_CHECK(ret == ESP_OK, "Error copying RMT items to shared mem",  ret);
+/* -------------------------------------------------------------------------- */
 
-    // and start
-    return rmt_tx_start(res->channel, true);
+esp_err_t fgen_schedule(fgen_resources_t* res, fgen_event_t event, int64_t at_us, const fgen_info_t* info)
+{
+    esp_timer_create_args_t timer = {
+        .callback = fgen_sched_tick,
+        .name     = "fgen_sched"
+    };
+    fgen_info_t* copy = NULL;
+    esp_err_t    ret  = ESP_OK;
+    size_t       i;
+
+    FGEN_CHECK(event <= FGEN_EVENT_RETUNE, "Unknown event", ESP_ERR_INVALID_ARG);
+    FGEN_CHECK(at_us - esp_timer_get_time() >= FGEN_SCHED_MIN_US, "Event scheduled too soon", ESP_ERR_INVALID_ARG);
+    if (event == FGEN_EVENT_RETUNE) {
+        FGEN_CHECK(info != NULL, "Retune with no solution", ESP_ERR_INVALID_ARG);
+        FGEN_CHECK(!info->streaming, "Patterns and streams cannot be retuned", ESP_ERR_NOT_SUPPORTED);
+        copy = (fgen_info_t*) malloc(sizeof(fgen_info_t));
+        FGEN_CHECK(copy != NULL, "Out of memory scheduling retune", ESP_ERR_NO_MEM);
+        *copy = *info;
+    }
+
+    // The generator is looked at with the lock taken, as it may be retuned meanwhile
+    fgen_lock();
+    if (res->stream != NULL || (event == FGEN_EVENT_RETUNE && res->pattern != NULL)) {
+        ret = ESP_ERR_NOT_SUPPORTED;
+    } else if (event == FGEN_EVENT_RETUNE && copy->mem_blocks > res->info.mem_blocks) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if (ret == ESP_OK && FGEN_SCHED_TASK == NULL) {
+        ret = esp_timer_create(&timer, &FGEN_SCHED_TIMER);
+        if (ret == ESP_OK && xTaskCreatePinnedToCore(fgen_sched_task, "fgen_sched", FGEN_SCHED_STACK, NULL,
+                                                     FGEN_SCHED_PRIO, &FGEN_SCHED_TASK, FGEN_SCHED_CPU) != pdPASS) {
+            esp_timer_delete(FGEN_SCHED_TIMER);
+            FGEN_SCHED_TASK = NULL;
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+    if (ret == ESP_OK && FGEN_SCHED_N == FGEN_SCHED_MAX) {
+        ret = ESP_ERR_NO_MEM;
+    }
+    // After those due at the same time, so that they run in the given order
+    if (ret == ESP_OK) {
+        for (i = FGEN_SCHED_N; i > 0 && FGEN_SCHED[i - 1].at > at_us; i--) {
+            FGEN_SCHED[i] = FGEN_SCHED[i - 1];
+        }
+        memset(&FGEN_SCHED[i], 0, sizeof(fgen_sched_t));
+        FGEN_SCHED[i].res   = res;
+        FGEN_SCHED[i].event = event;
+        FGEN_SCHED[i].at    = at_us;
+        FGEN_SCHED[i].info  = copy;
+        FGEN_SCHED_N       += 1;
+        if (i == 0) {
+            fgen_sched_arm();
+        }
+    }
+    fgen_unlock();
+
+    if (ret != ESP_OK) {
+        free(copy);
+        FGEN_CHECK(ret != ESP_ERR_NOT_SUPPORTED, "Streams cannot be scheduled, nor patterns retuned", ret);
+        FGEN_CHECK(ret != ESP_ERR_INVALID_SIZE, "More RMT blocks needed than held", ret);
+        ESP_LOGE(FGEN_TAG,"%s: No scheduler task or %d events pending already", __FUNCTION__, FGEN_SCHED_MAX);
+    }
+    return ret;
 }
 
 /* -------------------------------------------------------------------------- */
 
-esp_err_t fgen_stop(fgen_resources_t* res)
+esp_err_t fgen_schedule_update(fgen_resources_t* res, int64_t at_us, double freq, double duty_cycle)
 {
-    ESP_LOGD(FGEN_TAG, "Stopping RMT channel %d on GPIO %d => %0.2f Hz",res->channel, res->gpio_num, res->info.freq);
-    return rmt_tx_stop(res->channel);
+    fgen_info_t info;
+    esp_err_t   ret;
+
+    ret = fgen_info_update(res, freq, duty_cycle, NULL, &info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return fgen_schedule(res, FGEN_EVENT_RETUNE, at_us, &info);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_schedule_cancel(fgen_resources_t* res)
+{
+    size_t n = 0;
+
+    fgen_lock();
+    for (size_t i = 0; i < FGEN_SCHED_N; i++) {
+        if (res == NULL || FGEN_SCHED[i].res == res) {
+            free(FGEN_SCHED[i].info);
+        } else {
+            FGEN_SCHED[n++] = FGEN_SCHED[i];
+        }
+    }
+    FGEN_SCHED_N = n;
+    // Those being run are left to the scheduler task, to be failed
+    for (size_t i = 0; i < FGEN_SCHED_RUN_N; i++) {
+        if (res == NULL || FGEN_SCHED_RUN[i].res == res) {
+            FGEN_SCHED_RUN[i].res = NULL;
+        }
+    }
+    if (FGEN_SCHED_TASK != NULL) {
+        fgen_sched_arm();
+    }
+    fgen_unlock();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void fgen_schedule_stats(fgen_schedule_stats_t* stats)
+{
+    uint32_t ok;
+
+    // Updated by the scheduler task with the lock taken
+    fgen_lock();
+    *stats = FGEN_SCHED_STATS;
+    ok     = stats->done - stats->failed;
+    stats->pending    = FGEN_SCHED_N;
+    stats->err_avg_us = (ok > 0) ? FGEN_SCHED_ERR_SUM / ok : 0.0;
+    fgen_unlock();
 }
 
 /* -------------------------------------------------------------------------- */
@@ -606,13 +4767,97 @@ static esp_err_t rmt_tx_get_state(rmt_channel_t channel, uint32_t* state)
 }
 #endif
 
+esp_err_t fgen_stream_stats(const fgen_resources_t* res, fgen_stream_stats_t* stats)
+{
+    const fgen_stream_t* stream = res->stream;
+    uint64_t cycles;
+    int64_t  elapsed;
+
+    FGEN_CHECK(stream != NULL, "Not a streaming frequency generator", ESP_ERR_INVALID_ARG);
+
+    portENTER_CRITICAL(&FGEN_STREAM_LOCK);
+    stats->refills = stream->refills;
+    cycles         = stream->cycles;
+    portEXIT_CRITICAL(&FGEN_STREAM_LOCK);
+
+    // Time spent in the ISR outside fgen_stream_copy() is not accounted for
+    elapsed = ((stream->stopped) ? stream->stopped : esp_timer_get_time()) - stream->started;
+    stats->cycles = (stats->refills) ? cycles / stats->refills : 0;
+    stats->load   = (stream->started && elapsed > 0) ? cycles / ((double) elapsed * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ) : 0.0;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+size_t fgen_heap_size(const fgen_resources_t* res)
+{
+    size_t size = 0;
+
+    fgen_lock();
+    if (res->info.nitems > FGEN_SLOT_ITEMS) {
+        size += res->info.nitems * sizeof(rmt_item32_t);
+    }
+    if (res->pattern != NULL) {
+        size += sizeof(fgen_pattern_t) + res->pattern->nruns * sizeof(fgen_run_t);
+    }
+    if (res->sweep != NULL) {
+        size += sizeof(fgen_sweep_t) + ((res->sweep->steps != NULL) ? res->sweep->stats.total * sizeof(fgen_info_t) : 0);
+    }
+    if (res->burst != NULL) {
+        size += sizeof(fgen_burst_t);
+    }
+    fgen_unlock();
+    return size;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void fgen_arena_stats(size_t* size, size_t* free_slots)
+{
+    *size       = sizeof(FGEN_SLOTS);
+    *free_slots = 0;
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        *free_slots += !FGEN_SLOTS[i].used;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fgen_gpio_pool_set(const gpio_num_t* pins, size_t n)
+{
+    esp_err_t ret;
+
+    fgen_lock();
+    ret = fgen_gpio_pool_set_locked(pins, n);
+    fgen_unlock();
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+size_t fgen_gpio_pool_get(fgen_gpio_t* pool)
+{
+    size_t n;
+
+    fgen_lock();
+    fgen_gpio_pool_init();
+    memcpy(pool, FREQ_GPIO, FREQ_GPIO_NUM * sizeof(fgen_gpio_t));
+    n = FREQ_GPIO_NUM;
+    fgen_unlock();
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+
 rmt_channel_status_t fgen_get_state(const fgen_resources_t* res)
 {
-    uint32_t state;
+    // Read once, as it changes if the generator is moved meanwhile
+    rmt_channel_t channel = res->channel;
+    uint32_t      state;
 
-    rmt_tx_get_state(res->channel, &state);
+    rmt_tx_get_state(channel, &state);
 
-    ESP_LOGD(FGEN_TAG, "Getting state of RMT channel %d returned %d", res->channel, state);
+    ESP_LOGD(FGEN_TAG, "Getting state of RMT channel %d returned %d", channel, state);
     return state ? RMT_CHANNEL_BUSY : RMT_CHANNEL_IDLE;
 }
 
@@ -18,6 +18,8 @@ extern "C" {
 // Expressif SDK-IDF standard includes
 // -----------------------------------
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <driver/gpio.h>
 #include <driver/rmt.h>
 
@@ -25,31 +27,229 @@ extern "C" {
 /*                      DEFINES AND ENUMERATIONS SECTION                     */
 /* ************************************************************************* */
 
+// What the solver optimizes among the solutions within the error tolerance
+typedef enum {
+    FGEN_OBJ_ERROR,     // lowest frequency error (tolerance not used)
+    FGEN_OBJ_BLOCKS,    // fewest RMT memory blocks
+    FGEN_OBJ_JITTER,    // lowest wraparound jitter, i.e. lowest prescaler
+} fgen_objective_t;
+
+// Clock counted by the RMT items. REF_TICK periods are 80 times longer,
+// so very low frequencies fit in far fewer items
+typedef enum {
+    FGEN_ENC_APB,       // 80 MHz APB clock, the finest tick
+    FGEN_ENC_REF_TICK,  // 1 MHz REF_TICK clock, for long periods
+} fgen_encoding_t;
+
+// What a scheduled event does to its generator, see fgen_schedule()
+typedef enum {
+    FGEN_EVENT_START,   // starts it, or restarts it if running
+    FGEN_EVENT_STOP,
+    FGEN_EVENT_RETUNE,  // retunes it in place, as fgen_update_info() does
+} fgen_event_t;
 
 /* ************************************************************************* */
 /*                               DATATYPES SECTION                           */
 /* ************************************************************************* */
 
 typedef struct {
-    double        freq;       // real frequency after adjustment (Hz)
-    double        duty_cycle; // duty cycle after adjustments (0 < x < 1)
+    double        freq;       // real frequency after adjustment (Hz), averaged over nrep periods
+    double        duty_cycle; // duty cycle after adjustments (0 < x < 1), averaged as well
     double        jitter;     // jitter due to wraparound delay (secs)
+    double        phase_err;  // peak edge deviation from a clock at the average frequency (secs)
+    uint64_t      freq_mhz;   // real frequency after adjustment (mHz, rounded)
+    uint32_t      duty_ppm;   // duty cycle after adjustments (ppm, rounded)
+    int32_t       freq_err;   // frequency error relative to the requested one (ppm)
+    int32_t       duty_err;   // duty cycle error relative to the requested one (ppm)
     size_t        onitems;    // original items sequence length without duplication nor  EoTx
     size_t        nitems;     // number of RMT items including duplication and EoTx mark
-    uint8_t       nrep;       // how many times the items sequence is being repeated (1 < nrep)
+    uint16_t      nrep;       // how many times the items sequence is being repeated (1 < nrep)
     uint8_t       mem_blocks; // number of memory blocks consumed (1 block = 64 RMT items)
     uint8_t       prescaler;  // RMT prescaler value
     uint32_t      N;          // Big divisor to decompose in items (internal value)
     uint32_t      NH;         // The high level part of N (N = NH + NL)
     uint32_t      NL;         // The low level part of N  (N = NH + NL)
+    uint16_t      nlong;      // periods out of nrep lasting N+1 ticks, one more low tick (fractional mode)
+    fgen_encoding_t encoding; // RMT source clock the prescaler divides
+    bool          streaming;  // items streamed from RAM through a single RMT block, no wraparound
+    double        refill_rate;// half block refills per second when streaming
+    bool          compensated;// loop idle tick taken out of the last period
+    double        loop_freq;  // long run frequency, loop idle tick included (Hz)
+    int32_t       loop_err;   // its error relative to the requested one (ppm)
+    bool          min_wrap;   // repetitions to be spread over spare RMT blocks when allocated
+    bool          zero_copy;  // items written straight into RMT RAM, not copied on every start
+    uint32_t      phase_ticks;// loop started that many ticks late, relative to a group start
+    double        phase;      // achieved phase delay (degrees)
+    double        phase_res;  // phase step, one tick (degrees)
 } fgen_info_t;
 
 
 typedef struct {
-    rmt_item32_t* items;      // Array of RMT items including EoTx
+    double        freq;       // requested frequency (Hz)
+    double        duty_cycle; // requested duty cycle (0 < x < 1)
+} fgen_request_t;
+
+
+typedef struct {
+    fgen_objective_t objective; // what to optimize
+    uint32_t         tol_ppm;   // frequency error allowed while doing so (ppm)
+    bool             fractional;// alternate N and N+1 tick periods for a better average frequency
+    uint32_t         freq_weight; // with a non zero duty_weight, FGEN_OBJ_ERROR minimizes
+    uint32_t         duty_weight; // freq_weight * |freq. error| + duty_weight * |duty error|
+    bool             streaming; // stream the items instead of looping over them in RMT RAM
+    bool             compensate;// take the loop idle tick out of the last period
+    bool             min_wrap;  // spread the repetitions over spare RMT blocks, given back on demand
+    bool             zero_copy; // write the items straight into RMT RAM instead of copying them on start
+    double           phase;     // delay relative to generators started together (degrees, 0 <= x < 360)
+} fgen_options_t;
+
+
+// A GPIO pin of the pool given to generators created without one
+typedef struct {
+    gpio_num_t gpio_num;    // GPIO number
+    bool       allocated;   // GPIO resource status (allocated to frequency generator or free)
+} fgen_gpio_t;
+
+
+// One generator of a set placed as a whole, see fgen_plan()
+typedef struct {
+    double        freq;       // requested frequency (Hz)
+    double        duty_cycle; // requested duty cycle (0 < x < 1)
+    gpio_num_t    gpio_num;   // GPIO_NUM_NC to take one from the pool
+} fgen_plan_req_t;
+
+
+// Where fgen_plan() places a generator of the set, or why it cannot
+typedef struct {
+    fgen_info_t   info;       // its solution
+    esp_err_t     status;     // ESP_OK, or why it cannot be solved or given its GPIO
+    rmt_channel_t channel;    // RMT channel it takes, -1 if none
+    gpio_num_t    gpio_num;   // GPIO pin it takes, GPIO_NUM_NC if none
+} fgen_placement_t;
+
+
+typedef struct {
+    size_t        blocks;     // RMT blocks needed by the whole set
+    size_t        free_blocks;// RMT blocks free, spare ones lent to spread generators included
+    size_t        free_slots; // generators that can still be created
+    size_t        free_gpios; // pool GPIO pins left for the set
+    bool          give_back;  // spread generators give their spare blocks back first
+    bool          compact;    // existing generators are moved first, see fgen_alloc()
+} fgen_plan_t;
+
+
+// One segment of a custom pulse pattern, see fgen_pattern_alloc()
+typedef struct {
+    uint64_t      duration_ns;// segment length (ns)
+    uint32_t      level;      // output level, 0 or 1
+} fgen_segment_t;
+
+
+typedef struct {
+    uint32_t      hits;       // fgen_info() calls answered from the cache
+    uint32_t      misses;     // fgen_info() calls that had to run the solver
+    uint32_t      evictions;  // solutions dropped to make room for new ones
+    size_t        entries;    // solutions currently held
+    size_t        size;       // maximum number of solutions held
+} fgen_cache_stats_t;
+
+
+typedef struct {
+    uint32_t      refills;    // half block refills since the generator was started
+    uint32_t      cycles;     // average CPU cycles per refill
+    double        load;       // fraction of one CPU time spent refilling
+} fgen_stream_stats_t;
+
+
+// How the last fgen_update() of a generator went
+typedef struct {
+    uint32_t      latency_us; // from the call to the new items taking over, waiting included
+    bool          seamless;   // switched at a loop boundary or stopped, or else paused for a moment
+} fgen_retune_t;
+
+
+// A generator stepped through frequencies, see fgen_sweep_start()
+typedef struct {
+    double        start;      // first frequency (Hz)
+    double        stop;       // last frequency (Hz), above or below the first one
+    double        duty_cycle; // kept all along (0 < x < 1)
+    uint32_t      steps;      // frequencies, both ends included (2 or more)
+    uint32_t      dwell_us;   // time spent at each of them
+    bool          logscale;   // geometric instead of arithmetic steps
+    fgen_objective_t objective; // how every step is solved, see fgen_options_t
+    uint32_t      tol_ppm;
+} fgen_sweep_req_t;
+
+
+typedef struct {
+    uint32_t      total;      // steps in the sweep
+    uint32_t      steps;      // steps taken so far
+    uint32_t      seamless;   // of them switched at a loop boundary or while stopped
+    uint32_t      failed;     // of them that could not be retuned
+    uint32_t      overruns;   // dwell times over before the step ending them was taken
+    uint32_t      dwell_us;   // requested dwell time
+    uint32_t      dwell_err_max_us; // worst achieved dwell time error
+    double        dwell_err_avg_us; // mean absolute one
+    uint32_t      latency_max_us;   // slowest retune, waiting for a loop boundary included
+    int64_t       elapsed_us; // from the first step taking over to the end of the last one
+    bool          running;
+} fgen_sweep_stats_t;
+
+
+// How a counted burst went, see fgen_burst_start()
+typedef struct {
+    uint64_t      periods;    // requested periods
+    uint64_t      loops;      // whole loops sent before the last, shortened one
+    uint32_t      last;       // periods in that last loop
+    uint32_t      slack_us;   // least time left before the RMT reached the items being changed
+    int64_t       elapsed_us; // from the start to the end of transmission
+    bool          exact;      // ended by itself after all the periods
+    bool          running;
+} fgen_burst_stats_t;
+
+
+// Events scheduled and run so far. The error is the time of the register
+// write, or of the new items taking over for retunes, minus the
+// scheduled one, both in esp_timer time
+typedef struct {
+    uint32_t      pending;    // events waiting to be run
+    uint32_t      done;       // events run
+    uint32_t      failed;     // of them whose start, stop or retune failed
+    int32_t       err_min_us;
+    int32_t       err_max_us;
+    double        err_avg_us; // mean absolute error
+} fgen_schedule_stats_t;
+
+
+// Streaming state shared with the refill ISR
+typedef struct fgen_stream_s fgen_stream_t;
+
+
+// Sweep state shared with the task stepping it
+typedef struct fgen_sweep_s fgen_sweep_t;
+
+
+// Burst state shared with the task ending it
+typedef struct fgen_burst_s fgen_burst_t;
+
+
+// Custom pulse pattern in ticks of the chosen clock
+typedef struct fgen_pattern_s fgen_pattern_t;
+
+
+typedef struct {
+    rmt_item32_t* items;      // Array of RMT items including EoTx (no EoTx when streaming), in RMT RAM if zero_copy
     gpio_num_t    gpio_num;   // Allocated GPIO pin for this frequency generator
     rmt_channel_t channel;    // Allocated RMT channel
     fgen_info_t   info;       // detailed info about the frequency generator
+    fgen_stream_t* stream;    // NULL unless info.streaming
+    fgen_info_t   solved;     // info before spreading over spare RMT blocks
+    fgen_pattern_t* pattern;  // NULL unless allocated by fgen_pattern_alloc()
+    rmt_channel_t handle;     // channel number shown to users, kept when moved to another RMT channel
+    rmt_item32_t  head;       // first item if zero_copy, as every stop overwrites it in RMT RAM
+    fgen_retune_t retune;     // last fgen_update(), if any
+    fgen_sweep_t* sweep;      // last sweep, NULL if never swept
+    fgen_burst_t* burst;      // last burst, NULL if none yet
 } fgen_resources_t;
 
 
@@ -64,18 +264,185 @@ typedef struct {
 /*                               API FUNCTIONS                               */
 /* ************************************************************************* */
 
+// Any task can call these. Those creating, freeing, starting, stopping or
+// planning generators, or setting the GPIO pool, are serialized by a mutex.
+// fgen_info() and its variants, fgen_get_state() and the statistics take
+// no lock, but a generator must not be freed while they look at it.
+
 esp_err_t fgen_info(double freq, double duty_cycle, fgen_info_t* info);
 
+// Exact, integer only variants: frequency given in mHz or as num/den Hz
+// and duty cycle in parts per million
+esp_err_t fgen_info_mhz(uint64_t freq_mhz, uint32_t duty_ppm, fgen_info_t* info);
+
+esp_err_t fgen_info_ratio(uint64_t num, uint64_t den, uint32_t duty_ppm, fgen_info_t* info);
+
+// Same as above, optimizing for opt->objective within opt->tol_ppm.
+// A NULL opt gives the lowest frequency error, as the plain variants do.
+esp_err_t fgen_info_opt(double freq, double duty_cycle, const fgen_options_t* opt, fgen_info_t* info);
+
+esp_err_t fgen_info_ratio_opt(uint64_t num, uint64_t den, uint32_t duty_ppm, const fgen_options_t* opt, fgen_info_t* info);
+
+// Pareto set of (frequency error, memory blocks, jitter) solutions within
+// tol_ppm, sorted by increasing error. *n is the set capacity on input
+// and the number of solutions found on output.
+esp_err_t fgen_info_pareto(double freq, double duty_cycle, uint32_t tol_ppm, fgen_info_t* set, size_t* n);
+
+// Solves n requests as fgen_info() does, with the same results. Requests
+// close enough in period, as in a sweep over a narrow or high frequency
+// range, share the divisor tables built for them once, which makes them
+// cheaper to solve at once than one by one.
+// Per request results are left in info[] and, if not NULL, status[].
+// Returns the error of the first failed request, if any.
+esp_err_t fgen_info_batch(const fgen_request_t* req, size_t n, fgen_info_t* info, esp_err_t* status);
+
+// Solution cache used by all fgen_info() variants
+void fgen_cache_stats(fgen_cache_stats_t* stats);
+
+void fgen_cache_clear();
+
 fgen_resources_t* fgen_alloc(const fgen_info_t* info, gpio_num_t gpio_num);
 
+// Custom pulse patterns of n segments, looped over. In the info, N is the
+// pattern length in ticks, NH its high part, freq its repetition rate,
+// phase_err the peak edge rounding error and compensated tells whether it
+// loops without a gap. Freed with fgen_free().
+esp_err_t fgen_pattern_info(const fgen_segment_t* seg, size_t n, fgen_info_t* info);
+
+fgen_resources_t* fgen_pattern_alloc(const fgen_segment_t* seg, size_t n, gpio_num_t gpio_num);
+
 void fgen_free(fgen_resources_t* res);
 
+// Plans where a whole set of n generators would go, alongside the
+// existing ones, whatever their order. Nothing is changed. On failure,
+// the entries whose status is not ESP_OK, or else the plan figures,
+// tell why. fgen_plan_apply() creates them all as planned or none,
+// leaving them in res[].
+esp_err_t fgen_plan(const fgen_plan_req_t* req, size_t n, fgen_placement_t* place, fgen_plan_t* plan);
+
+esp_err_t fgen_plan_apply(const fgen_plan_req_t* req, size_t n, fgen_resources_t** res);
+
+// fgen_plan_apply() in place of the nold generators in old[]. The set is
+// planned as if they were freed, and they are stopped and freed only once
+// it fits as a whole, so that they are left as they were otherwise. They
+// must not be sweeping nor bursting.
+esp_err_t fgen_plan_apply_over(const fgen_plan_req_t* req, size_t n, fgen_resources_t** old, size_t nold, fgen_resources_t** res);
+
+// fgen_start(), fgen_stop() and fgen_start_group() return
+// ESP_ERR_INVALID_STATE for a generator sending a burst, which ends by
+// itself or with fgen_burst_stop().
 esp_err_t fgen_start(fgen_resources_t* res);
 
+// Starts n generators together, running or not, their outputs aligned
+// within a few APB clock cycles. They are all stopped and loaded first,
+// their clock dividers reset, and then started one right after the other
+// with interrupts disabled, as the ESP32 RMT has no simultaneous start.
+// window_ns, if not NULL, gets the start window: the CPU cycles taken by
+// the start writes, read before the first and after the last one. It is
+// an upper bound on the time between the first and last start, not a
+// measure of the outputs. Streamed generators cannot be started this way.
+esp_err_t fgen_start_group(fgen_resources_t** res, size_t n, uint32_t* window_ns);
+
 esp_err_t fgen_stop(fgen_resources_t* res);
 
+// Retunes a generator in place, on the same RMT channel and blocks and
+// without reinstalling the driver, solving with the options it was created
+// with. A running one switches at a loop boundary if its clock divider
+// stays the same and its loop is short enough to wait for, otherwise it
+// pauses for a few microseconds. Solutions needing fewer blocks keep the
+// spare ones, given back when needed. Streamed generators and patterns
+// cannot be retuned. fgen_update_info() takes a solution at hand, such as
+// one computed beforehand. fgen_update() keeps the phase it was given,
+// fgen_update_phase() sets a new one.
+esp_err_t fgen_update(fgen_resources_t* res, double freq, double duty_cycle);
+
+esp_err_t fgen_update_phase(fgen_resources_t* res, double freq, double duty_cycle, double phase);
+
+esp_err_t fgen_update_info(fgen_resources_t* res, const fgen_info_t* info);
+
+// Sweeps a generator from req->start to req->stop in req->steps, dwelling
+// req->dwell_us at each one. Every step is solved beforehand, with the
+// options the generator was created with, and must fit in the RMT blocks
+// it holds. A high priority task then retunes it in place at every tick
+// of an esp_timer, starting it if stopped. The generator is left running
+// at the last frequency. Returns right away, the task taking the steps.
+// fgen_sweep_stop() aborts a sweep, waiting for its task to be done.
+// Statistics are kept until the next sweep or fgen_free().
+esp_err_t fgen_sweep_start(fgen_resources_t* res, const fgen_sweep_req_t* req);
+
+esp_err_t fgen_sweep_stop(fgen_resources_t* res);
+
+esp_err_t fgen_sweep_stats(const fgen_resources_t* res, fgen_sweep_stats_t* stats);
+
+// Sends exactly the given number of periods and stops. The ESP32 RMT has
+// no loop counter, so the generator loops as usual while a high priority
+// task sleeps until the last loop, timed with esp_timer, which counts the
+// same crystal. Only then are two items rewritten and loop mode cleared,
+// so that the last loop ends after the remaining periods, low for at
+// least one full item, and the RMT end of transmission callback tells
+// the task. No CPU time is spent per period or loop. notify, if not NULL,
+// gets a task notification when done, fgen_burst_stats() telling how it
+// went. The generator is restarted if running and left stopped. Streams,
+// patterns and phased generators cannot burst. fgen_burst_stop() aborts
+// a burst, stopping the generator at once. The first burst registers the
+// RMT driver end of transmission callback with
+// rmt_register_tx_end_callback(), which replaces any the application set,
+// as there is a single one for all channels.
+esp_err_t fgen_burst_start(fgen_resources_t* res, uint64_t periods, TaskHandle_t notify);
+
+esp_err_t fgen_burst_stop(fgen_resources_t* res);
+
+esp_err_t fgen_burst_stats(const fgen_resources_t* res, fgen_burst_stats_t* stats);
+
+// Schedules an event at an esp_timer_get_time() time, 1 ms ahead at
+// least. Up to 32 events can be pending. They are queued by time and run
+// by a high priority task, which wakes up shortly before, loads the items
+// of generators to be started, then spins until the time comes and
+// writes the RMT registers with interrupts disabled. It holds the lock
+// other calls take only while loading, for the last 50 us and for
+// retunes, so that those calls are not held up meanwhile. Events due at
+// the same time are run together, so that their edges are aligned as
+// fgen_start_group() aligns them. Retunes take over at the loop boundary
+// they wait for, if any, so they are as late as that. info is the retune
+// solution, solved beforehand, and ignored otherwise.
+// fgen_schedule_update() solves it as fgen_update() does. The error of
+// every event is logged, see fgen_schedule_stats(). Streamed generators
+// cannot be scheduled, and events fail on a bursting one.
+// fgen_schedule_cancel() drops the pending events of a generator, or all
+// of them if NULL, as fgen_free() does for its own, those about to run
+// included.
+esp_err_t fgen_schedule(fgen_resources_t* res, fgen_event_t event, int64_t at_us, const fgen_info_t* info);
+
+esp_err_t fgen_schedule_update(fgen_resources_t* res, int64_t at_us, double freq, double duty_cycle);
+
+esp_err_t fgen_schedule_cancel(fgen_resources_t* res);
+
+void fgen_schedule_stats(fgen_schedule_stats_t* stats);
+
 rmt_channel_status_t fgen_get_state(const fgen_resources_t* res);
 
+// Heap bytes held by a frequency generator, only patterns, sweeps, bursts
+// and streams of very long periods taking any. Resources and items come
+// from a static arena with a slot per RMT channel
+size_t fgen_heap_size(const fgen_resources_t* res);
+
+void fgen_arena_stats(size_t* size, size_t* free_slots);
+
+// GPIO pool, CONFIG_FGEN_GPIO_POOL until set otherwise. Setting n pins,
+// up to one per RMT channel, fails if any of them cannot be an output.
+// Setting none (NULL) goes back to the configured pool. Generators keep
+// their pins either way. Getting it copies RMT_CHANNEL_MAX entries at
+// most and returns how many pins there are.
+esp_err_t fgen_gpio_pool_set(const gpio_num_t* pins, size_t n);
+
+size_t fgen_gpio_pool_get(fgen_gpio_t* pool);
+
+// Refill ISR load of a streaming frequency generator. Streams share one
+// interrupt, and set the RMT memory wraparound bit, global to all the
+// channels, while any of them runs. The bit is put back as it was when
+// the last one stops. The load is about refill_rate * cycles / CPU clock
+esp_err_t fgen_stream_stats(const fgen_resources_t* res, fgen_stream_stats_t* stats);
+
 
 #ifdef __cplusplus
 }
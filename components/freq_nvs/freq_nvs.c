@@ -35,6 +35,9 @@
 // namespace for NVS storage
 #define FREQ_NVS_NAMESPACE "freq"
 
+// GPIO pool length, one pin per RMT channel
+#define FREQ_NVS_MAX_GPIOS 8
+
 #define NVS_CHECK(a, str, ret_val) \
     if (!(a)) { \
         ESP_LOGE(NVS_TAG,"%s(%d): %s", __FUNCTION__, __LINE__, str); \
@@ -148,6 +151,55 @@ esp_err_t freq_nvs_info_erase(uint32_t channel)
 
 /* ************************************************************************* */
 
+esp_err_t freq_nvs_gpio_pool_load(gpio_num_t* pins, size_t* n)
+{
+    nvs_handle_t handle;
+    esp_err_t    res;
+    size_t       length = FREQ_NVS_MAX_GPIOS * sizeof(gpio_num_t);
+
+    res = nvs_open(FREQ_NVS_NAMESPACE, NVS_READONLY, &handle);
+    NVS_CHECK(res == ESP_OK, "Error opening NVS handle", res);
+
+    *n  = 0; // no pool if not set yet in NVS
+    res = nvs_get_blob(handle, "gpios", pins, &length);
+    if (res == ESP_OK) {
+        *n = length / sizeof(gpio_num_t);
+        ESP_LOGD(NVS_TAG, "GPIO pool of %d pins read from NVS", *n);
+    } else if (res == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGD(NVS_TAG, "No GPIO pool stored in NVS");
+        res = ESP_OK;
+    }
+    nvs_close(handle);
+    return res;
+}
+
+/* ************************************************************************* */
+
+esp_err_t freq_nvs_gpio_pool_save(const gpio_num_t* pins, size_t n)
+{
+    nvs_handle_t handle;
+    esp_err_t    res;
+
+    res = nvs_open(FREQ_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    NVS_CHECK(res == ESP_OK, "Error opening NVS handle", res);
+
+    ESP_LOGD(NVS_TAG, "Updating GPIO pool in NVS ... ");
+    if (n > 0) {
+        res = nvs_set_blob(handle, "gpios", pins, n * sizeof(gpio_num_t));
+    } else {
+        res = nvs_erase_key(handle, "gpios");
+        res = (res == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : res;
+    }
+    if (res == ESP_OK) {
+        ESP_LOGD(NVS_TAG, "Committing updates in NVS ... ");
+        res = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return res;
+}
+
+/* ************************************************************************* */
+
 esp_err_t freq_nvs_begin_transaction(nvs_open_mode_t open_mode, nvs_handle_t* handle)
 {
 	esp_err_t    res;
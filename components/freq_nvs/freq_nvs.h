@@ -43,6 +43,12 @@ esp_err_t freq_nvs_autoboot_save(uint32_t  flag);
 
 esp_err_t freq_nvs_info_erase(uint32_t channel);
 
+// GPIO pool override, up to one pin per RMT channel. None stored
+// loads n = 0, and saving n = 0 erases it.
+esp_err_t freq_nvs_gpio_pool_load(gpio_num_t* pins, size_t* n);
+
+esp_err_t freq_nvs_gpio_pool_save(const gpio_num_t* pins, size_t n);
+
 esp_err_t freq_nvs_begin_transaction(nvs_open_mode_t open_mode, nvs_handle_t* handle);
 
 esp_err_t freq_nvs_info_load(nvs_handle_t handle, uint32_t channel, freq_nvs_info_t* info);
@@ -0,0 +1,294 @@
+/*
+   (c) Rafael González (astrorafael@gmail.com), LICA, Ftad. CC. Fisicas, UCM
+
+   See project's LICENSE file.
+*/
+
+/* ************************************************************************* */
+/*                         INCLUDE HEADER SECTION                            */
+/* ************************************************************************* */
+
+// -------------------
+// C standard includes
+// -------------------
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --------------
+// Local includes
+// --------------
+
+#include "mock_idf.h"
+
+// Built in, so that the solver internals can be called from here
+#include "freq_generator.c"
+
+/* ************************************************************************* */
+/*                      DEFINES AND ENUMERATIONS SECTION                     */
+/* ************************************************************************* */
+
+// Log sweep over the whole range of the original solver
+#define BENCH_FMIN    0.01
+#define BENCH_FMAX    500000.0
+#define BENCH_POINTS  200000
+
+// Relative error margin within which both solvers are taken as equal
+#define BENCH_EPS     1e-12
+
+// Batches solved by fgen_info_batch() and one by one
+#define BENCH_BATCH   4096
+
+/* ************************************************************************* */
+/*                          AUXILIAR FUNCTIONS SECTION                       */
+/* ************************************************************************* */
+
+// The fmod prescaler scan fgen_find_freq() used to be, as it was
+
+static
+esp_err_t bench_old_find_freq(double fout, double duty_cycle, fgen_info_t* fgen)
+{
+    double whole;
+    double new_N;
+    double err, new_err;
+    double dNhigh, dNlow;
+
+    fgen->prescaler = 255;   // Assume highest prescaler
+
+    whole   = round(FGEN_APB/fout);
+    fgen->N = whole / fgen->prescaler;
+    err     = fmod(whole,  fgen->prescaler);
+
+    while (fgen->prescaler > 1) {
+        new_N     = whole / fgen->prescaler;
+        new_err   = fmod(whole, fgen->prescaler);
+        if (new_err == 0.0 && new_N > 1.0) {
+            err     = new_err;
+            fgen->N = new_N;
+            break;
+        } else if (new_err < err) {
+            err     = new_err;
+            fgen->N = new_N;
+        }
+        fgen->prescaler -= 1;
+    }
+
+    if (fgen->prescaler == 2 && err != 0.0) {
+        fgen->prescaler = 1;
+        fgen->N         = whole;
+    }
+
+    dNhigh = fgen->N * duty_cycle;
+    dNlow  = fgen->N - dNhigh;
+    if (dNhigh < 1.0 || dNlow < 1.0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    fgen->NH = (uint32_t)(round(dNhigh));
+    fgen->NL = (uint32_t)(round(dNlow));
+    fgen->N  = fgen->NH + fgen->NL;   // May be changed by one unit by rounding
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t bench_new_find_freq(double fout, double duty_cycle, fgen_info_t* fgen)
+{
+    fgen_target_t target;
+    esp_err_t     ret;
+
+    ret = fgen_target_double(fout, duty_cycle, NULL, &target);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return fgen_find_freq(&target, NULL, fgen);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+double bench_freq(int i)
+{
+    return BENCH_FMIN * pow(BENCH_FMAX / BENCH_FMIN, i / (BENCH_POINTS - 1.0));
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+double bench_rel_err(double fout, const fgen_info_t* fgen)
+{
+    return fabs((double) fgen->prescaler * fgen->N * fout / FGEN_APB - 1.0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+double bench_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Time taken by a solver over the whole sweep, in seconds
+
+static
+double bench_time(esp_err_t (*solve)(double, double, fgen_info_t*))
+{
+    fgen_info_t info;
+    double      start = bench_seconds();
+
+    for (int i = 0; i < BENCH_POINTS; i++) {
+        solve(bench_freq(i), 0.5, &info);
+    }
+    return bench_seconds() - start;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+bool bench_same_info(const fgen_info_t* a, const fgen_info_t* b)
+{
+    return a->prescaler == b->prescaler && a->N == b->N && a->NH == b->NH && a->NL == b->NL &&
+           a->encoding == b->encoding && a->streaming == b->streaming &&
+           a->mem_blocks == b->mem_blocks && a->nitems == b->nitems && a->nrep == b->nrep;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Number of tick products whose divisor in a sieve differs from the one
+// fgen_best_divisor() gives, for windows at a few bases
+
+static
+uint32_t bench_sieve(void)
+{
+    static const uint64_t base[] = { 2, 3, 1000, 65536, 77777, 1ULL << 32, 1234567890123ULL };
+    static fgen_sieve_t   sieve;
+    uint32_t differ = 0;
+
+    for (size_t i = 0; i < sizeof(base) / sizeof(base[0]); i++) {
+        fgen_sieve_build(&sieve, base[i]);
+        for (uint64_t M = base[i]; M < base[i] + FGEN_BATCH_WINDOW; M++) {
+            differ += fgen_divisor(&sieve, M) != fgen_divisor(NULL, M);
+        }
+    }
+    printf("%u tick products with a wrong divisor in the sieve\n", differ);
+    return differ;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Solves BENCH_BATCH frequencies from fmin to fmax, on a log scale or not,
+// with fgen_info_batch() and one by one with fgen_info(). Returns the
+// number of requests solved differently
+
+static
+uint32_t bench_batch(double fmin, double fmax, bool logscale)
+{
+    static fgen_request_t req[BENCH_BATCH];
+    static fgen_info_t    batch[BENCH_BATCH], single[BENCH_BATCH];
+    static esp_err_t      status[BENCH_BATCH];
+    double   start, batch_time, single_time;
+    uint32_t differ = 0;
+
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        double x = i / (BENCH_BATCH - 1.0);
+        req[i].freq       = (logscale) ? fmin * pow(fmax / fmin, x) : fmin + (fmax - fmin) * x;
+        req[i].duty_cycle = 0.5;
+    }
+
+    start = bench_seconds();
+    fgen_info_batch(req, BENCH_BATCH, batch, status);
+    batch_time = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        fgen_info(req[i].freq, req[i].duty_cycle, &single[i]);
+    }
+    single_time = bench_seconds() - start;
+
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        esp_err_t ret = fgen_info(req[i].freq, req[i].duty_cycle, &single[i]);
+        if (ret != status[i] || (ret == ESP_OK && !bench_same_info(&batch[i], &single[i]))) {
+            differ += 1;
+            fprintf(stderr, "%.6f Hz solved differently in a batch\n", req[i].freq);
+        }
+    }
+    printf("%d requests from %g Hz to %g Hz%s: %u solved differently\n",
+        BENCH_BATCH, fmin, fmax, (logscale) ? " (log)" : "", differ);
+    printf("  %.1f ns per request one by one, %.1f ns in a batch, %.1fx faster\n",
+        single_time * 1e9 / BENCH_BATCH, batch_time * 1e9 / BENCH_BATCH, single_time / batch_time);
+    return differ;
+}
+
+/* ************************************************************************* */
+/*                               MAIN FUNCTION                               */
+/* ************************************************************************* */
+
+// Compares the exact divisor search with the fmod scan it replaced over a
+// log sweep of the whole range: it must never give a larger error, but
+// where the old one chose an N too large for RMT RAM, and it times both.
+// Then fgen_info_batch() must solve requests just as fgen_info() does
+
+int main(void)
+{
+    fgen_info_t old, new;
+    esp_err_t   old_ret, new_ret;
+    double      old_err, new_err, old_max = 0, new_max = 0;
+    double      old_time, new_time;
+    uint32_t    better = 0, same = 0, unfit = 0, worse = 0, failed = 0, differ = 0;
+
+    for (int i = 0; i < BENCH_POINTS; i++) {
+        double freq = bench_freq(i);
+
+        memset(&old, 0, sizeof(old));
+        memset(&new, 0, sizeof(new));
+        old_ret = bench_old_find_freq(freq, 0.5, &old);
+        new_ret = bench_new_find_freq(freq, 0.5, &new);
+        if (new_ret != ESP_OK) {
+            failed += 1;
+            fprintf(stderr, "%.6f Hz not solved\n", freq);
+            continue;
+        }
+        new_err = bench_rel_err(freq, &new);
+        new_max = fmax(new_max, new_err);
+        if (old_ret != ESP_OK) {
+            better += 1;
+            continue;
+        }
+        old_err = bench_rel_err(freq, &old);
+        old_max = fmax(old_max, old_err);
+        if (new_err < old_err - BENCH_EPS) {
+            better += 1;
+        } else if (new_err <= old_err + BENCH_EPS) {
+            same += 1;
+        } else if (old.N > FGEN_MAX_N) {
+            unfit += 1;
+        } else {
+            worse += 1;
+            fprintf(stderr, "%.6f Hz: %u x %u (%.3g) worse than %u x %u (%.3g)\n",
+                freq, new.prescaler, new.N, new_err, old.prescaler, old.N, old_err);
+        }
+    }
+
+    old_time = bench_time(bench_old_find_freq);
+    new_time = bench_time(bench_new_find_freq);
+
+    printf("%d points from %g Hz to %g Hz\n", BENCH_POINTS, BENCH_FMIN, BENCH_FMAX);
+    printf("  %u more accurate, %u same, %u worse with the old N too large for RMT RAM\n", better, same, unfit);
+    printf("  %u worse otherwise, %u not solved\n", worse, failed);
+    printf("  max relative error %.3g before, %.3g now\n", old_max, new_max);
+    printf("  %.1f ns per solve before, %.1f ns now, %.1fx faster\n",
+        old_time * 1e9 / BENCH_POINTS, new_time * 1e9 / BENCH_POINTS, old_time / new_time);
+
+    differ += bench_sieve();
+    differ += bench_batch(20000, BENCH_FMAX, false);
+    differ += bench_batch(1000, 1100, false);
+    differ += bench_batch(BENCH_FMIN, BENCH_FMAX, true);
+    return (worse == 0 && failed == 0 && differ == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
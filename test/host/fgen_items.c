@@ -0,0 +1,277 @@
+/*
+   (c) Rafael González (astrorafael@gmail.com), LICA, Ftad. CC. Fisicas, UCM
+
+   See project's LICENSE file.
+*/
+
+/* ************************************************************************* */
+/*                         INCLUDE HEADER SECTION                            */
+/* ************************************************************************* */
+
+// -------------------
+// C standard includes
+// -------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// --------------
+// Local includes
+// --------------
+
+#include "mock_idf.h"
+
+// Built in, so that the item layout functions can be called from here
+#include "freq_generator.c"
+
+/* ************************************************************************* */
+/*                      DEFINES AND ENUMERATIONS SECTION                     */
+/* ************************************************************************* */
+
+// Every N up to this one is tried at every duty cycle below
+#define ITEMS_EXHAUSTIVE  (1UL << 20)
+
+// Random N up to 2^32, uniform and log uniform
+#define ITEMS_RANDOM      2000
+#define ITEMS_RANDOM_LOG  200000
+
+// Longest item sequence, for NH and NL both close to 2^32
+#define ITEMS_MAX         (2 * (UINT32_MAX / (2 * FGEN_ITEM_TICKS) + 2))
+
+/* ************************************************************************* */
+/*                          GLOBAL VARIABLES SECTION                         */
+/* ************************************************************************* */
+
+static const double ITEMS_DUTY[] = { 0.01, 0.3, 0.5, 0.999 };
+
+#define ITEMS_NDUTY (sizeof(ITEMS_DUTY) / sizeof(ITEMS_DUTY[0]))
+
+static rmt_item32_t* ITEMS_OLD;
+static rmt_item32_t* ITEMS_NEW;
+static uint32_t      ITEMS_CASES;
+static uint32_t      ITEMS_BAD;
+
+/* ************************************************************************* */
+/*                          AUXILIAR FUNCTIONS SECTION                       */
+/* ************************************************************************* */
+
+// The item counting and filling loops fgen_count_items() and
+// fgen_fill_items() used to be, as they were
+
+static
+uint16_t items_old_count(uint32_t NH, uint32_t NL)
+{
+    uint16_t count = 0;
+
+    // Quick way out for only 1 item
+    if (NH < 32768 && NL < 32768) {
+        count += 1;  // item
+        return count;
+    }
+
+    // Long high period
+    while (NH > 32767*2) {
+        NH   -= 32767*2;
+        count += 1;
+    }
+
+    // Ending high part
+    if ((32767 < NH) && (NH <= 32767*2)) {
+        NH -= 32767;
+        count += 1;
+    } else {
+        uint32_t padding = min(NL, 32767);
+        NL -= padding;
+        count += 1;
+    }
+
+    // Long low period
+    while (NL > 32767*2) {
+        NL   -= 32767*2;
+        count += 1;
+    }
+
+    // Ending low part
+    if ((32767 < NL) && (NL <= 32767*2)) {
+        NL -= 32767;
+        count += 1;
+    } else if (NL > 0) {
+        count += 1;
+    }
+
+    // The count does not include a final EoTx item
+    return count;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+rmt_item32_t* items_old_fill(rmt_item32_t* item, uint32_t NH, uint32_t NL)
+{
+
+    // Quick way out for only 1 item
+    if (NH < 32768 && NL < 32768) {
+        item->duration0 = NH; item->level0 = 1;
+        item->duration1 = NL; item->level1 = 0;
+        item++;
+        return item;
+    }
+
+    // Long high period
+    while (NH > 32767*2) {
+        NH   -= 32767*2;
+        item->duration0 = 32767; item->level0 = 1;
+        item->duration1 = 32767; item->level1 = 1;
+        item++;
+    }
+
+    // Ending high part
+    if ((32767 < NH) && (NH <= 32767*2)) {
+        NH -= 32767;
+        item->duration0 = 32767; item->level0 = 1;
+        item->duration1 = NH;    item->level1 = 1;
+        item++;
+
+    } else {
+        uint32_t padding = min(NL, 32767);
+        item->duration0 = NH;      item->level0 = 1;
+        item->duration1 = padding; item->level1 = 0;
+        item++;
+        NL -= padding;
+    }
+
+    // Long low period
+    while (NL > 32767*2) {
+        NL   -= 32767*2;
+        item->duration0 = 32767; item->level0 = 0;
+        item->duration1 = 32767; item->level1 = 0;
+        item++;
+    }
+
+    // Ending low part
+    if ((32767 < NL) && (NL <= 32767*2)) {
+        NL -= 32767;
+        item->duration0 = 32767; item->level0 = 0;
+        item->duration1 = NL;    item->level1 = 0;
+        item++;
+    } else if (NL > 0) {
+        item->duration0 = NL; item->level0 = 0;
+        item->duration1 = 0;  item->level1 = 0;
+        item++;
+    }
+    return item;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Both item sequences for NH + NL must be the same, item by item, and
+// their length the count given by both counting functions
+
+static
+void items_check(uint32_t NH, uint32_t NL)
+{
+    size_t   nold, nnew;
+    uint16_t cold, cnew;
+    bool     bad;
+
+    nold = items_old_fill(ITEMS_OLD, NH, NL) - ITEMS_OLD;
+    nnew = fgen_fill_items(ITEMS_NEW, NH, NL) - ITEMS_NEW;
+    cold = items_old_count(NH, NL);
+    cnew = fgen_count_items(NH, NL);
+
+    bad = nold != nnew || cold != cnew || cnew != (uint16_t) nnew;
+    for (size_t i = 0; !bad && i < nnew; i++) {
+        bad = ITEMS_OLD[i].val != ITEMS_NEW[i].val;
+    }
+    if (bad && ITEMS_BAD < 10) {
+        fprintf(stderr, "NH %u NL %u: %zu items counted as %u before, %zu counted as %u now\n",
+            NH, NL, nold, cold, nnew, cnew);
+    }
+    ITEMS_BAD   += bad;
+    ITEMS_CASES += 1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// N split at the duty cycle, with at least one tick of each level
+
+static
+void items_check_duty(uint32_t N, double duty_cycle)
+{
+    uint32_t NH = (uint32_t)(N * duty_cycle + 0.5);
+
+    NH = (NH < 1) ? 1 : (NH > N - 1) ? N - 1 : NH;
+    items_check(NH, N - NH);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+uint32_t items_random(unsigned* seed)
+{
+    return ((uint32_t) rand_r(seed) << 16) ^ (uint32_t) rand_r(seed);
+}
+
+/* ************************************************************************* */
+/*                               MAIN FUNCTION                               */
+/* ************************************************************************* */
+
+// Compares the constant time item layout with the loops it replaced: every
+// N up to ITEMS_EXHAUSTIVE, every pair of NH and NL around multiples of
+// the item half length, up to 2^32, and random N up to 2^32
+
+int main(void)
+{
+    uint32_t edge[64];
+    size_t   nedge = 0;
+    unsigned seed  = 1;
+    uint32_t N, NH;
+
+    ITEMS_OLD = (rmt_item32_t*) malloc(ITEMS_MAX * sizeof(rmt_item32_t));
+    ITEMS_NEW = (rmt_item32_t*) malloc(ITEMS_MAX * sizeof(rmt_item32_t));
+    if (ITEMS_OLD == NULL || ITEMS_NEW == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (N = 2; N <= ITEMS_EXHAUSTIVE; N++) {
+        for (size_t d = 0; d < ITEMS_NDUTY; d++) {
+            items_check_duty(N, ITEMS_DUTY[d]);
+        }
+    }
+
+    for (uint32_t v = 0; v <= 2; v++) {
+        edge[nedge++] = v;
+    }
+    for (uint32_t k = 1; k <= 5; k++) {
+        for (int d = -2; d <= 2; d++) {
+            edge[nedge++] = k * FGEN_ITEM_TICKS + d;
+        }
+    }
+    edge[nedge++] = 65536 * FGEN_ITEM_TICKS;
+    edge[nedge++] = UINT32_MAX / (2 * FGEN_ITEM_TICKS) * (2 * FGEN_ITEM_TICKS);
+    edge[nedge++] = UINT32_MAX / (2 * FGEN_ITEM_TICKS) * (2 * FGEN_ITEM_TICKS) + FGEN_ITEM_TICKS;
+    edge[nedge++] = UINT32_MAX - 1;
+    edge[nedge++] = UINT32_MAX;
+    for (size_t i = 0; i < nedge; i++) {
+        for (size_t j = 0; j < nedge; j++) {
+            items_check(edge[i], edge[j]);
+        }
+    }
+
+    for (int i = 0; i < ITEMS_RANDOM; i++) {
+        N = 2 + items_random(&seed) % (UINT32_MAX - 1);
+        items_check_duty(N, ITEMS_DUTY[rand_r(&seed) % ITEMS_NDUTY]);
+    }
+    for (int i = 0; i < ITEMS_RANDOM_LOG; i++) {
+        N = items_random(&seed) >> (rand_r(&seed) % 31);
+        N = (N < 2) ? 2 : N;
+        NH = 1 + items_random(&seed) % (N - 1);
+        items_check(NH, N - NH);
+    }
+
+    printf("%u layouts, %u different from the old loops\n", ITEMS_CASES, ITEMS_BAD);
+    free(ITEMS_OLD);
+    free(ITEMS_NEW);
+    return (ITEMS_BAD == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,324 @@
+/*
+   (c) Rafael González (astrorafael@gmail.com), LICA, Ftad. CC. Fisicas, UCM
+
+   See project's LICENSE file.
+*/
+
+/* ************************************************************************* */
+/*                         INCLUDE HEADER SECTION                            */
+/* ************************************************************************* */
+
+// -------------------
+// C standard includes
+// -------------------
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// --------------
+// Local includes
+// --------------
+
+#include "mock_idf.h"
+
+// Built in, so that the bookkeeping can be checked from here
+#include "freq_generator.c"
+
+/* ************************************************************************* */
+/*                      DEFINES AND ENUMERATIONS SECTION                     */
+/* ************************************************************************* */
+
+#define STRESS_THREADS   4
+#define STRESS_OWNED     2      // generators held by every thread at most
+#define STRESS_ITER      20000  // operations per thread
+#define STRESS_PACE_US   100    // at most between them, for tasks and timers to run
+
+/* ************************************************************************* */
+/*                          GLOBAL VARIABLES SECTION                         */
+/* ************************************************************************* */
+
+static const double STRESS_FREQ[] = {
+    1000, 500, 100, 10, 5, 0.00289, 0.0241376, 8.2724, 0.0697576, 0.118588, 0.0410339,
+};
+
+#define STRESS_NFREQ (sizeof(STRESS_FREQ) / sizeof(STRESS_FREQ[0]))
+
+static uint32_t STRESS_BAD;
+static uint32_t STRESS_OPS;
+
+/* ************************************************************************* */
+/*                          AUXILIAR FUNCTIONS SECTION                       */
+/* ************************************************************************* */
+
+// Number of bookkeeping inconsistencies, to be called with the lock taken:
+// RMT blocks owned twice or in the wrong state, handles or GPIOs given
+// twice and the GPIO pool out of step with the generators
+
+static
+uint32_t stress_inconsistencies(void)
+{
+    uint32_t bad = 0;
+    bool     owned[RMT_CHANNEL_MAX] = { false };
+
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        if (!FGEN_SLOTS[i].used) {
+            continue;
+        }
+        const fgen_resources_t* res = &FGEN_SLOTS[i].res;
+        for (int ch = res->channel; ch < res->channel + res->info.mem_blocks; ch++) {
+            bad += owned[ch];
+            owned[ch] = true;
+            bad += FREQ_CHANNEL[ch].state != ((ch == res->channel) ? FGEN_CHANNEL_USED : FGEN_CHANNEL_UNAVAILABLE);
+        }
+        for (int j = 0; j < RMT_CHANNEL_MAX; j++) {
+            bad += j != i && FGEN_SLOTS[j].used
+                && (FGEN_SLOTS[j].res.handle == res->handle || FGEN_SLOTS[j].res.gpio_num == res->gpio_num);
+        }
+    }
+    for (int ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+        bad += !owned[ch] && FREQ_CHANNEL[ch].state != FGEN_CHANNEL_FREE;
+    }
+    for (size_t i = 0; i < FREQ_GPIO_NUM; i++) {
+        bad += FREQ_GPIO[i].allocated != fgen_gpio_used(FREQ_GPIO[i].gpio_num);
+    }
+    return bad;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+double stress_freq(unsigned* seed)
+{
+    return STRESS_FREQ[rand_r(seed) % STRESS_NFREQ];
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+fgen_resources_t* stress_alloc(unsigned* seed)
+{
+    fgen_options_t opt = { 0 };
+    fgen_info_t    info;
+
+    opt.min_wrap  = rand_r(seed) % 3 == 0;
+    opt.zero_copy = rand_r(seed) % 2;
+    opt.streaming = rand_r(seed) % 8 == 0;
+    if (fgen_info_opt(stress_freq(seed), 0.5, &opt, &info) != ESP_OK) {
+        return NULL;
+    }
+    return fgen_alloc(&info, GPIO_NUM_NC);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void stress_sweep(fgen_resources_t* res, unsigned* seed)
+{
+    fgen_sweep_req_t   req = {
+        .start      = res->info.freq,
+        .stop       = res->info.freq * (1 + rand_r(seed) % 3),
+        .duty_cycle = 0.5,
+        .steps      = 2 + rand_r(seed) % 4,
+        .dwell_us   = 500 + rand_r(seed) % 2000,
+        .logscale   = rand_r(seed) % 2,
+    };
+    fgen_sweep_stats_t stats;
+
+    switch (rand_r(seed) % 3) {
+        case 0:
+            fgen_sweep_start(res, &req);
+            break;
+        case 1:
+            fgen_sweep_stop(res);
+            break;
+        default:
+            fgen_sweep_stats(res, &stats);
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void stress_burst(fgen_resources_t* res, unsigned* seed)
+{
+    fgen_burst_stats_t stats;
+
+    switch (rand_r(seed) % 3) {
+        case 0:
+            fgen_burst_start(res, 1 + rand_r(seed) % 3, NULL);
+            break;
+        case 1:
+            fgen_burst_stop(res);
+            break;
+        default:
+            fgen_burst_stats(res, &stats);
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void stress_schedule(fgen_resources_t* res, unsigned* seed)
+{
+    int64_t               at = esp_timer_get_time() + 1000 + rand_r(seed) % 4000;
+    fgen_schedule_stats_t stats;
+
+    switch (rand_r(seed) % 4) {
+        case 0:
+            fgen_schedule(res, FGEN_EVENT_START, at, NULL);
+            break;
+        case 1:
+            fgen_schedule(res, FGEN_EVENT_STOP, at, NULL);
+            break;
+        case 2:
+            fgen_schedule_update(res, at, res->info.freq * 1.001, 0.5);
+            break;
+        default:
+            fgen_schedule_stats(&stats);
+            break;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void stress_plan(fgen_resources_t** owned, unsigned* seed)
+{
+    fgen_plan_req_t   req[STRESS_OWNED] = {
+        { stress_freq(seed), 0.5, GPIO_NUM_NC },
+        { stress_freq(seed), 0.3, GPIO_NUM_NC },
+    };
+    fgen_placement_t  place[STRESS_OWNED];
+    fgen_plan_t       plan;
+    fgen_resources_t* res[STRESS_OWNED];
+
+    if (rand_r(seed) % 2) {
+        fgen_plan(req, STRESS_OWNED, place, &plan);
+    } else if (owned[0] == NULL && owned[1] == NULL && fgen_plan_apply(req, STRESS_OWNED, res) == ESP_OK) {
+        owned[0] = res[0];
+        owned[1] = res[1];
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Random operations on generators of its own and read only ones on the
+// shared state, checking the bookkeeping now and then
+
+static
+void* stress_worker(void* arg)
+{
+    unsigned          seed = 7919 * (uintptr_t) arg + 1;
+    fgen_resources_t* owned[STRESS_OWNED] = { NULL };
+    fgen_resources_t* res;
+    fgen_info_t       info;
+    uint32_t          bad;
+    int               k;
+
+    for (int i = 0; i < STRESS_ITER; i++) {
+        k   = rand_r(&seed) % STRESS_OWNED;
+        res = owned[k];
+        switch (rand_r(&seed) % 12) {
+            case 0:
+            case 1:
+                if (res == NULL) {
+                    owned[k] = stress_alloc(&seed);
+                } else {
+                    fgen_free(res);
+                    owned[k] = NULL;
+                }
+                break;
+            case 2:
+                if (res != NULL) {
+                    fgen_start(res);
+                }
+                break;
+            case 3:
+                if (res != NULL) {
+                    fgen_stop(res);
+                }
+                break;
+            case 4:
+                if (res != NULL) {
+                    fgen_update(res, res->info.freq * (1 + rand_r(&seed) % 2), 0.5);
+                }
+                break;
+            case 5:
+                if (res != NULL) {
+                    stress_sweep(res, &seed);
+                }
+                break;
+            case 6:
+                if (res != NULL) {
+                    stress_burst(res, &seed);
+                }
+                break;
+            case 7:
+                if (res != NULL) {
+                    stress_schedule(res, &seed);
+                }
+                break;
+            case 8:
+                stress_plan(owned, &seed);
+                break;
+            case 9:
+                if (res != NULL) {
+                    fgen_get_state(res);
+                }
+                fgen_info(stress_freq(&seed) * (1 + rand_r(&seed) % 5), 0.5, &info);
+                break;
+            case 10:
+                fgen_lock();
+                fgen_compact();
+                fgen_unlock();
+                break;
+            default:
+                fgen_lock();
+                bad = stress_inconsistencies();
+                fgen_unlock();
+                __atomic_add_fetch(&STRESS_BAD, bad, __ATOMIC_RELAXED);
+                break;
+        }
+        __atomic_add_fetch(&STRESS_OPS, 1, __ATOMIC_RELAXED);
+        usleep(rand_r(&seed) % STRESS_PACE_US);
+    }
+    for (k = 0; k < STRESS_OWNED; k++) {
+        if (owned[k] != NULL) {
+            fgen_free(owned[k]);
+        }
+    }
+    return NULL;
+}
+
+/* ************************************************************************* */
+/*                               MAIN FUNCTION                               */
+/* ************************************************************************* */
+
+int main(void)
+{
+    pthread_t worker[STRESS_THREADS];
+    uint32_t  failures;
+    size_t    used = 0;
+
+    mock_start();
+    for (uintptr_t i = 0; i < STRESS_THREADS; i++) {
+        pthread_create(&worker[i], NULL, stress_worker, (void*) i);
+    }
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        pthread_join(worker[i], NULL);
+    }
+    fgen_schedule_cancel(NULL);
+    failures = mock_stop();
+
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+        used += FGEN_SLOTS[i].used;
+    }
+    STRESS_BAD += stress_inconsistencies();
+    printf("%u operations, %u inconsistencies, %u mock failures, %zu generators left\n",
+        STRESS_OPS, STRESS_BAD, failures, used);
+    return (STRESS_BAD == 0 && failures == 0 && used == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,727 @@
+/*
+   (c) Rafael González (astrorafael@gmail.com), LICA, Ftad. CC. Fisicas, UCM
+
+   See project's LICENSE file.
+*/
+
+/* ************************************************************************* */
+/*                         INCLUDE HEADER SECTION                            */
+/* ************************************************************************* */
+
+// -------------------
+// C standard includes
+// -------------------
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// ------------------------------------
+// Expressif SDK-IDF stand-in includes
+// ------------------------------------
+
+#include <esp_intr_alloc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <driver/rmt.h>
+#include <xtensa/core-macros.h>
+
+// --------------
+// Local includes
+// --------------
+
+#include "mock_idf.h"
+
+/* ************************************************************************* */
+/*                      DEFINES AND ENUMERATIONS SECTION                     */
+/* ************************************************************************* */
+
+#define MOCK_TICK_US   20     // time the RMT model takes per item
+#define MOCK_ITEMS     (RMT_CHANNEL_MAX * 64)
+
+/* ************************************************************************* */
+/*                          DATATYPES SECTION                                */
+/* ************************************************************************* */
+
+// A FreeRTOS task, run by a thread of its own
+typedef struct {
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    uint32_t        notified;
+    TaskFunction_t  fn;
+    void*           arg;
+} mock_task_t;
+
+// A recursive mutex knowing its owner, so that driver calls can check it
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_t       owner;
+    int             count;
+} mock_mutex_t;
+
+// An esp_timer, firing from a thread of its own
+struct esp_timer {
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    esp_timer_cb_t  callback;
+    void*           arg;
+    int64_t         due;      // 0 if not armed
+    uint64_t        period;   // 0 if one shot
+    bool            quit;
+};
+
+/* ************************************************************************* */
+/*                          GLOBAL VARIABLES SECTION                         */
+/* ************************************************************************* */
+
+rmt_dev_t RMT;
+rmt_mem_t RMTMEM;
+
+// Every spinlock and the RMT model, interrupt side included
+static pthread_mutex_t   MOCK_CRITICAL;
+static pthread_once_t    MOCK_ONCE = PTHREAD_ONCE_INIT;
+static __thread mock_task_t* MOCK_SELF;
+
+// The one recursive mutex created by the generator
+static mock_mutex_t*     MOCK_LOCK;
+
+static struct {
+    bool   installed;
+    size_t pos;               // item being read
+} MOCK_RMT[RMT_CHANNEL_MAX];
+
+static rmt_tx_end_fn_t   MOCK_TX_END;
+static void*             MOCK_TX_END_ARG;
+static pthread_t         MOCK_RMT_THREAD;
+static volatile bool     MOCK_RMT_QUIT;
+static volatile uint32_t MOCK_FAILURES;
+
+/* ************************************************************************* */
+/*                          AUXILIAR FUNCTIONS SECTION                       */
+/* ************************************************************************* */
+
+static
+void mock_fail(const char* fn, const char* what, int channel)
+{
+    fprintf(stderr, "MOCK FAILURE: %s() %s, channel %d\n", fn, what, channel);
+    __atomic_add_fetch(&MOCK_FAILURES, 1, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void mock_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&MOCK_CRITICAL, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void mock_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+mock_task_t* mock_task_new(void)
+{
+    mock_task_t* task = calloc(1, sizeof(mock_task_t));
+
+    pthread_mutex_init(&task->mutex, NULL);
+    mock_cond_init(&task->cond);
+    return task;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The calling thread as a task, threads not created by
+// xTaskCreatePinnedToCore() becoming one on first use
+
+static
+mock_task_t* mock_task_self(void)
+{
+    if (MOCK_SELF == NULL) {
+        MOCK_SELF = mock_task_new();
+        MOCK_SELF->thread = pthread_self();
+    }
+    return MOCK_SELF;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void* mock_task_run(void* arg)
+{
+    mock_task_t* task = arg;
+
+    MOCK_SELF = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void mock_deadline(struct timespec* ts, int64_t us)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec  += us / 1000000;
+    ts->tv_nsec += (us % 1000000) * 1000;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+void* mock_timer_run(void* arg)
+{
+    struct esp_timer* timer = arg;
+    struct timespec   ts;
+    int64_t           now;
+
+    pthread_mutex_lock(&timer->mutex);
+    while (!timer->quit) {
+        if (timer->due == 0) {
+            pthread_cond_wait(&timer->cond, &timer->mutex);
+            continue;
+        }
+        now = esp_timer_get_time();
+        if (now < timer->due) {
+            mock_deadline(&ts, timer->due - now);
+            pthread_cond_timedwait(&timer->cond, &timer->mutex, &ts);
+            continue;
+        }
+        timer->due = (timer->period) ? timer->due + timer->period : 0;
+        pthread_mutex_unlock(&timer->mutex);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->mutex);
+    }
+    pthread_mutex_unlock(&timer->mutex);
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Driver calls are expected with the generator lock taken
+
+static
+void mock_driver_check(const char* fn, rmt_channel_t channel)
+{
+    if (channel < 0 || channel >= RMT_CHANNEL_MAX) {
+        mock_fail(fn, "bad channel", channel);
+        return;
+    }
+    if (MOCK_LOCK == NULL || MOCK_LOCK->count == 0 || !pthread_equal(MOCK_LOCK->owner, pthread_self())) {
+        mock_fail(fn, "called without the generator lock", channel);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Moves every running channel one item forward, as the RMT reads them,
+// wrapping around in loop mode at the end of transmission marker and
+// stopping otherwise, with the tx end callback
+
+static
+void* mock_rmt_run(void* arg)
+{
+    rmt_item32_t item;
+    bool         ended[RMT_CHANNEL_MAX];
+    size_t       pos;
+
+    while (!MOCK_RMT_QUIT) {
+        usleep(MOCK_TICK_US);
+        mock_enter_critical();
+        for (int ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+            ended[ch] = false;
+            if (RMT.conf_ch[ch].conf1.mem_rd_rst) {
+                RMT.conf_ch[ch].conf1.mem_rd_rst = 0;
+                MOCK_RMT[ch].pos = 0;
+            }
+            if (!RMT.conf_ch[ch].conf1.tx_start) {
+                continue;
+            }
+            pos  = MOCK_RMT[ch].pos;
+            item.val = RMTMEM.chan[ch].data32[pos].val;
+            if (item.duration0 == 0 || item.duration1 == 0 || ch * 64 + pos + 1 >= MOCK_ITEMS) {
+                pos = 0;
+                if (!RMT.conf_ch[ch].conf1.tx_conti_mode) {
+                    RMT.conf_ch[ch].conf1.tx_start = 0;
+                    ended[ch] = true;
+                }
+            } else {
+                pos++;
+            }
+            MOCK_RMT[ch].pos = pos;
+            RMT.status_ch[ch].val = (uint32_t) (ch * 64 + pos) << 12;
+        }
+        mock_exit_critical();
+        for (int ch = 0; ch < RMT_CHANNEL_MAX; ch++) {
+            if (ended[ch] && MOCK_TX_END != NULL) {
+                MOCK_TX_END(ch, MOCK_TX_END_ARG);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* ************************************************************************* */
+/*                               API FUNCTIONS                               */
+/* ************************************************************************* */
+
+void mock_start(void)
+{
+    pthread_once(&MOCK_ONCE, mock_init);
+    MOCK_RMT_QUIT = false;
+    pthread_create(&MOCK_RMT_THREAD, NULL, mock_rmt_run, NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+uint32_t mock_stop(void)
+{
+    MOCK_RMT_QUIT = true;
+    pthread_join(MOCK_RMT_THREAD, NULL);
+    return MOCK_FAILURES;
+}
+
+/* -------------------------------------------------------------------------- */
+
+uint32_t mock_ccount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 240000000ULL + ts.tv_nsec * 240ULL / 1000);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void mock_enter_critical(void)
+{
+    pthread_once(&MOCK_ONCE, mock_init);
+    pthread_mutex_lock(&MOCK_CRITICAL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void mock_exit_critical(void)
+{
+    pthread_mutex_unlock(&MOCK_CRITICAL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void* arg, intr_handle_t* ret_handle)
+{
+    // Streams are allocated but never refilled, no interrupt being raised
+    *ret_handle = (intr_handle_t) 1;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_intr_free(intr_handle_t handle)
+{
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+    struct esp_timer* timer = calloc(1, sizeof(struct esp_timer));
+
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg      = args->arg;
+    pthread_mutex_init(&timer->mutex, NULL);
+    mock_cond_init(&timer->cond);
+    pthread_create(&timer->thread, NULL, mock_timer_run, timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static
+esp_err_t mock_timer_arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&timer->mutex);
+    if (timer->due != 0) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->due    = esp_timer_get_time() + ((timeout_us) ? timeout_us : 1);
+        timer->period = period_us;
+        pthread_cond_signal(&timer->cond);
+    }
+    pthread_mutex_unlock(&timer->mutex);
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return mock_timer_arm(timer, timeout_us, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return mock_timer_arm(timer, period_us, period_us);
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&timer->mutex);
+    if (timer->due == 0) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    timer->due = 0;
+    pthread_mutex_unlock(&timer->mutex);
+    return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer->mutex);
+    if (timer->due != 0) {
+        pthread_mutex_unlock(&timer->mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->quit = true;
+    pthread_cond_signal(&timer->cond);
+    pthread_mutex_unlock(&timer->mutex);
+    pthread_join(timer->thread, NULL);
+    pthread_mutex_destroy(&timer->mutex);
+    pthread_cond_destroy(&timer->cond);
+    free(timer);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t* buffer)
+{
+    pthread_mutexattr_t attr;
+    mock_mutex_t*       mutex = calloc(1, sizeof(mock_mutex_t));
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    MOCK_LOCK = mutex;
+    return mutex;
+}
+
+/* -------------------------------------------------------------------------- */
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t handle, TickType_t wait)
+{
+    mock_mutex_t* mutex = handle;
+
+    pthread_mutex_lock(&mutex->mutex);
+    mutex->owner = pthread_self();
+    mutex->count++;
+    return pdTRUE;
+}
+
+/* -------------------------------------------------------------------------- */
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t handle)
+{
+    mock_mutex_t* mutex = handle;
+
+    if (--mutex->count == 0) {
+        mutex->owner = 0;
+    }
+    pthread_mutex_unlock(&mutex->mutex);
+    return pdTRUE;
+}
+
+/* -------------------------------------------------------------------------- */
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                   UBaseType_t prio, TaskHandle_t* handle, BaseType_t core)
+{
+    mock_task_t* task = mock_task_new();
+
+    task->fn  = fn;
+    task->arg = arg;
+    *handle   = task;
+    if (pthread_create(&task->thread, NULL, mock_task_run, task) != 0) {
+        free(task);
+        return pdFALSE;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// The task itself is not freed, a late notification not knowing better
+
+void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+/* -------------------------------------------------------------------------- */
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return mock_task_self();
+}
+
+/* -------------------------------------------------------------------------- */
+
+void xTaskNotifyGive(TaskHandle_t handle)
+{
+    mock_task_t* task = handle;
+
+    pthread_mutex_lock(&task->mutex);
+    task->notified++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->mutex);
+}
+
+/* -------------------------------------------------------------------------- */
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* woken)
+{
+    xTaskNotifyGive(handle);
+    *woken = pdTRUE;
+}
+
+/* -------------------------------------------------------------------------- */
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    mock_task_t*    task = mock_task_self();
+    struct timespec ts;
+    uint32_t        notified;
+
+    mock_deadline(&ts, (int64_t) wait * portTICK_PERIOD_MS * 1000);
+    pthread_mutex_lock(&task->mutex);
+    while (task->notified == 0) {
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(&task->cond, &task->mutex);
+        } else if (pthread_cond_timedwait(&task->cond, &task->mutex, &ts) != 0) {
+            break;
+        }
+    }
+    notified = task->notified;
+    task->notified = (clear || notified == 0) ? 0 : notified - 1;
+    pthread_mutex_unlock(&task->mutex);
+    return notified;
+}
+
+/* -------------------------------------------------------------------------- */
+
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg)
+{
+    rmt_tx_end_callback_t previous = { MOCK_TX_END, MOCK_TX_END_ARG };
+
+    MOCK_TX_END     = function;
+    MOCK_TX_END_ARG = arg;
+    return previous;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_config(const rmt_config_t* config)
+{
+    mock_driver_check(__func__, config->channel);
+    mock_enter_critical();
+    RMT.conf_ch[config->channel].conf0.div_cnt       = config->clk_div;
+    RMT.conf_ch[config->channel].conf0.mem_size      = config->mem_block_num;
+    RMT.conf_ch[config->channel].conf1.tx_conti_mode = config->tx_config.loop_en;
+    RMT.conf_ch[config->channel].conf1.idle_out_lv   = config->tx_config.idle_level;
+    RMT.conf_ch[config->channel].conf1.idle_out_en   = config->tx_config.idle_output_en;
+    mock_exit_critical();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags)
+{
+    mock_driver_check(__func__, channel);
+    if (MOCK_RMT[channel].installed) {
+        mock_fail(__func__, "driver installed twice", channel);
+        return ESP_ERR_INVALID_STATE;
+    }
+    MOCK_RMT[channel].installed = true;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel)
+{
+    mock_driver_check(__func__, channel);
+    mock_enter_critical();
+    MOCK_RMT[channel].installed = false;
+    RMT.conf_ch[channel].conf1.tx_start = 0;
+    mock_exit_critical();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool tx_idx_rst)
+{
+    mock_driver_check(__func__, channel);
+    mock_enter_critical();
+    if (tx_idx_rst) {
+        MOCK_RMT[channel].pos = 0;
+    }
+    RMT.conf_ch[channel].conf1.tx_start = 1;
+    mock_exit_critical();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+// As the driver does, leaving an end of transmission marker first
+
+esp_err_t rmt_tx_stop(rmt_channel_t channel)
+{
+    mock_driver_check(__func__, channel);
+    mock_enter_critical();
+    RMT.conf_ch[channel].conf1.tx_start = 0;
+    RMTMEM.chan[channel].data32[0].val  = 0;
+    MOCK_RMT[channel].pos = 0;
+    mock_exit_critical();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t* item, uint16_t item_num, uint16_t mem_offset)
+{
+    mock_driver_check(__func__, channel);
+    if (channel * 64 + mem_offset + item_num > MOCK_ITEMS) {
+        mock_fail(__func__, "items past the RMT memory", channel);
+        return ESP_ERR_INVALID_ARG;
+    }
+    mock_enter_critical();
+    for (size_t i = 0; i < item_num; i++) {
+        RMTMEM.chan[channel].data32[mem_offset + i].val = item[i].val;
+    }
+    mock_exit_critical();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_tx_intr_en(rmt_channel_t channel, bool en)
+{
+    mock_driver_check(__func__, channel);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_tx_thr_intr_en(rmt_channel_t channel, bool en, uint16_t evt_thresh)
+{
+    mock_driver_check(__func__, channel);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_clk_div(rmt_channel_t channel, uint8_t div_cnt)
+{
+    mock_driver_check(__func__, channel);
+    RMT.conf_ch[channel].conf0.div_cnt = div_cnt;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_mem_block_num(rmt_channel_t channel, uint8_t rmt_mem_num)
+{
+    mock_driver_check(__func__, channel);
+    RMT.conf_ch[channel].conf0.mem_size = rmt_mem_num;
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_source_clk(rmt_channel_t channel, rmt_source_clk_t base_clk)
+{
+    mock_driver_check(__func__, channel);
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_tx_loop_mode(rmt_channel_t channel, bool loop_en)
+{
+    mock_driver_check(__func__, channel);
+    mock_enter_critical();
+    RMT.conf_ch[channel].conf1.tx_conti_mode = loop_en;
+    mock_exit_critical();
+    return ESP_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+
+esp_err_t rmt_set_idle_level(rmt_channel_t channel, bool idle_out_en, rmt_idle_level_t level)
+{
+    mock_driver_check(__func__, channel);
+    return ESP_OK;
+}
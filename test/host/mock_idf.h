@@ -0,0 +1,30 @@
+/* 
+   (c) Rafael González (astrorafael@gmail.com), LICA, Ftad. CC. Fisicas, UCM
+
+   See project's LICENSE file.
+*/
+
+#pragma once
+
+/* ************************************************************************* */
+/*                         INCLUDE HEADER SECTION                            */
+/* ************************************************************************* */
+
+#include <stdint.h>
+
+/* ************************************************************************* */
+/*                               API FUNCTIONS                               */
+/* ************************************************************************* */
+
+// Host stand-ins for the parts of ESP-IDF and FreeRTOS the generator uses.
+// Tasks and esp_timers run on threads of their own, spinlocks are one
+// recursive mutex and the RMT is a model reading one item every 20 us,
+// so that retunes and bursts see it moving. Every RMT driver call is
+// checked to be made with the generator lock held, and drivers are
+// never installed twice.
+
+// Starts the RMT model
+void mock_start(void);
+
+// Stops it, returning the number of failed checks so far
+uint32_t mock_stop(void);
@@ -0,0 +1,50 @@
+#pragma once
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "soc/rmt_struct.h"
+
+typedef enum {
+    RMT_CHANNEL_0, RMT_CHANNEL_1, RMT_CHANNEL_2, RMT_CHANNEL_3,
+    RMT_CHANNEL_4, RMT_CHANNEL_5, RMT_CHANNEL_6, RMT_CHANNEL_7,
+    RMT_CHANNEL_MAX
+} rmt_channel_t;
+
+typedef enum { RMT_CHANNEL_UNINIT, RMT_CHANNEL_IDLE, RMT_CHANNEL_BUSY } rmt_channel_status_t;
+typedef enum { RMT_MODE_TX, RMT_MODE_RX } rmt_mode_t;
+typedef enum { RMT_BASECLK_REF, RMT_BASECLK_APB } rmt_source_clk_t;
+typedef enum { RMT_IDLE_LEVEL_LOW, RMT_IDLE_LEVEL_HIGH } rmt_idle_level_t;
+
+typedef struct {
+    bool             loop_en;
+    bool             carrier_en;
+    bool             idle_output_en;
+    rmt_idle_level_t idle_level;
+} rmt_tx_config_t;
+
+typedef struct {
+    rmt_mode_t      rmt_mode;
+    rmt_channel_t   channel;
+    gpio_num_t      gpio_num;
+    uint8_t         clk_div;
+    uint8_t         mem_block_num;
+    uint32_t        flags;
+    rmt_tx_config_t tx_config;
+} rmt_config_t;
+
+typedef void (*rmt_tx_end_fn_t)(rmt_channel_t channel, void* arg);
+typedef struct { rmt_tx_end_fn_t function; void* arg; } rmt_tx_end_callback_t;
+
+esp_err_t rmt_config(const rmt_config_t* config);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags);
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel);
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool tx_idx_rst);
+esp_err_t rmt_tx_stop(rmt_channel_t channel);
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t* item, uint16_t item_num, uint16_t mem_offset);
+esp_err_t rmt_set_tx_intr_en(rmt_channel_t channel, bool en);
+esp_err_t rmt_set_tx_thr_intr_en(rmt_channel_t channel, bool en, uint16_t evt_thresh);
+esp_err_t rmt_set_clk_div(rmt_channel_t channel, uint8_t div_cnt);
+esp_err_t rmt_set_mem_block_num(rmt_channel_t channel, uint8_t rmt_mem_num);
+esp_err_t rmt_set_source_clk(rmt_channel_t channel, rmt_source_clk_t base_clk);
+esp_err_t rmt_set_tx_loop_mode(rmt_channel_t channel, bool loop_en);
+esp_err_t rmt_set_idle_level(rmt_channel_t channel, bool idle_out_en, rmt_idle_level_t level);
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg);
@@ -0,0 +1,12 @@
+#pragma once
+#include "esp_err.h"
+
+#define ESP_INTR_FLAG_LEVEL3    (1 << 3)
+#define ESP_INTR_FLAG_SHARED    (1 << 8)
+#define ESP_INTR_FLAG_IRAM      (1 << 10)
+
+typedef struct intr_handle_data_t* intr_handle_t;
+typedef void (*intr_handler_t)(void* arg);
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void* arg, intr_handle_t* ret_handle);
+esp_err_t esp_intr_free(intr_handle_t handle);
@@ -0,0 +1,29 @@
+#pragma once
+#include "esp_err.h"
+
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define portMAX_DELAY       0xffffffff
+#define pdMS_TO_TICKS(ms)   (ms)
+#define portTICK_PERIOD_MS  1
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY      0x7fffffff
+
+// All spinlocks are one recursive mutex, which also serializes the RMT
+// model against the interrupt side, see mock_idf.c
+typedef struct { int owner; int count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+
+void mock_enter_critical(void);
+void mock_exit_critical(void);
+
+#define portENTER_CRITICAL(mux)     do { (void) (mux); mock_enter_critical(); } while (0)
+#define portEXIT_CRITICAL(mux)      do { (void) (mux); mock_exit_critical(); } while (0)
+#define portENTER_CRITICAL_ISR(mux) do { (void) (mux); mock_enter_critical(); } while (0)
+#define portEXIT_CRITICAL_ISR(mux)  do { (void) (mux); mock_exit_critical(); } while (0)
+#define portYIELD_FROM_ISR()        do { } while (0)
@@ -0,0 +1,9 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef void* SemaphoreHandle_t;
+typedef struct { void* storage[16]; } StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t* buffer);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex);
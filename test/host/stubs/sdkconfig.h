@@ -0,0 +1,4 @@
+#pragma once
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_FGEN_GPIO_POOL "27,18,19,21,22,23,25,26"
+#define CONFIG_LOG_DEFAULT_LEVEL 1
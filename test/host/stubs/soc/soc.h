@@ -0,0 +1,2 @@
+#pragma once
+#define ETS_RMT_INTR_SOURCE 47
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+uint32_t mock_ccount(void);
+#define XTHAL_GET_CCOUNT() mock_ccount()